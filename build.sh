@@ -1 +1,3 @@
-g++ src/*.cpp -o server -pthread -L/usr/local/lib -lssl -lcrypto -std=c++11
\ No newline at end of file
+# 系统中有 brotli 的头文件时同时支持 brotli 压缩，否则只支持 gzip
+if echo '#include <brotli/encode.h>' | g++ -E -x c++ - >/dev/null 2>&1; then BROTLI="-DHAVE_BROTLI -lbrotlienc"; fi
+g++ src/*.cpp -o server -pthread -L/usr/local/lib -lssl -lcrypto -lz $BROTLI -std=c++11
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "admission.h"
+#include "stats.h"
+
+Admission::Admission()
+    : m_max_queue_depth(0),
+      m_max_queue_wait(0),
+      m_retry_after(1),
+      m_queue_depth(0),
+      m_queue_wait(0),
+      m_loop_busy(0)
+{
+}
+
+Admission *Admission::getInstance()
+{
+    static Admission admission;
+    return &admission;
+}
+
+void Admission::init(int max_queue_depth, int max_queue_wait, int retry_after)
+{
+    m_max_queue_depth = max_queue_depth > 0 ? max_queue_depth : 0;
+    m_max_queue_wait = max_queue_wait > 0 ? (uint64_t)max_queue_wait * 1000 : 0;
+    m_retry_after = retry_after > 0 ? retry_after : 1;
+}
+
+// 队列为空时不看排队时间：拒绝新请求后不再有任务出队，排队时间的平均值不会更新，
+// 只看平均值会在负载消失后继续拒绝。事件循环每一轮都会更新，没有这个问题
+bool Admission::admitNew() const
+{
+    if (m_max_queue_wait && m_loop_busy >= m_max_queue_wait)
+    {
+        return false;
+    }
+    int depth = m_queue_depth;
+    if (depth <= 0)
+    {
+        return true;
+    }
+    if (m_max_queue_depth && depth >= m_max_queue_depth)
+    {
+        return false;
+    }
+    return !m_max_queue_wait || m_queue_wait < m_max_queue_wait;
+}
+
+void Admission::enqueued()
+{
+    m_queue_depth++;
+}
+
+void Admission::dequeued(uint64_t wait)
+{
+    m_queue_depth--;
+    Stats::getInstance()->queue_wait.record(wait);
+    updateAverage(m_queue_wait, wait);
+}
+
+void Admission::loopFinished(uint64_t busy)
+{
+    updateAverage(m_loop_busy, busy);
+}
+
+// 权重 1/8，多个线程同时更新时丢失一次更新无关紧要
+void Admission::updateAverage(std::atomic<uint64_t> &average, uint64_t sample)
+{
+    uint64_t old = average.load(std::memory_order_relaxed);
+    average.store(old - old / 8 + sample / 8, std::memory_order_relaxed);
+}
+
+int Admission::queueDepth() const
+{
+    return m_queue_depth;
+}
+
+uint64_t Admission::queueWait() const
+{
+    return m_queue_wait;
+}
+
+uint64_t Admission::loopBusy() const
+{
+    return m_loop_busy;
+}
+
+int Admission::retryAfter() const
+{
+    return m_retry_after;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/* 准入控制：根据线程池请求队列的长度、请求在队列中的等待时间、Reactor 事件循环每轮的处理时间
+ * 和连接数判断服务器是否过载。后者近似于就绪的事件（包括监听队列中的新连接）在被处理之前等待的时间，
+ * Reactor 线程本身成为瓶颈时，请求在到达线程池之前就已经在排队了。
+ * 过载时优先拒绝新的工作：新连接上的第一个请求直接在 Reactor 线程中回复 503 和 Retry-After，
+ * 已经处理过请求的 keep-alive 连接上的请求照常进入队列，只有队列真正满了才被拒绝。
+ * 队列长度和等待时间由 Reactor 入队、工作线程出队时更新，各线程无锁地读写。 */
+class Admission
+{
+public:
+    static Admission *getInstance();
+    // max_queue_depth 为 0 表示不按队列长度拒绝，max_queue_wait 单位为毫秒，0 表示不按等待时间拒绝
+    void init(int max_queue_depth, int max_queue_wait, int retry_after);
+    bool admitNew() const;          // 是否接受新连接上的第一个请求
+    void enqueued();                // 一个任务进入线程池队列
+    void dequeued(uint64_t wait);   // 一个任务离开队列，wait 为排队的微秒数
+    void loopFinished(uint64_t busy); // Reactor 处理完一轮事件，busy 为这一轮处理事件的微秒数
+    int queueDepth() const;
+    uint64_t queueWait() const;     // 最近排队时间的指数加权平均（微秒）
+    uint64_t loopBusy() const;      // 最近事件循环每轮处理时间的指数加权平均（微秒）
+    int retryAfter() const;         // 503 响应中 Retry-After 的秒数
+
+private:
+    Admission();
+    static void updateAverage(std::atomic<uint64_t> &average, uint64_t sample);
+
+    int m_max_queue_depth;
+    uint64_t m_max_queue_wait; // 微秒
+    int m_retry_after;
+    std::atomic<int> m_queue_depth;
+    std::atomic<uint64_t> m_queue_wait;
+    std::atomic<uint64_t> m_loop_busy;
+};
@@ -0,0 +1,110 @@
+#include "byterange.h"
+
+static void skipSpaces(StringView input, size_t &i)
+{
+    while (i < input.size && (input[i] == ' ' || input[i] == '\t'))
+    {
+        ++i;
+    }
+}
+
+// 读取一个非负的十进制数，没有数字或者溢出时返回 false
+static bool readNumber(StringView input, size_t &i, off_t &value)
+{
+    size_t begin = i;
+    value = 0;
+    while (i < input.size && input[i] >= '0' && input[i] <= '9')
+    {
+        if (value > (((off_t)1 << 62) - 1) / 10)
+        {
+            return false;
+        }
+        value = value * 10 + (input[i] - '0');
+        ++i;
+    }
+    return i > begin;
+}
+
+ByteRanges::RESULT ByteRanges::parse(StringView header, off_t size, std::vector<ByteRange> &ranges)
+{
+    ranges.clear();
+    if (header.size < 6 || !header.substr(0, 6).iequals("bytes="))
+    {
+        return RANGE_IGNORED;
+    }
+    size_t i = 6;
+    size_t specs = 0;
+    off_t total = 0;
+    while (true)
+    {
+        skipSpaces(header, i);
+        if (i < header.size && header[i] == ',')
+        {
+            // 列表中允许空的元素
+            ++i;
+            continue;
+        }
+        if (i >= header.size)
+        {
+            break;
+        }
+        if (++specs > MAX_RANGES)
+        {
+            ranges.clear();
+            return RANGE_IGNORED;
+        }
+        ByteRange range;
+        if (header[i] == '-')
+        {
+            off_t suffix;
+            ++i;
+            if (!readNumber(header, i, suffix))
+            {
+                ranges.clear();
+                return RANGE_IGNORED;
+            }
+            range.first = suffix < size ? size - suffix : 0;
+            range.last = size - 1;
+            if (suffix == 0)
+            {
+                range.first = size; // 长度为 0 的后缀不可满足
+            }
+        }
+        else
+        {
+            off_t last = size - 1;
+            if (!readNumber(header, i, range.first) || i >= header.size || header[i] != '-')
+            {
+                ranges.clear();
+                return RANGE_IGNORED;
+            }
+            ++i;
+            if (i < header.size && header[i] >= '0' && header[i] <= '9')
+            {
+                if (!readNumber(header, i, last) || last < range.first)
+                {
+                    ranges.clear();
+                    return RANGE_IGNORED;
+                }
+            }
+            range.last = last < size - 1 ? last : size - 1;
+        }
+        skipSpaces(header, i);
+        if (i < header.size && header[i] != ',')
+        {
+            ranges.clear();
+            return RANGE_IGNORED;
+        }
+        if (range.first < size)
+        {
+            ranges.push_back(range);
+            total += range.length();
+        }
+    }
+    if (specs == 0 || total > size)
+    {
+        ranges.clear();
+        return RANGE_IGNORED;
+    }
+    return ranges.empty() ? RANGE_UNSATISFIABLE : RANGE_SATISFIABLE;
+}
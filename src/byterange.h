@@ -0,0 +1,34 @@
+#pragma once
+
+#include <sys/types.h>
+#include <vector>
+#include "stringview.h"
+
+// 请求的一个字节范围，[first, last] 闭区间，已经按文件大小截断
+struct ByteRange
+{
+    off_t first;
+    off_t last;
+
+    off_t length() const { return last - first + 1; }
+};
+
+/* Range 首部（RFC 9110 14.1.2）的解析器。"bytes=" 之后是逗号分隔的范围：
+ * "first-last"、"first-"（到文件末尾）和 "-suffix"（最后 suffix 个字节）。
+ * 超出文件末尾的 last 截断到文件末尾，first 超出文件末尾的范围不可满足，被跳过。
+ * 首部格式不正确、单位不是 bytes、范围超过 MAX_RANGES 个或者总长度超过文件本身时忽略整个首部，
+ * 回复完整的文件：重叠的小范围不能把一个请求放大成多倍的响应。 */
+class ByteRanges
+{
+public:
+    static const size_t MAX_RANGES = 16;
+
+    enum RESULT
+    {
+        RANGE_IGNORED,      // 回复完整的文件
+        RANGE_SATISFIABLE,  // ranges 中至少有一个范围
+        RANGE_UNSATISFIABLE // 所有范围都在文件末尾之后，回复 416
+    };
+
+    static RESULT parse(StringView header, off_t size, std::vector<ByteRange> &ranges);
+};
@@ -0,0 +1,146 @@
+#include "chunked.h"
+#include <stdint.h>
+#include <string.h>
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+ChunkedDecoder::ChunkedDecoder()
+{
+    reset();
+}
+
+void ChunkedDecoder::reset()
+{
+    m_state = STATE_SIZE;
+    m_chunk = 0;
+    m_digits = 0;
+    m_size = 0;
+}
+
+size_t ChunkedDecoder::decode(const char *data, size_t size, char *out, size_t &out_size)
+{
+    const char *p = data;
+    const char *end = data + size;
+    out_size = 0;
+    while (p < end && m_state != STATE_DONE && m_state != STATE_BAD)
+    {
+        if (m_state == STATE_DATA)
+        {
+            // 块数据整段移动，原地解码时输出位置总在输入位置之前
+            size_t len = (size_t)(end - p) < m_chunk ? end - p : m_chunk;
+            memmove(out + out_size, p, len);
+            out_size += len;
+            m_size += len;
+            m_chunk -= len;
+            p += len;
+            if (m_chunk == 0)
+            {
+                m_state = STATE_DATA_CR;
+            }
+            continue;
+        }
+        char c = *p++;
+        switch (m_state)
+        {
+        case STATE_SIZE:
+            if (hexDigit(c) >= 0)
+            {
+                if (m_chunk > (SIZE_MAX >> 4))
+                {
+                    m_state = STATE_BAD;
+                    break;
+                }
+                m_chunk = m_chunk << 4 | hexDigit(c);
+                ++m_digits;
+            }
+            else if (m_digits == 0)
+            {
+                m_state = STATE_BAD;
+            }
+            else if (c == ';' || c == ' ' || c == '\t')
+            {
+                m_state = STATE_EXTENSION;
+            }
+            else if (c == '\r')
+            {
+                m_state = STATE_SIZE_LF;
+            }
+            else
+            {
+                m_state = STATE_BAD;
+            }
+            break;
+        case STATE_EXTENSION:
+            if (c == '\r')
+            {
+                m_state = STATE_SIZE_LF;
+            }
+            break;
+        case STATE_SIZE_LF:
+            if (c != '\n')
+            {
+                m_state = STATE_BAD;
+            }
+            else
+            {
+                m_digits = 0;
+                m_state = m_chunk == 0 ? STATE_TRAILER : STATE_DATA;
+            }
+            break;
+        case STATE_DATA_CR:
+            m_state = c == '\r' ? STATE_DATA_LF : STATE_BAD;
+            break;
+        case STATE_DATA_LF:
+            m_state = c == '\n' ? STATE_SIZE : STATE_BAD;
+            break;
+        case STATE_TRAILER:
+            m_state = c == '\r' ? STATE_END_LF : STATE_TRAILER_LINE;
+            break;
+        case STATE_TRAILER_LINE:
+            if (c == '\r')
+            {
+                m_state = STATE_TRAILER_LF;
+            }
+            break;
+        case STATE_TRAILER_LF:
+            m_state = c == '\n' ? STATE_TRAILER : STATE_BAD;
+            break;
+        case STATE_END_LF:
+            m_state = c == '\n' ? STATE_DONE : STATE_BAD;
+            break;
+        default:
+            break;
+        }
+    }
+    return p - data;
+}
+
+bool ChunkedDecoder::finished() const
+{
+    return m_state == STATE_DONE;
+}
+
+bool ChunkedDecoder::failed() const
+{
+    return m_state == STATE_BAD;
+}
+
+size_t ChunkedDecoder::size() const
+{
+    return m_size;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+/* Transfer-Encoding: chunked 请求体的增量解码器。
+ * 数据到达一段就解码一段，解码结果可以直接写回输入所在的内存（原地解码，输出永远不会超过输入）：
+ * 块大小行（含扩展）、块后的 "\r\n" 和尾部首部都被丢弃，只输出块的数据。
+ * 最后一个块（大小为 0）和尾部之后的数据属于下一个请求，不会被消耗。 */
+class ChunkedDecoder
+{
+public:
+    ChunkedDecoder();
+
+    void reset();
+    // 解码 data 开始的 size 个字节，解码出的数据写到 out（可以等于 data），写出的字节数保存在 out_size 中。
+    // 返回消耗的输入字节数
+    size_t decode(const char *data, size_t size, char *out, size_t &out_size);
+    bool finished() const;
+    bool failed() const;
+    size_t size() const; // 已经解码出的请求体长度
+
+private:
+    enum State
+    {
+        STATE_SIZE = 0,      // 块大小（十六进制）
+        STATE_EXTENSION,     // 块扩展，忽略到行尾
+        STATE_SIZE_LF,
+        STATE_DATA,
+        STATE_DATA_CR,       // 块数据之后的 "\r\n"
+        STATE_DATA_LF,
+        STATE_TRAILER,       // 尾部首部的行首，空行表示请求体结束
+        STATE_TRAILER_LINE,  // 尾部首部，忽略到行尾
+        STATE_TRAILER_LF,
+        STATE_END_LF,        // 结束空行的 '\n'
+        STATE_DONE,
+        STATE_BAD
+    };
+
+    State m_state;
+    size_t m_chunk;  // 当前块还没有解码的字节数，解析块大小时为已经读到的值
+    int m_digits;    // 块大小的十六进制位数
+    size_t m_size;
+};
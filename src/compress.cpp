@@ -0,0 +1,200 @@
+#include "compress.h"
+#include <string.h>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+bool Compressor::m_enabled = true;
+size_t Compressor::m_min_size = 1024;
+
+// 读取 ";q=" 参数，没有时为 1。q 值最多三位小数，放大 1000 倍比较
+static int qvalue(StringView params)
+{
+    size_t i = 0;
+    while ((i = params.find(';', i)) != StringView::npos)
+    {
+        ++i;
+        while (i < params.size && (params[i] == ' ' || params[i] == '\t'))
+        {
+            ++i;
+        }
+        if (i + 1 < params.size && (params[i] == 'q' || params[i] == 'Q') && params[i + 1] == '=')
+        {
+            i += 2;
+            int q = 0;
+            if (i < params.size && params[i] == '1')
+            {
+                return 1000;
+            }
+            if (i < params.size && params[i] == '0')
+            {
+                ++i;
+            }
+            if (i < params.size && params[i] == '.')
+            {
+                ++i;
+                for (int scale = 100; scale > 0 && i < params.size && params[i] >= '0' && params[i] <= '9'; scale /= 10)
+                {
+                    q += (params[i++] - '0') * scale;
+                }
+            }
+            return q;
+        }
+    }
+    return 1000;
+}
+
+CONTENT_ENCODING Compressor::negotiate(StringView accept_encoding)
+{
+    int gzip = -1, brotli = -1, any = -1;
+    size_t begin = 0;
+    while (begin < accept_encoding.size)
+    {
+        size_t end = accept_encoding.find(',', begin);
+        if (end == StringView::npos)
+        {
+            end = accept_encoding.size;
+        }
+        StringView item = accept_encoding.substr(begin, end - begin);
+        begin = end + 1;
+        size_t i = 0;
+        while (i < item.size && (item[i] == ' ' || item[i] == '\t'))
+        {
+            ++i;
+        }
+        size_t j = i;
+        while (j < item.size && item[j] != ';' && item[j] != ' ' && item[j] != '\t')
+        {
+            ++j;
+        }
+        StringView coding = item.substr(i, j - i);
+        int q = qvalue(item.substr(j));
+        if (coding.iequals("gzip") || coding.iequals("x-gzip"))
+        {
+            gzip = q;
+        }
+        else if (coding.iequals("br"))
+        {
+            brotli = q;
+        }
+        else if (coding == "*")
+        {
+            any = q;
+        }
+    }
+    // 没有单独列出的编码按 "*" 的 q 值
+    gzip = gzip < 0 ? any : gzip;
+    brotli = brotli < 0 ? any : brotli;
+#ifndef HAVE_BROTLI
+    brotli = -1;
+#endif
+    if (brotli > 0 && brotli >= gzip)
+    {
+        return ENCODING_BROTLI;
+    }
+    if (gzip > 0)
+    {
+        return ENCODING_GZIP;
+    }
+    return ENCODING_IDENTITY;
+}
+
+bool Compressor::compressible(const char *content_type)
+{
+    static const char *TYPES[] = {"text/", "application/javascript", "application/json", "application/xml",
+                                  "image/svg+xml"};
+    for (const char *type : TYPES)
+    {
+        if (strncmp(content_type, type, strlen(type)) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *Compressor::name(CONTENT_ENCODING encoding)
+{
+    switch (encoding)
+    {
+    case ENCODING_GZIP:
+        return "gzip";
+    case ENCODING_BROTLI:
+        return "br";
+    default:
+        return "identity";
+    }
+}
+
+const char *Compressor::suffix(CONTENT_ENCODING encoding)
+{
+    switch (encoding)
+    {
+    case ENCODING_GZIP:
+        return ".gz";
+    case ENCODING_BROTLI:
+        return ".br";
+    default:
+        return "";
+    }
+}
+
+// 能容纳 len 字节的最小窗口（以 2 为底的对数）。窗口不需要比输入大，
+// 小窗口减少了编码器初始化时分配和清零的内存，几 KB 的网页初始化的开销比压缩本身还大
+static int windowBits(size_t len, int min_bits, int max_bits)
+{
+    int bits = min_bits;
+    while (bits < max_bits && ((size_t)1 << bits) < len)
+    {
+        ++bits;
+    }
+    return bits;
+}
+
+static bool gzip(const char *data, size_t len, int level, std::string &out)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // windowBits 加 16 表示输出 gzip 格式（而不是 zlib 格式），哈希表（memLevel）随窗口缩小
+    int bits = windowBits(len, 10, 15);
+    if (deflateInit2(&stream, level, Z_DEFLATED, bits + 16, bits - 7, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return false;
+    }
+    out.resize(deflateBound(&stream, len));
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = len;
+    stream.next_out = (Bytef *)&out[0];
+    stream.avail_out = out.size();
+    int ret = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return ret == Z_STREAM_END;
+}
+
+bool Compressor::compress(CONTENT_ENCODING encoding, const char *data, size_t len, bool dynamic, std::string &out)
+{
+    if (encoding == ENCODING_GZIP)
+    {
+        return gzip(data, len, dynamic ? DYNAMIC_LEVEL : STATIC_LEVEL, out);
+    }
+#ifdef HAVE_BROTLI
+    if (encoding == ENCODING_BROTLI)
+    {
+        size_t size = BrotliEncoderMaxCompressedSize(len);
+        out.resize(size);
+        int quality = dynamic ? DYNAMIC_QUALITY : STATIC_QUALITY;
+        int bits = windowBits(len, BROTLI_MIN_WINDOW_BITS, BROTLI_DEFAULT_WINDOW);
+        if (size == 0 || !BrotliEncoderCompress(quality, bits, BROTLI_MODE_TEXT, len, (const uint8_t *)data, &size,
+                                                (uint8_t *)&out[0]))
+        {
+            out.clear();
+            return false;
+        }
+        out.resize(size);
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include "stringview.h"
+
+enum CONTENT_ENCODING
+{
+    ENCODING_IDENTITY = 0,
+    ENCODING_GZIP,
+    ENCODING_BROTLI
+};
+
+/* 响应体的压缩。gzip 使用 zlib；编译时定义了 HAVE_BROTLI（build.sh 检测到 brotli 的头文件时定义）才支持 brotli。
+ * 静态文件的压缩版本在放入文件缓存时生成一次（或者直接读取同目录下的 .gz/.br 文件），使用最高的压缩级别；
+ * CGI 生成的网页每次压缩，使用较低的级别，以免压缩的 CPU 时间超过节省的传输时间。 */
+class Compressor
+{
+public:
+    static bool m_enabled;     // 是否压缩响应
+    static size_t m_min_size;  // 小于这个长度的响应体不压缩，压缩节省的字节不够抵消首部和 CPU 开销
+    static const int STATIC_LEVEL = 9;   // 静态文件的 gzip 级别
+    static const int DYNAMIC_LEVEL = 5;  // 动态内容的 gzip 级别
+    static const int STATIC_QUALITY = 9; // 静态文件的 brotli 质量（11 比 9 慢一个数量级，只小几个百分点）
+    static const int DYNAMIC_QUALITY = 5; // 动态内容的 brotli 质量（几 KB 的网页 5 和 4 耗时相近，输出小 10% 以上）
+
+    // 按 Accept-Encoding（包括 q 值和 "*"）选出客户端接受的最好的编码，同样接受时 brotli 优先
+    static CONTENT_ENCODING negotiate(StringView accept_encoding);
+    static bool compressible(const char *content_type); // 文本类的内容才值得压缩，图片和视频已经压缩过
+    static const char *name(CONTENT_ENCODING encoding);  // Content-Encoding 的值
+    static const char *suffix(CONTENT_ENCODING encoding); // 预压缩文件的扩展名
+    // 把 data 压缩后保存到 out 中，dynamic 表示动态内容（使用较低的级别）。失败或者不支持该编码时返回 false
+    static bool compress(CONTENT_ENCODING encoding, const char *data, size_t len, bool dynamic, std::string &out);
+};
@@ -0,0 +1,137 @@
+#include "connslab.h"
+#include "httpconnection.h"
+#include "log.h"
+#include "stats.h"
+#include "admission.h"
+
+struct ConnectionSlab::Slot
+{
+    Slot() : generation(1) {}
+
+    HTTPConnection conn;
+    std::atomic<uint32_t> generation;
+};
+
+static inline uint32_t handleIndex(ConnHandle handle)
+{
+    return (uint32_t)handle;
+}
+
+static inline uint32_t handleGeneration(ConnHandle handle)
+{
+    return (uint32_t)(handle >> 32) & ConnectionSlab::GENERATION_MASK;
+}
+
+ConnectionSlab::ConnectionSlab(int capacity)
+    : m_capacity(capacity),
+      m_chunk_number((capacity + CHUNK_SIZE - 1) / CHUNK_SIZE),
+      m_next(0)
+{
+    // 块指针数组按容量一次分配好，查找槽位时不需要加锁
+    m_chunks = new std::atomic<Slot *>[m_chunk_number];
+    for (int i = 0; i < m_chunk_number; ++i)
+    {
+        m_chunks[i] = NULL;
+    }
+    Stats::getInstance()->conn_slot_bytes = sizeof(Slot);
+}
+
+ConnectionSlab::~ConnectionSlab()
+{
+    for (int i = 0; i < m_chunk_number; ++i)
+    {
+        delete[] m_chunks[i].load();
+    }
+    delete[] m_chunks;
+}
+
+ConnectionSlab::Slot *ConnectionSlab::slot(uint32_t index) const
+{
+    if (index >= (uint32_t)m_capacity)
+    {
+        return NULL;
+    }
+    Slot *chunk = m_chunks[index / CHUNK_SIZE].load(std::memory_order_acquire);
+    return chunk ? &chunk[index % CHUNK_SIZE] : NULL;
+}
+
+HTTPConnection *ConnectionSlab::acquire(ConnHandle &handle)
+{
+    uint32_t index;
+    m_locker.lock();
+    if (!m_free.empty())
+    {
+        index = m_free.back();
+        m_free.pop_back();
+    }
+    else if (m_next < (uint32_t)m_capacity)
+    {
+        index = m_next++;
+        if (index % CHUNK_SIZE == 0)
+        {
+            m_chunks[index / CHUNK_SIZE].store(new Slot[CHUNK_SIZE], std::memory_order_release);
+            Stats::getInstance()->conn_slots += CHUNK_SIZE;
+        }
+    }
+    else
+    {
+        m_locker.unlock();
+        return NULL;
+    }
+    m_locker.unlock();
+    Slot *s = slot(index);
+    handle = ((ConnHandle)s->generation.load() << 32) | index;
+    return &s->conn;
+}
+
+void ConnectionSlab::release(ConnHandle handle)
+{
+    Slot *s = slot(handleIndex(handle));
+    uint32_t generation = handleGeneration(handle);
+    if (s == NULL || s->generation.load() != generation)
+    {
+        return;
+    }
+    generation = (generation + 1) & GENERATION_MASK;
+    s->generation = generation ? generation : 1;
+    m_locker.lock();
+    m_free.push_back(handleIndex(handle));
+    m_locker.unlock();
+}
+
+HTTPConnection *ConnectionSlab::get(ConnHandle handle) const
+{
+    Slot *s = slot(handleIndex(handle));
+    if (s == NULL || s->generation.load(std::memory_order_acquire) != handleGeneration(handle))
+    {
+        return NULL;
+    }
+    return &s->conn;
+}
+
+int ConnectionSlab::capacity() const
+{
+    return m_capacity;
+}
+
+void ConnTask::process() const
+{
+    Admission::getInstance()->dequeued(nowMicros() - enqueued);
+    HTTPConnection *conn = slab->get(handle);
+    if (conn == NULL)
+    {
+        Stats::getInstance()->stale_events++;
+        return;
+    }
+    // 任务排队期间 Reactor 可能因超时关闭了连接（它拿得到锁），加锁后重新检查句柄。
+    // 槽位的内存不会释放，连接关闭后加锁、解锁仍然是安全的
+    conn->lockProcess();
+    if (slab->get(handle) != conn)
+    {
+        conn->unlockProcess();
+        Stats::getInstance()->stale_events++;
+        return;
+    }
+    conn->process();
+    conn->unlockProcess();
+}
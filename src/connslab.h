@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "locker.h"
+
+class HTTPConnection;
+
+/* 连接句柄：低 32 位为槽位下标，32~59 位为槽位的代数（generation）。
+ * 槽位每释放一次代数加一，因此连接关闭后仍留在 epoll、线程池或时间堆中的旧句柄都会失效。
+ * 代数从 1 开始，有效句柄总是不小于 2^32，不会和以 fd 本身作为事件数据的监听 socket、eventfd 混淆；
+ * 最高 4 位留给 io_uring 后端保存请求类型。 */
+typedef uint64_t ConnHandle;
+
+/* 连接表：按块（CHUNK_SIZE 个槽位）按需分配 HTTPConnection，而不是按最大 fd 预先分配。
+ * 块一旦分配就不再释放，连接对象的地址在服务器运行期间保持有效；
+ * 空闲槽位中的连接对象不持有任何堆内存。acquire/release 可以在任意线程中调用。 */
+class ConnectionSlab
+{
+public:
+    static const int CHUNK_SIZE = 256;
+    static const uint32_t GENERATION_MASK = 0x0fffffff;
+
+    explicit ConnectionSlab(int capacity);
+    ~ConnectionSlab();
+    HTTPConnection *acquire(ConnHandle &handle); // 分配一个槽位，连接数已达上限时返回 NULL
+    void release(ConnHandle handle);             // 释放槽位，使该句柄失效
+    HTTPConnection *get(ConnHandle handle) const; // 句柄已经失效时返回 NULL
+    int capacity() const;
+    static bool isHandle(uint64_t data) { return data >> 32 != 0; } // 区分连接句柄和以 fd 为数据的事件
+
+private:
+    struct Slot;
+
+    Slot *slot(uint32_t index) const;
+
+    int m_capacity;
+    int m_chunk_number;
+    std::atomic<Slot *> *m_chunks;
+    std::vector<uint32_t> m_free; // 释放过的槽位，后进先出以复用刚刚用过的内存
+    uint32_t m_next;              // 从未使用过的下一个槽位
+    Locker m_locker;
+};
+
+// 线程池中的任务只保存连接句柄，连接在排队期间被关闭或复用时任务被丢弃
+struct ConnTask
+{
+    ConnectionSlab *slab;
+    ConnHandle handle;
+    uint64_t enqueued; // 入队时间（微秒），用于统计排队时间
+    void process() const;
+};
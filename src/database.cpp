@@ -18,6 +18,7 @@ Database::Database(std::string filepath, int max_edit_, int dump_interval_, int
     m_dump_interval = dump_interval_;
     m_edit_count = 0;
     m_db_thread_stop = false;
+    m_detached = false;
     loadFile();
     pthread_create(m_db_thread.get(), NULL, db_thread_run, this);
 }
@@ -37,6 +38,24 @@ void Database::init(std::string filepath, int max_edit_, int dump_interval_, int
     }
 }
 
+void Database::flush()
+{
+    if (m_db.get() != nullptr)
+    {
+        m_db->dumpFile();
+    }
+}
+
+void Database::detach()
+{
+    if (m_db.get() != nullptr)
+    {
+        m_db->m_thread_locker.lock();
+        m_db->m_detached = true;
+        m_db->m_thread_locker.unlock();
+    }
+}
+
 Database::~Database()
 {
     m_db_thread_stop = true;
@@ -172,6 +191,13 @@ void Database::db_async_write()
 
 void Database::dumpFile()
 {
+    // 后台线程和热升级可能同时写文件
+    m_thread_locker.lock();
+    if (m_detached)
+    {
+        m_thread_locker.unlock();
+        return;
+    }
     m_rw_locker.readLock();
     m_file_writer.open(m_db_file_path);
     for (auto iter = m_data_dict.begin(); iter != m_data_dict.end(); iter++)
@@ -190,4 +216,5 @@ void Database::dumpFile()
     m_rw_locker.readUnlock();
     m_file_writer.flush();
     m_file_writer.close();
+    m_thread_locker.unlock();
 }
\ No newline at end of file
@@ -20,6 +20,8 @@ public:
     static void releaseDBConnection();
 
     static void init(std::string filepath, int max_edit_, int dump_interval_, int max_conn_);
+    static void flush();  // 立即把数据写回文件
+    static void detach(); // 之后不再写文件，热升级后数据文件由新进程负责
 
     ~Database();
     
@@ -59,4 +61,5 @@ private:
 
     std::unique_ptr<pthread_t> m_db_thread;
     bool m_db_thread_stop;
+    bool m_detached;
 };
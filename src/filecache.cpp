@@ -0,0 +1,429 @@
+#include "filecache.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <functional>
+#include "httpdate.h"
+#include "log.h"
+#include "stats.h"
+
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+FileCache::FileCache() : m_shard_size(0), m_max_file_size(0), m_bytes(0), m_entries(0), m_inotify_fd(-1)
+{
+    for (int i = 0; i < SHARD_NUMBER; ++i)
+    {
+        pthread_rwlock_init(&m_shards[i].lock, NULL);
+        m_shards[i].bytes = 0;
+        m_shards[i].generation = 0;
+    }
+}
+
+FileCache::~FileCache()
+{
+    for (int i = 0; i < SHARD_NUMBER; ++i)
+    {
+        pthread_rwlock_destroy(&m_shards[i].lock);
+    }
+}
+
+FileCache *FileCache::getInstance()
+{
+    static FileCache cache;
+    return &cache;
+}
+
+bool FileCache::init(const std::string &root, size_t max_size, size_t max_file_size)
+{
+    if (max_size == 0)
+    {
+        return true;
+    }
+    m_inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (m_inotify_fd == -1)
+    {
+        // 没有 inotify 就无法知道文件何时变化，不使用缓存
+        LOG_WARN << "inotify_init1 failed, errno: " << errno << ", file cache disabled." << Log::endl;
+        return false;
+    }
+    watch(root);
+    size_t shard_size = max_size / SHARD_NUMBER;
+    m_max_file_size = max_file_size < shard_size ? max_file_size : shard_size;
+    m_shard_size = shard_size;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, watch_thread_run, this) != 0)
+    {
+        LOG_ERROR << "file cache watch thread create failed." << Log::endl;
+        m_shard_size = 0;
+        return false;
+    }
+    pthread_detach(thread);
+    LOG_INFO << "file cache: " << max_size << " bytes, " << m_watches.size() << " directories watched." << Log::endl;
+    return true;
+}
+
+FileCache::Shard &FileCache::shard(const std::string &path)
+{
+    return m_shards[std::hash<std::string>()(path) % SHARD_NUMBER];
+}
+
+// 只缓存规范形式的路径，保证和 inotify 报告的路径一一对应
+static bool canonical(const std::string &path)
+{
+    if (path.empty() || path.back() == '/' || path.find("//") != std::string::npos)
+    {
+        return false;
+    }
+    size_t begin = 0;
+    while (begin <= path.size())
+    {
+        size_t end = path.find('/', begin);
+        if (end == std::string::npos)
+        {
+            end = path.size();
+        }
+        if (path.compare(begin, end - begin, ".") == 0 || path.compare(begin, end - begin, "..") == 0)
+        {
+            return false;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+CachedFilePtr FileCache::get(const std::string &path)
+{
+    if (m_shard_size == 0 || !canonical(path))
+    {
+        return CachedFilePtr();
+    }
+    Shard &s = shard(path);
+    pthread_rwlock_rdlock(&s.lock);
+    auto it = s.files.find(path);
+    if (it != s.files.end())
+    {
+        CachedFilePtr file = it->second;
+        pthread_rwlock_unlock(&s.lock);
+        file->referenced.store(true, std::memory_order_relaxed);
+        Stats::getInstance()->file_cache_hits++;
+        return file;
+    }
+    pthread_rwlock_unlock(&s.lock);
+    Stats::getInstance()->file_cache_misses++;
+    uint64_t generation = s.generation;
+    CachedFilePtr file = load(path);
+    if (file)
+    {
+        insert(s, path, file, generation);
+    }
+    return file;
+}
+
+CachedFilePtr FileCache::load(const std::string &path) const
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return CachedFilePtr();
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH) || st.st_size == 0 ||
+        (size_t)st.st_size > m_max_file_size)
+    {
+        close(fd);
+        return CachedFilePtr();
+    }
+    std::shared_ptr<CachedFile> file(new CachedFile);
+    file->data.resize(st.st_size);
+    ssize_t len = pread(fd, &file->data[0], st.st_size, 0);
+    close(fd);
+    if (len != st.st_size)
+    {
+        return CachedFilePtr();
+    }
+    file->size = st.st_size;
+    file->mtime = st.st_mtime;
+    file->etag = entityTag(st.st_mtime, st.st_size);
+    file->last_modified = HTTPDate::format(st.st_mtime);
+    file->content_type = contentType(path);
+    file->referenced = false;
+    if (Compressor::m_enabled && Compressor::compressible(file->content_type) &&
+        file->data.size() >= Compressor::m_min_size)
+    {
+        loadEncoded(path, *file, ENCODING_GZIP);
+        loadEncoded(path, *file, ENCODING_BROTLI);
+    }
+    return file;
+}
+
+void FileCache::loadEncoded(const std::string &path, CachedFile &file, CONTENT_ENCODING encoding) const
+{
+    std::string &out = encoding == ENCODING_GZIP ? file.gzip : file.brotli;
+    int fd = open((path + Compressor::suffix(encoding)).c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd != -1 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime >= file.mtime &&
+        st.st_size > 0 && (size_t)st.st_size < file.data.size())
+    {
+        out.resize(st.st_size);
+        if (pread(fd, &out[0], st.st_size, 0) != st.st_size)
+        {
+            out.clear();
+        }
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    if (out.empty() && (!Compressor::compress(encoding, file.data.data(), file.data.size(), false, out) ||
+                        out.size() >= file.data.size()))
+    {
+        std::string().swap(out);
+    }
+}
+
+const std::string &CachedFile::encoded(CONTENT_ENCODING encoding) const
+{
+    switch (encoding)
+    {
+    case ENCODING_GZIP:
+        return gzip;
+    case ENCODING_BROTLI:
+        return brotli;
+    default:
+        return data;
+    }
+}
+
+void FileCache::insert(Shard &s, const std::string &path, const CachedFilePtr &file, uint64_t generation)
+{
+    pthread_rwlock_wrlock(&s.lock);
+    if (s.generation != generation || s.files.count(path))
+    {
+        // 读取期间分片中有文件失效（可能就是这个文件），或者其他线程已经放入了这个文件
+        pthread_rwlock_unlock(&s.lock);
+        return;
+    }
+    // CLOCK 置换：最多扫描两遍，第一遍清零的访问位在第二遍时就可以被移出
+    for (int pass = 0; pass < 2 && s.bytes + file->memory() > m_shard_size; ++pass)
+    {
+        for (auto it = s.files.begin(); it != s.files.end() && s.bytes + file->memory() > m_shard_size;)
+        {
+            if (it->second->referenced.exchange(false, std::memory_order_relaxed))
+            {
+                ++it;
+                continue;
+            }
+            s.bytes -= it->second->memory();
+            m_bytes -= it->second->memory();
+            --m_entries;
+            Stats::getInstance()->file_cache_evictions++;
+            it = s.files.erase(it);
+        }
+    }
+    s.files.emplace(path, file);
+    s.bytes += file->memory();
+    m_bytes += file->memory();
+    ++m_entries;
+    pthread_rwlock_unlock(&s.lock);
+}
+
+void FileCache::invalidate(const std::string &path)
+{
+    Shard &s = shard(path);
+    pthread_rwlock_wrlock(&s.lock);
+    ++s.generation;
+    auto it = s.files.find(path);
+    if (it != s.files.end())
+    {
+        s.bytes -= it->second->memory();
+        m_bytes -= it->second->memory();
+        --m_entries;
+        Stats::getInstance()->file_cache_invalidations++;
+        s.files.erase(it);
+    }
+    pthread_rwlock_unlock(&s.lock);
+}
+
+void FileCache::invalidatePrefix(const std::string &prefix)
+{
+    for (int i = 0; i < SHARD_NUMBER; ++i)
+    {
+        Shard &s = m_shards[i];
+        pthread_rwlock_wrlock(&s.lock);
+        ++s.generation;
+        for (auto it = s.files.begin(); it != s.files.end();)
+        {
+            if (it->first.compare(0, prefix.size(), prefix) != 0)
+            {
+                ++it;
+                continue;
+            }
+            s.bytes -= it->second->memory();
+            m_bytes -= it->second->memory();
+            --m_entries;
+            Stats::getInstance()->file_cache_invalidations++;
+            it = s.files.erase(it);
+        }
+        pthread_rwlock_unlock(&s.lock);
+    }
+}
+
+void FileCache::watch(const std::string &dir)
+{
+    int wd = inotify_add_watch(m_inotify_fd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if (wd == -1)
+    {
+        LOG_WARN << "inotify_add_watch " << dir << " failed, errno: " << errno << Log::endl;
+        return;
+    }
+    m_watches[wd] = dir;
+    DIR *dp = opendir(dir.c_str());
+    if (dp == NULL)
+    {
+        return;
+    }
+    while (dirent *entry = readdir(dp))
+    {
+        if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+            watch(dir + "/" + entry->d_name);
+        }
+    }
+    closedir(dp);
+}
+
+void *FileCache::watch_thread_run(void *arg)
+{
+    ((FileCache *)arg)->watchLoop();
+    return NULL;
+}
+
+void FileCache::watchLoop()
+{
+    alignas(inotify_event) char buf[16384];
+    while (true)
+    {
+        ssize_t len = read(m_inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            if (len == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            // 不能再得知文件的变化，停止使用缓存
+            LOG_ERROR << "inotify read failed, errno: " << errno << ", file cache disabled." << Log::endl;
+            m_shard_size = 0;
+            invalidatePrefix("");
+            return;
+        }
+        for (char *p = buf; p < buf + len;)
+        {
+            inotify_event *event = (inotify_event *)p;
+            p += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // 丢失了事件，不知道哪些文件变化了
+                invalidatePrefix("");
+                continue;
+            }
+            auto dir = m_watches.find(event->wd);
+            if (dir == m_watches.end())
+            {
+                continue;
+            }
+            if (event->mask & IN_IGNORED)
+            {
+                m_watches.erase(dir);
+                continue;
+            }
+            if (event->len == 0)
+            {
+                // 被监视的目录本身被删除或移走，其中的文件都不再能通过原来的路径访问
+                invalidatePrefix(dir->second + "/");
+                continue;
+            }
+            std::string path = dir->second + "/" + event->name;
+            if (event->mask & IN_ISDIR)
+            {
+                invalidatePrefix(path + "/");
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    watch(path);
+                }
+                continue;
+            }
+            invalidate(path);
+            // 预压缩的文件变化时，缓存中原文件的压缩版本也要更新
+            for (CONTENT_ENCODING encoding : {ENCODING_GZIP, ENCODING_BROTLI})
+            {
+                size_t len = strlen(Compressor::suffix(encoding));
+                if (path.size() > len && path.compare(path.size() - len, len, Compressor::suffix(encoding)) == 0)
+                {
+                    invalidate(path.substr(0, path.size() - len));
+                }
+            }
+        }
+    }
+}
+
+size_t FileCache::bytes() const
+{
+    return m_bytes;
+}
+
+size_t FileCache::entries() const
+{
+    return m_entries;
+}
+
+std::string FileCache::entityTag(time_t mtime, off_t size)
+{
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)mtime, (unsigned long)size);
+    return etag;
+}
+
+const char *FileCache::contentType(const std::string &path)
+{
+    static const struct
+    {
+        const char *extension;
+        const char *type;
+    } TYPES[] = {
+        {".html", "text/html"},
+        {".htm", "text/html"},
+        {".css", "text/css"},
+        {".js", "application/javascript"},
+        {".json", "application/json"},
+        {".txt", "text/plain"},
+        {".xml", "application/xml"},
+        {".jpeg", "image/jpeg"},
+        {".jpg", "image/jpeg"},
+        {".png", "image/png"},
+        {".gif", "image/gif"},
+        {".webp", "image/webp"},
+        {".svg", "image/svg+xml"},
+        {".ico", "image/x-icon"},
+        {".pdf", "application/pdf"},
+        {".mp4", "video/mp4"},
+    };
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return "application/octet-stream";
+    }
+    for (auto &type : TYPES)
+    {
+        if (strcasecmp(path.c_str() + dot, type.extension) == 0)
+        {
+            return type.type;
+        }
+    }
+    return "application/octet-stream";
+}
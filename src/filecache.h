@@ -0,0 +1,86 @@
+#pragma once
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "compress.h"
+
+// 缓存的文件：内容和元数据在放入缓存之前准备好，之后只读，由使用它的连接共同持有
+struct CachedFile
+{
+    std::string data;
+    off_t size;
+    time_t mtime;
+    std::string etag;          // "修改时间-大小"（十六进制），和 nginx 的格式相同
+    std::string last_modified; // HTTP 日期格式的修改时间
+    const char *content_type;
+    std::string gzip;   // 压缩的版本，不是文本类的文件、太小或者压缩后没有变小时为空
+    std::string brotli;
+    mutable std::atomic<bool> referenced; // 最近被访问过，CLOCK 置换时跳过一次
+
+    const std::string &encoded(CONTENT_ENCODING encoding) const; // 该编码的内容，为空时没有这个版本
+    size_t memory() const { return data.size() + gzip.size() + brotli.size(); } // 计入缓存容量的字节数
+};
+
+typedef std::shared_ptr<const CachedFile> CachedFilePtr;
+
+/* 静态文件的内存缓存，所有线程共享，以文件路径为键。
+ * 缓存按路径的散列值分成 SHARD_NUMBER 个分片，每个分片有自己的读写锁和容量（总容量平均分配），
+ * 命中时只加读锁，读者之间互不阻塞；访问位是原子变量，命中时不需要写锁。
+ * 分片满时按 CLOCK 算法置换：访问位为 1 的文件清零后保留一轮，为 0 的被移出。
+ * 被移出或失效的文件只是从表中删除，正在发送它的连接仍然持有引用，发送完毕后才释放内存。
+ * 缓存不在命中时 stat() 检查文件是否变化，而是由后台线程通过 inotify 监视网站根目录下的所有目录，
+ * 文件被修改、替换、删除或改变权限时使其失效。没有命中的文件在读取期间被修改时（分片的代数变化），
+ * 读到的内容只用于这一次请求，不放入缓存。
+ * 文本类的文件在读入时一并准备好 gzip 和 brotli 的版本：同目录下有不比原文件旧的 .gz/.br 文件时直接读取，
+ * 否则压缩一次；这些文件变化时原文件的缓存也随之失效。 */
+class FileCache
+{
+public:
+    static const int SHARD_NUMBER = 16;
+
+    static FileCache *getInstance();
+    // max_size 为 0 表示不使用缓存；大于 max_file_size 的文件不缓存
+    bool init(const std::string &root, size_t max_size, size_t max_file_size);
+    // 返回缓存中的文件，不在缓存中时读入并缓存。文件不存在、不是普通文件、对其他用户不可读、
+    // 太大，或者路径不是规范形式（包含 "//"、"." 或 ".."）时返回 NULL，由调用者按原来的方式处理
+    CachedFilePtr get(const std::string &path);
+    size_t bytes() const;   // 缓存的文件内容的总字节数
+    size_t entries() const; // 缓存的文件数
+    static const char *contentType(const std::string &path); // 根据扩展名得到 Content-Type
+    static std::string entityTag(time_t mtime, off_t size);  // 不在缓存中的文件也用同样的格式生成 ETag
+
+private:
+    struct Shard
+    {
+        pthread_rwlock_t lock;
+        std::unordered_map<std::string, CachedFilePtr> files;
+        size_t bytes;
+        std::atomic<uint64_t> generation; // 分片中有文件失效时加一
+    };
+
+    FileCache();
+    ~FileCache();
+    Shard &shard(const std::string &path);
+    CachedFilePtr load(const std::string &path) const;
+    // 读取 path 同目录下预压缩的文件，没有或者比原文件旧时压缩 file 的内容
+    void loadEncoded(const std::string &path, CachedFile &file, CONTENT_ENCODING encoding) const;
+    void insert(Shard &shard, const std::string &path, const CachedFilePtr &file, uint64_t generation);
+    void invalidate(const std::string &path);
+    void invalidatePrefix(const std::string &prefix); // prefix 为空时清空整个缓存
+    void watch(const std::string &dir);               // 监视 dir 和它下面的所有目录
+    static void *watch_thread_run(void *);
+    void watchLoop();
+
+    Shard m_shards[SHARD_NUMBER];
+    std::atomic<size_t> m_shard_size; // 每个分片的容量，0 表示不使用缓存
+    size_t m_max_file_size;
+    std::atomic<size_t> m_bytes;
+    std::atomic<size_t> m_entries;
+    int m_inotify_fd;
+    std::unordered_map<int, std::string> m_watches; // inotify 监视描述符到目录路径，只由监视线程访问
+};
@@ -2,64 +2,42 @@
 
 #include "httpconnection.h"
 #include "log.h"
+#include "admission.h"
+#include "httpdate.h"
 
 // 定义 HTTP 响应的一些状态信息
 const std::string ok_200_title = "OK";
+const std::string partial_206_title = "Partial Content";
+const std::string not_modified_304_title = "Not Modified";
 const std::string error_400_title = "Bad Request";
 const std::string error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
 const std::string error_403_title = "Forbidden";
 const std::string error_403_form = "You don't have permission to get file from this server.\n";
 const std::string error_404_title = "Not Found";
 const std::string error_404_form = "The requested file was not found on this server.\n";
+const std::string error_413_title = "Payload Too Large";
+const std::string error_413_form = "The request body is larger than the server is willing to process.\n";
+const std::string error_416_title = "Range Not Satisfiable";
+const std::string error_416_form = "The requested range is not satisfiable.\n";
+const std::string error_431_title = "Request Header Fields Too Large";
+const std::string error_431_form = "The request header fields are larger than the server is willing to process.\n";
 const std::string error_500_title = "Internal Error";
 const std::string error_500_form = "There was an unusual problem serving the requested file.\n";
+const std::string error_503_title = "Service Unavailable";
+const std::string error_503_form = "The server is overloaded, please try again later.\n";
 
 // 网站的根目录
 const std::string doc_root = "resources";
+// 上传文件在接收过程中所在的目录。不在网站根目录中，没有接收完的文件不会被当作静态文件访问，
+// 写入时也不会触发文件缓存的 inotify 事件。和 doc_root 在同一个文件系统中，接收完毕后直接改名
+const std::string upload_dir = "upload";
+// 查看服务器统计信息的页面
+const std::string stats_url = "/stats";
 
-int HTTPConnection::m_epoll_fd = -1;
-int HTTPConnection::m_user_count = 0;
-
-// 设置文件描述符 fd 非阻塞
-void setnonblockint(int fd)
-{
-    int old_flag = fcntl(fd, F_GETFL);
-    int new_flag = old_flag | O_NONBLOCK;
-    fcntl(fd, F_SETFL, new_flag);
-}
-
-// 添加文件描述符到 epoll 中
-void addfd(int epollfd, int fd, bool one_shot)
-{
-    epoll_event event;
-    event.data.fd = fd;
-    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET; // ET 触发
-    if (one_shot)
-    {
-        event.events |= EPOLLONESHOT; // 防止同一个通信被不同的线程处理
-    }
-    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    // 设置文件描述符非阻塞
-    setnonblockint(fd);
-}
-
-// 从 epoll 中移除监听的文件描述符
-void removefd(int epollfd, int fd, SSL *ssl)
-{
-    SSL_free(ssl);
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL);
-    close(fd);
-}
-
-// 修改文件描述符，重置 socket 上的 EPOLLONESHOT 事件，
-// 以确保下一次可读时，EPOLLIN 事件能被触发
-void modfd(int epollfd, int fd, int ev)
-{
-    epoll_event event;
-    event.data.fd = fd;
-    event.events = ev | EPOLLONESHOT | EPOLLET | EPOLLRDHUP;
-    epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
-}
+std::atomic<int> HTTPConnection::m_user_count(0);
+std::atomic<bool> HTTPConnection::m_draining(false);
+size_t HTTPConnection::m_max_body_size = 0;
+int HTTPConnection::m_timeouts[PHASE_COUNT] = {10000, 20000, 60000, 60000, 120000};
 
 // 返回带错误消息的默认界面
 std::string index_cgi(std::string str)
@@ -195,42 +173,89 @@ std::string upload_cgi(Database::key_type user, Database::values_array vs)
 }
 
 // 初始化新的连接
-void HTTPConnection::init(int sock_fd, const sockaddr_in &addr, SSL *ssl)
+void HTTPConnection::init(int sock_fd, const sockaddr_in &addr, SSL *ssl, Poller *poller, std::atomic<int> *reactor_load,
+                          ConnectionSlab *slab, ConnHandle handle)
 {
     m_sock_fd = sock_fd;
+    m_poller = poller;
+    m_reactor_load = reactor_load;
+    m_slab = slab;
+    m_handle = handle;
     m_address = addr;
     m_ssl = ssl;
     m_user.clear();
+    m_conn_state = ssl ? CONN_HANDSHAKING : CONN_ESTABLISHED;
+    m_accept_time = nowMicros();
+    m_served = 0;
     // 端口复用
     // int reuse = 1;
     // setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    // 添加到 epoll 对象中
-    addfd(m_epoll_fd, sock_fd, true);
+    // 添加到所属 Reactor 的事件后端中
+    m_poller->add(sock_fd, m_handle, true);
     m_user_count++;
     init();
 }
 
 void HTTPConnection::init()
 {
-    m_parse_state = PARSE_STATE_REQUESTLINE; // 初始化为解析请求首行
-    m_linger = false;                        // 默认不保持连接
-    m_method = GET;                          // 默认请求方法为 GET
+    m_linger = false; // 默认不保持连接
     m_read_buf.clear();
+    m_request_begin = 0;
     m_pos = 0;
     m_line = 0;
     m_read_size = 0;
+    m_write_buf.clear();
+    closeFile();
+    m_sendfile = false;
+    m_chunked_response = false;
+    m_request_start = 0;
+    m_rejected = false;
+    m_close = false;
+    m_responses = 0;
+    m_pending = false;
+    resetRequest();
+    m_timer.reset();
+}
+
+void HTTPConnection::resetRequest()
+{
+    m_parse_state = PARSE_STATE_REQUESTLINE; // 初始化为解析请求首行
+    m_parser.reset();                        // 默认请求方法为 GET
     m_line_status = LINE_OK;
     m_file_path.clear();
-    m_url.clear();
-    m_protocol.clear();
-    m_version = HTTP_1_1;
     m_parameters.clear();
-    m_headers.clear();
-    m_write_buf.clear();
     m_file_buf.clear();
+    m_cached_file.reset();
+    m_content_type = "text/html";
+    m_etag.clear();
+    m_last_modified.clear();
+    m_encoding = ENCODING_IDENTITY;
+    m_vary = false;
+    if (m_file_fd == -1)
+    {
+        m_ranges.clear();
+    }
     m_content_length = 0;
-    m_linger = false;
-    m_timer.reset();
+    m_multipart.reset();
+    m_body_remaining = 0;
+    m_chunk_decoder.reset();
+}
+
+// 请求（包括请求体）到 m_pos 为止，之后的数据属于客户端不等响应就发送的下一个请求。
+// 读缓冲区只在全部处理完时清空，或者在等待更多数据之前整理（见 process()），不为每个请求移动剩余的数据。
+// 清空时释放处理大请求时扩大的内存，空闲的 keep-alive 连接只保留初始大小的读缓冲区
+void HTTPConnection::nextRequest()
+{
+    if (m_pos >= (int)m_read_buf.size())
+    {
+        m_read_buf.clear();
+        m_read_buf.shrink();
+        m_pos = 0;
+    }
+    m_request_begin = m_pos;
+    m_line = m_pos;
+    m_read_size = m_read_buf.size();
+    resetRequest();
 }
 
 // 关闭连接
@@ -239,47 +264,224 @@ void HTTPConnection::close_conn()
     LOG_DEBUG << "close http conn." << Log::endl;
     if (m_sock_fd != -1)
     {
-        removefd(m_epoll_fd, m_sock_fd, m_ssl);
+        m_poller->remove(m_sock_fd, m_handle);
+        if (m_ssl)
+        {
+            if (m_conn_state == CONN_ESTABLISHED)
+            {
+                // 尽力发送 close_notify：没有正常关闭的连接，其会话会被 OpenSSL 从会话缓存中删除
+                SSL_shutdown(m_ssl);
+            }
+            SSL_free(m_ssl);
+        }
+        close(m_sock_fd);
+        closeFile();
+        m_multipart.reset(); // 删除没有完成的上传留下的临时文件
         m_sock_fd = -1;
         m_ssl = NULL;
         m_user.clear();
         m_user_count--; // 连接的客户端数量减一
+        if (m_reactor_load)
+        {
+            (*m_reactor_load)--;
+            m_reactor_load = NULL;
+        }
         if(m_timer.get()) {
             m_timer->setDeleted();
             m_timer.reset();
         }
+        freeBuffers();
+        // 最后归还槽位，此后这个连接的句柄全部失效
+        ConnHandle handle = m_handle;
+        m_handle = 0;
+        m_slab->release(handle);
+    }
+}
+
+void HTTPConnection::freeBuffers()
+{
+    m_read_buf.release();
+    m_write_buf.release();
+    std::string().swap(m_file_buf);
+    m_cached_file.reset();
+    std::string().swap(m_etag);
+    std::string().swap(m_last_modified);
+    std::vector<ByteRange>().swap(m_ranges);
+    std::string().swap(m_boundary);
+    std::string().swap(m_file_path);
+    std::string().swap(m_user);
+    std::unordered_map<std::string, std::string>().swap(m_parameters);
+    m_parser.release();
+}
+
+// 推进 TLS 握手。SSL_do_handshake 需要更多数据或者 socket 暂时不可写时，
+// 根据 SSL_ERROR_WANT_READ/WANT_WRITE 重新注册对应的事件，等待下一次就绪后继续
+// 返回 1 表示握手完成并且请求数据已经在 OpenSSL 的缓冲区中；返回 0 表示已经重新注册了事件，
+// 连接交还给了事件后端，工作线程中调用时此后不能再访问连接
+int HTTPConnection::handshake()
+{
+    int ret = SSL_do_handshake(m_ssl);
+    if (ret == 1)
+    {
+        m_conn_state = CONN_ESTABLISHED;
+        Stats::getInstance()->handshake.record(nowMicros() - m_accept_time);
+        if (SSL_session_reused(m_ssl))
+        {
+            Stats::getInstance()->handshake_resumed++;
+        }
+        else
+        {
+            Stats::getInstance()->handshake_full++;
+        }
+        if (BIO_get_ktls_send(SSL_get_wbio(m_ssl)))
+        {
+            Stats::getInstance()->ktls_connections++;
+        }
+        if (!hasBufferedData())
+        {
+            // 握手在线程池中完成时 Reactor 不会更新定时器，在这里进入读取头部的阶段
+            updateTimer();
+            m_poller->mod(m_sock_fd, m_handle, EPOLLIN);
+            return 0;
+        }
+        return 1;
+    }
+    int err = SSL_get_error(m_ssl, ret);
+    if (err == SSL_ERROR_WANT_READ)
+    {
+        m_poller->mod(m_sock_fd, m_handle, EPOLLIN);
+        return 0;
     }
+    if (err == SSL_ERROR_WANT_WRITE)
+    {
+        m_poller->mod(m_sock_fd, m_handle, EPOLLOUT);
+        return 0;
+    }
+    Stats::getInstance()->handshake_failed++;
+    LOG_DEBUG << "ssl handshake failed, error: " << err << Log::endl;
+    return -1;
+}
+
+bool HTTPConnection::isHandshaking() const
+{
+    return m_conn_state == CONN_HANDSHAKING;
+}
+
+bool HTTPConnection::hasBufferedData() const
+{
+    return m_ssl && SSL_has_pending(m_ssl);
+}
+
+// 一次响应发送完毕后 init() 会清空读写缓冲区，读到下一个请求的数据之前连接都是空闲的；
+// 正在握手、读取、处理或发送中的连接不是空闲的
+bool HTTPConnection::isIdle() const
+{
+    return m_sock_fd != -1 && m_conn_state == CONN_ESTABLISHED && m_read_buf.empty() &&
+           m_write_buf.empty() && m_file_fd == -1 && !hasBufferedData();
+}
+
+bool HTTPConnection::isNew() const
+{
+    return m_served == 0;
+}
+
+// 这一批响应部分发送、等待可写时，后面的请求还不能处理，否则会在发送中的响应之前生成下一个响应
+bool HTTPConnection::hasPendingRequest() const
+{
+    return m_pending && m_write_buf.empty() && m_file_fd == -1;
+}
+
+std::string HTTPConnection::serviceUnavailable()
+{
+    return "HTTP/1.1 503 " + error_503_title + "\r\n" +
+           "Retry-After: " + std::to_string(Admission::getInstance()->retryAfter()) + "\r\n" +
+           "Content-Length: " + std::to_string(error_503_form.size()) + "\r\n" +
+           "Content-Type: text/html\r\n" +
+           "Connection: close\r\n\r\n" + error_503_form;
+}
+
+// 由 Reactor 线程调用，此时连接不在线程池中。请求不再解析，已经读到的数据直接丢弃
+void HTTPConnection::reject()
+{
+    m_rejected = true;
+    m_responses = 1;
+    m_write_buf.append(serviceUnavailable());
+    m_poller->mod(m_sock_fd, m_handle, EPOLLOUT);
 }
 
 // 循环读取客户端数据，直到无数据可读或客户端断开连接
 bool HTTPConnection::read()
 {
-    int read_bytes = 0; // 读取到的字节数
+    if (m_request_start == 0)
+    {
+        m_request_start = nowMicros();
+    }
+    size_t want = READ_BUFFER_SIZE;
     while (true)
     {
-        char buf[READ_BUFFER_SIZE];
-        read_bytes = SSL_read(m_ssl, buf, READ_BUFFER_SIZE);
-        // read_bytes = recv(m_sockfd, m_read_buf + m_read_index, READ_BUFFER_SIZE - m_read_index, 0);
-        if (read_bytes == -1)
+        // 直接读入读缓冲区的尾部。缓冲区已满时剩下的数据留在 socket 或 OpenSSL 中，处理完缓冲区中的请求后再读
+        size_t room = 0;
+        char *buf = m_read_buf.prepare(want, room);
+        if (room == 0)
         {
-            if (errno == EAGAIN || errno == EWOULDBLOCK)
-            { // 没有数据
-                break;
+            break;
+        }
+        size_t read_bytes = 0; // 读取到的字节数
+        if (m_ssl)
+        {
+            int ret = SSL_read_ex(m_ssl, buf, room, &read_bytes);
+            if (ret <= 0)
+            {
+                int err = SSL_get_error(m_ssl, ret);
+                if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+                { // 没有数据
+                    break;
+                }
+                // 客户端关闭连接或者出错
+                return false;
             }
-            else if (errno == EINTR)
+        }
+        else
+        {
+            ssize_t len = recv(m_sock_fd, buf, room, 0);
+            if (len == -1)
             {
-                continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                { // 没有数据
+                    break;
+                }
+                else if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
             }
-            return false;
+            else if (len == 0)
+            { // 客户端关闭连接
+                return false;
+            }
+            read_bytes = len;
         }
-        else if (read_bytes == 0)
-        { // 客户端关闭连接
-            return false;
+        // 交给 multipart 解析器的请求体不留在读缓冲区中
+        size_t consumed = consumeBody(buf, read_bytes);
+        if (consumed > 0)
+        {
+            memmove(buf, buf + consumed, read_bytes - consumed);
+        }
+        m_read_buf.commit(read_bytes - consumed);
+        if (read_bytes == room && want < (size_t)MAX_READ_AHEAD)
+        {
+            // 读满了准备的空间，说明还有更多数据，下一次准备更大的空间
+            want *= 2;
+        }
+        if (m_read_buf.size() >= MAX_READ_AHEAD && !hasBufferedData())
+        {
+            // 请求体还没有交给解析器时不一次读完 socket 中的所有数据，先让工作线程解析请求头；
+            // 之后重新注册 EPOLLIN 时还有数据就会再次就绪
+            break;
         }
-        m_read_buf += std::string(buf, buf + read_bytes);
     }
     m_read_size = m_read_buf.size();
-    // printf("\n%s", m_read_buf.c_str());
     return true;
 }
 
@@ -292,13 +494,16 @@ PARSE_RESULT HTTPConnection::parseRequest()
         switch (m_parse_state)
         {
         case PARSE_STATE_REQUESTLINE:
-            m_line_status = parseRequestLine();
+            m_line_status = m_parser.parseRequestLine(m_pos);
             if (m_line_status == LINE_OK)
             {
+                m_line = m_pos;
                 m_parse_state = PARSE_STATE_HEADER;
             }
             else if (m_line_status == LINE_BAD)
             {
+                // 找不到这个请求的结尾，也就无法解析之后的请求，回复 400 后关闭连接
+                m_close = true;
                 return BAD_REQUEST;
             }
             else if (m_line_status == LINE_OPEN)
@@ -307,13 +512,24 @@ PARSE_RESULT HTTPConnection::parseRequest()
             }
             break;
         case PARSE_STATE_HEADER:
-            m_line_status = parseHeaders();
+            m_line_status = m_parser.parseHeaders(m_pos);
+            m_line = m_pos;
             if (m_line_status == LINE_OK)
             {
+                // 分块编码的请求体长度要解码之后才知道，在解码时检查最大长度
+                m_content_length = m_parser.chunked() ? 0 : m_parser.contentLength();
+                m_linger = m_parser.keepAlive();
+                if (m_max_body_size > 0 && (size_t)m_content_length > m_max_body_size)
+                {
+                    // 请求体不再读取，回复 413 后关闭连接
+                    m_close = true;
+                    return PAYLOAD_TOO_LARGE;
+                }
                 m_parse_state = PARSE_STATE_CONTENT;
             }
             else if (m_line_status == LINE_BAD)
             {
+                m_close = true;
                 return BAD_REQUEST;
             }
             else if (m_line_status == LINE_OPEN)
@@ -322,11 +538,23 @@ PARSE_RESULT HTTPConnection::parseRequest()
             }
             break;
         case PARSE_STATE_CONTENT:
-            if (m_method == GET)
+            if (m_parser.method() == GET)
             {
+                // GET 请求的请求体被忽略，但是要等它全部到达，之后才是下一个请求
+                m_line_status = readBody();
+                if (m_line_status == LINE_OPEN)
+                {
+                    return NO_REQUEST;
+                }
+                else if (m_line_status == LINE_BAD)
+                {
+                    m_close = true;
+                    return bodyTooLarge() ? PAYLOAD_TOO_LARGE : BAD_REQUEST;
+                }
                 parseURL();
+                m_pos += m_content_length;
             }
-            else if (m_method == POST)
+            else if (m_parser.method() == POST)
             {
                 m_line_status = parseContent();
                 if (m_line_status == LINE_OPEN)
@@ -335,85 +563,27 @@ PARSE_RESULT HTTPConnection::parseRequest()
                 }
                 else if (m_line_status == LINE_BAD)
                 {
-                    return BAD_REQUEST;
+                    m_close = true;
+                    return bodyTooLarge() ? PAYLOAD_TOO_LARGE : BAD_REQUEST;
+                }
+                // 上传的请求体已经从读缓冲区中取走，其他请求的请求体紧跟在头部之后
+                if (m_action != UPLOAD)
+                {
+                    m_pos += m_content_length;
                 }
             }
             else
             {
+                m_close = true;
                 return INTERNAL_ERROR;
             }
-            m_pos = m_read_size;
             m_parse_state = PARSE_DONE;
             break;
         default:
             return INTERNAL_ERROR;
         }
     }
-    return doRequest();
-}
-
-LINE_STATUS HTTPConnection::parseRequestLine()
-{
-    // "GET /index.html HTTP/1.1\r\n"
-    auto enter_pos = m_read_buf.find("\r\n", m_pos);
-    if (enter_pos == m_read_buf.npos)
-    {
-        return LINE_OPEN;
-    }
-    auto space_pos = m_read_buf.find(' ', m_pos); // first space
-    if (space_pos == m_read_buf.npos)
-    {
-        return LINE_BAD;
-    }
-    if (!readMethod(space_pos))
-    {
-        return LINE_BAD;
-    }
-    m_pos = space_pos + 1;
-    space_pos = m_read_buf.find(' ', m_pos); // second space
-    if (space_pos == m_read_buf.npos)
-    {
-        return LINE_BAD;
-    }
-    if (!readURL(space_pos))
-    {
-        return LINE_BAD;
-    }
-    // printf("%s\n", m_url.c_str());
-    m_pos = space_pos + 1;
-    if (!readProtocol(enter_pos))
-    {
-        return LINE_BAD;
-    }
-    // printf("%s\n", m_protocol.c_str());
-    m_pos = enter_pos + 2;
-    m_line = m_pos;
-    return LINE_OK;
-}
-
-LINE_STATUS HTTPConnection::parseHeaders()
-{
-    while (true)
-    {
-        auto enter_pos = m_read_buf.find("\r\n", m_pos);
-        if (enter_pos == m_read_buf.npos)
-        {
-            return LINE_OPEN;
-        }
-        else if (int(enter_pos) == m_pos)
-        {
-            break;
-        }
-        if (!readHeader(enter_pos))
-        {
-            return LINE_BAD;
-        }
-        m_pos = enter_pos + 2;
-        m_line = m_pos;
-    }
-    m_pos += 2;
-    m_line = m_pos;
-    return LINE_OK;
+    return GET_REQUEST;
 }
 
 // POST 请求分情况解析内容
@@ -424,20 +594,30 @@ LINE_STATUS HTTPConnection::parseHeaders()
 //      upload.action : 上传操作
 LINE_STATUS HTTPConnection::parseContent()
 {
-    if (m_read_size - m_pos < atoi(m_headers["Content-Length"].c_str()))
+    if (m_multipart.active())
     {
-        return LINE_OPEN;
+        return feedUpload();
     }
     // 从 url 中获取对应的 action
-    auto slash_pos = m_url.find_last_of('/');
-    if (slash_pos == m_url.npos)
+    StringView url = m_parser.url();
+    auto slash_pos = url.rfind('/');
+    if (slash_pos == StringView::npos)
     {
         return LINE_BAD;
     }
-    auto action = m_url.substr(slash_pos + 1);
+    StringView action = url.substr(slash_pos + 1);
+    if (action == "upload.action")
+    {
+        return startUpload();
+    }
+    LINE_STATUS body_status = readBody();
+    if (body_status != LINE_OK)
+    {
+        return body_status;
+    }
     if (action == "login.action")
     {
-        parseParameters(m_read_buf.substr(m_pos, m_read_size - m_pos));
+        URLEncoded::parse(StringView(m_read_buf.data() + m_pos, m_content_length), m_parameters);
         if (m_parameters.count("type") == 0)
         {
             return LINE_BAD;
@@ -456,41 +636,6 @@ LINE_STATUS HTTPConnection::parseContent()
     {
         m_action = UPDATE;
     }
-    else if (action == "upload.action")
-    {
-        m_action = UPLOAD;
-        // 解析多部分的内容
-        if (m_headers.count("Content-Type") == 0)
-        {
-            return LINE_BAD;
-        }
-        auto content_type = m_headers["Content-Type"];
-        auto equal_pos = content_type.find('=');
-        auto boundary = "--" + content_type.substr(equal_pos + 1);
-        auto boundary_end = boundary + "--";
-        auto enter_pos = m_read_buf.find("\r\n", m_pos);
-        while (enter_pos != m_read_buf.npos && m_read_buf.substr(m_pos, enter_pos - m_pos) == boundary)
-        {
-            m_pos = enter_pos + 2;
-            auto name_pos = m_read_buf.find("name=\"", m_pos) + 6;
-            auto quote_pos = m_read_buf.find('\"', name_pos);
-            auto name = m_read_buf.substr(name_pos, quote_pos - name_pos);
-            if (name == "portrait")
-            {
-                auto filename_pos = m_read_buf.find("filename=\"", quote_pos) + 10;
-                auto quote_pos = m_read_buf.find('\"', filename_pos);
-                auto filename = m_read_buf.substr(filename_pos, quote_pos - filename_pos);
-                m_parameters["filename"] = filename;
-            }
-            enter_pos = m_read_buf.find("\r\n\r\n", quote_pos);
-            m_pos = enter_pos + 4;
-            enter_pos = m_read_buf.find("\r\n" + boundary, m_pos);
-            auto value = m_read_buf.substr(m_pos, enter_pos - m_pos);
-            m_parameters[name] = value;
-            m_pos = enter_pos + 2;
-            enter_pos = m_read_buf.find("\r\n", m_pos);
-        }
-    }
     else
     {
         return LINE_BAD;
@@ -498,182 +643,144 @@ LINE_STATUS HTTPConnection::parseContent()
     return LINE_OK;
 }
 
-// str 以 "key1=value1&key2=value2" 的形式传入
-void HTTPConnection::parseParameters(std::string str)
-{
-    // printf("%s\n", str.c_str());
-    std::vector<std::string> name;
-    std::vector<std::string> value;
-    // match_result 中所含的首个 sub_match （下标 0 ）始终表示 regex 所做的目标序列内的完整匹配，
-    // 而后继的 sub_match 表示按顺序对应分隔正则表达式中子表达式的左括号的子表达式匹配
-    std::smatch result;
-    // (.*?) 表示是一个尽可能少地匹配字符的模式
-    // (.*?)=(.*?)&，该表示式可以理解为完整匹配：xxx=xxx&
-    std::regex findStartParameter("(.*?)=(.*?)&");
-    std::regex_search(str, result, findStartParameter);
-    // printf("first name %s\n", result.str(1).c_str());
-    name.push_back(result.str(1));
-    std::regex findParameterName("&(.*?)=");
-    std::sregex_iterator iter(str.begin(), str.end(), findParameterName);
-    std::sregex_iterator end;
-    for (iter; iter != end; iter++)
-    {
-        // printf("name:%s\n", (*iter).str(1).c_str());
-        name.push_back((*iter).str(1));
-    }
-    // 查找 value
-    std::regex findParameterValue("=(.*?)&");
-    std::sregex_iterator iter1(str.begin(), str.end(), findParameterValue);
-    for (iter1; iter1 != end; iter1++)
-    {
-        // printf("value:%s\n", (*iter1).str(1).c_str());
-        value.push_back((*iter1).str(1));
-    }
-    // 最后一个 value，通过反转 URL 后使用 ^(.*?)= 行首匹配
-    std::string reverse_str = str;
-    std::reverse(reverse_str.begin(), reverse_str.end());
-    std::regex findParameterLastValue("^(.*?)=");
-    regex_search(reverse_str, result, findParameterLastValue);
-    // printf("last value %s\n", result.str(1).c_str());
-    std::string lastValue = result.str(1);
-    std::reverse(lastValue.begin(), lastValue.end());
-    value.push_back(lastValue);
-    for (int i = 0; i < name.size(); i++)
-    {
-        m_parameters[name[i]] = value[i];
-    }
-    // for(auto parameter : m_parameters) {
-    //     printf("name %s  value %s\n", parameter.first.c_str(), parameter.second.c_str());
-    // }
-}
-
-void HTTPConnection::parseURL()
+LINE_STATUS HTTPConnection::readBody()
 {
-    auto i = m_url.find('?');
-    if (i != m_url.npos)
+    if (m_parser.chunked())
     {
-        parseParameters(m_url.substr(i + 1));
+        return decodeChunked();
     }
-    std::string tmp = m_url.substr(0, i);
-    if (tmp == "/")
-    {
-        tmp += "index.html";
-    }
-    m_file_path = doc_root + tmp;
-    // printf("%s\n", m_file_path.c_str());
+    return m_read_size - m_pos < m_content_length ? LINE_OPEN : LINE_OK;
 }
 
-bool HTTPConnection::readMethod(int end)
+// 分块编码的请求体在读缓冲区中原地解码：已经解码的部分紧跟在头部之后，块大小行等编码数据解码后立即删除，
+// 所以读缓冲区中只有解码后的请求体和还没有解码的部分。全部解码后请求体和 Content-Length 的情况一样
+LINE_STATUS HTTPConnection::decodeChunked()
 {
-    std::string tmp = m_read_buf.substr(m_pos, end - m_pos);
-    if (tmp == "GET")
-    {
-        m_method = GET;
-    }
-    else if (tmp == "POST")
-    {
-        m_method = POST;
-    }
-    else if (tmp == "HEAD")
-    {
-        m_method = HEAD;
-    }
-    else if (tmp == "PUT")
-    {
-        m_method = PUT;
-    }
-    else if (tmp == "DELETE")
-    {
-        m_method = DELETE;
-    }
-    else if (tmp == "TRACE")
-    {
-        m_method = TRACE;
-    }
-    else if (tmp == "OPTIONS")
+    size_t begin = m_pos + m_chunk_decoder.size();
+    char *data = &m_read_buf[begin];
+    size_t decoded = 0;
+    size_t used = m_chunk_decoder.decode(data, m_read_buf.size() - begin, data, decoded);
+    m_read_buf.erase(begin + decoded, used - decoded);
+    m_read_size = m_read_buf.size();
+    if (m_chunk_decoder.failed() || bodyTooLarge())
     {
-        m_method = OPTIONS;
+        return LINE_BAD;
     }
-    else if (tmp == "CONNECT")
+    if (!m_chunk_decoder.finished())
     {
-        m_method = CONNECT;
+        return LINE_OPEN;
     }
-    else
+    m_content_length = m_chunk_decoder.size();
+    return LINE_OK;
+}
+
+bool HTTPConnection::bodyTooLarge() const
+{
+    return m_max_body_size > 0 && m_chunk_decoder.size() > m_max_body_size;
+}
+
+// 上传请求体交给 multipart 解析器边接收边解析，不会整个留在内存中：
+// 已经读到的部分先交给解析器，之后到达的数据由 read() 直接交给解析器
+LINE_STATUS HTTPConnection::startUpload()
+{
+    m_action = UPLOAD;
+    if (!m_multipart.init(m_parser.header(HEADER_CONTENT_TYPE), &m_parameters, upload_dir))
     {
-        return false;
+        return LINE_BAD;
     }
-    // printf("%s\n", tmp.c_str());
-    return true;
+    m_body_remaining = m_content_length;
+    return feedUpload();
 }
 
-bool HTTPConnection::readProtocol(int end)
+LINE_STATUS HTTPConnection::feedUpload()
 {
-    m_protocol = m_read_buf.substr(m_pos, end - m_pos);
-    auto i = m_protocol.find('/', 0);
-    if (i == m_protocol.npos)
+    size_t used = feedBody(&m_read_buf[m_pos], m_read_size - m_pos);
+    if (used > 0)
     {
-        return false;
+        m_read_buf.erase(m_pos, used);
+        m_read_size = m_read_buf.size();
     }
-    std::string tmp = m_protocol.substr(i + 1);
-    if (tmp == "1.0")
+    if (m_multipart.failed() || m_chunk_decoder.failed() || bodyTooLarge())
     {
-        m_version = HTTP_1_0;
+        // 请求体可能还没有读完，不能再在这个连接上解析下一个请求
+        m_close = true;
+        return LINE_BAD;
     }
-    else if (tmp == "1.1")
+    if (m_parser.chunked() ? !m_chunk_decoder.finished() : m_body_remaining > 0)
     {
-        m_version = HTTP_1_1;
+        return LINE_OPEN;
     }
-    else if (tmp == "2.0")
+    return m_multipart.finished() ? LINE_OK : LINE_BAD;
+}
+
+size_t HTTPConnection::feedBody(char *data, size_t size)
+{
+    size_t len;
+    size_t decoded;
+    if (m_parser.chunked())
     {
-        m_version = HTTP_2_0;
+        if (m_chunk_decoder.finished() || m_chunk_decoder.failed() || bodyTooLarge())
+        {
+            return 0;
+        }
+        len = m_chunk_decoder.decode(data, size, data, decoded);
     }
-    else if (tmp == "3.0")
+    else
     {
-        m_version = HTTP_3_0;
+        len = decoded = std::min(size, m_body_remaining);
+        m_body_remaining -= len;
     }
-    else
+    if (decoded > 0 && !m_multipart.failed())
     {
-        return false;
+        m_multipart.feed(data, decoded);
     }
-    return true;
+    return len;
 }
 
-bool HTTPConnection::readURL(int end)
+size_t HTTPConnection::consumeBody(char *data, size_t size)
 {
-    m_url = m_read_buf.substr(m_pos, end - m_pos);
-    return true;
+    return m_multipart.active() ? feedBody(data, size) : 0;
 }
 
-bool HTTPConnection::readHeader(int end)
+void HTTPConnection::parseURL()
 {
-    std::string name, value;
-    auto tmp_pos = m_read_buf.find(": ", m_pos);
-    if (tmp_pos == m_read_buf.npos)
-    {
-        return false;
-    }
-    name = m_read_buf.substr(m_pos, tmp_pos - m_pos);
-    value = m_read_buf.substr(tmp_pos + 2, end - tmp_pos - 2);
-    m_headers.emplace(name, value);
-    if (name == "Content-Length")
+    StringView url = m_parser.url();
+    auto i = url.find('?');
+    if (i != StringView::npos)
     {
-        m_content_length = atoi(value.c_str());
+        URLEncoded::parse(url.substr(i + 1), m_parameters);
     }
-    if (name == "Connection" && value == "keep-alive")
+    StringView path = url.substr(0, i);
+    m_file_path.assign(doc_root).append(path.data, path.size);
+    if (path == "/")
     {
-        m_linger = true;
+        m_file_path += "index.html";
     }
-    // printf("%s : %s\n", name.c_str(), value.c_str());
-    return true;
+    // printf("%s\n", m_file_path.c_str());
 }
 
 // 当得到一个完整、正确的 HTTP 请求时，我们就分析目标文件的属性，
 // 判断目标文件是否存在、对所有用户是否可读，是否是目录
 PARSE_RESULT HTTPConnection::doRequest()
 {
-    switch (m_method)
+    switch (m_parser.method())
     {
     case GET:
+        if (m_file_path == doc_root + stats_url)
+        {
+            m_file_buf = Stats::getInstance()->toString();
+            return FILE_REQUEST;
+        }
+        // 缓存中的文件不需要 stat() 和读取，文件变化时缓存由 inotify 通知失效
+        m_cached_file = FileCache::getInstance()->get(m_file_path);
+        if (m_cached_file)
+        {
+            m_content_type = m_cached_file->content_type;
+            m_etag = m_cached_file->etag;
+            m_last_modified = m_cached_file->last_modified;
+            selectEncoding();
+            return notModified(m_cached_file->mtime) ? NOT_MODIFIED : checkRange(FILE_REQUEST);
+        }
         // 获取 m_file_path 文件的相关状态信息，-1 失败，0 成功
         // printf("%s\n", m_file_path.c_str());
         if (stat(m_file_path.c_str(), &m_file_stat) < 0)
@@ -690,7 +797,25 @@ PARSE_RESULT HTTPConnection::doRequest()
         {
             return BAD_REQUEST;
         }
-        readFile();
+        // 客户端的副本仍然有效时不打开文件。stat 得到的大小为 0 的文件不知道实际内容，不生成验证器
+        if (m_file_stat.st_size > 0)
+        {
+            m_etag = FileCache::entityTag(m_file_stat.st_mtime, m_file_stat.st_size);
+            m_last_modified = HTTPDate::format(m_file_stat.st_mtime);
+            if (notModified(m_file_stat.st_mtime))
+            {
+                return NOT_MODIFIED;
+            }
+            if (checkRange(FILE_REQUEST) == RANGE_NOT_SATISFIABLE)
+            {
+                return RANGE_NOT_SATISFIABLE;
+            }
+        }
+        if (!openFile())
+        {
+            return FORBIDDEN_REQUEST;
+        }
+        m_content_type = FileCache::contentType(m_file_path);
         return FILE_REQUEST;
     case POST:
         if (m_action == QUIT || m_action == CANCEL || m_action == UPDATE || m_action == UPLOAD)
@@ -711,25 +836,291 @@ PARSE_RESULT HTTPConnection::doRequest()
     return INTERNAL_ERROR;
 }
 
-void HTTPConnection::readFile()
+// If-None-Match 的值是 "*" 或者逗号分隔的实体标签列表，按弱比较（忽略 W/ 前缀）判断其中是否有 etag
+static bool matchEntityTag(StringView list, const std::string &etag)
 {
-    FILE *file = fopen(m_file_path.c_str(), "r");
-    m_file_buf.resize(m_file_stat.st_size);
-    fread(const_cast<char *>(m_file_buf.data()), m_file_stat.st_size, 1, file);
-    fclose(file);
+    size_t i = 0;
+    while (i < list.size)
+    {
+        if (list[i] == ' ' || list[i] == '\t' || list[i] == ',')
+        {
+            ++i;
+            continue;
+        }
+        if (list[i] == '*')
+        {
+            return true;
+        }
+        if (list.substr(i, 2) == "W/")
+        {
+            i += 2;
+        }
+        size_t end = list.find('"', i + 1);
+        if (i >= list.size || list[i] != '"' || end == StringView::npos)
+        {
+            return false; // 格式不正确
+        }
+        if (list.substr(i, end + 1 - i) == etag)
+        {
+            return true;
+        }
+        i = end + 1;
+    }
+    return false;
 }
 
-bool HTTPConnection::doAction()
+// RFC 9110 13.2.2：有 If-None-Match 时忽略 If-Modified-Since；日期格式不正确时忽略 If-Modified-Since
+bool HTTPConnection::notModified(time_t mtime) const
 {
-    switch (m_action)
+    StringView none_match = m_parser.header(HEADER_IF_NONE_MATCH);
+    if (!none_match.empty())
     {
-    case LOGIN:
-        return doLogin();
-    case REGISTER:
-        return doRegister();
-    case QUIT:
-        return doQuit();
-    case CANCEL:
+        return matchEntityTag(none_match, m_etag);
+    }
+    StringView since = m_parser.header(HEADER_IF_MODIFIED_SINCE);
+    time_t t;
+    return !since.empty() && HTTPDate::parse(since, t) && mtime <= t;
+}
+
+// If-Range 的值是实体标签（按强比较）或者日期（和 Last-Modified 完全相同），不匹配时文件已经变化，
+// 客户端手中的部分内容不能和范围拼接，回复完整的文件
+PARSE_RESULT HTTPConnection::checkRange(PARSE_RESULT result)
+{
+    StringView range = m_parser.header(HEADER_RANGE);
+    if (range.empty() || m_etag.empty())
+    {
+        return result;
+    }
+    StringView if_range = m_parser.header(HEADER_IF_RANGE);
+    if (!if_range.empty() && if_range != m_etag && if_range != m_last_modified)
+    {
+        return result;
+    }
+    // 范围被忽略时 m_ranges 为空，回复完整的文件
+    if (ByteRanges::parse(range, fileSize(), m_ranges) == ByteRanges::RANGE_UNSATISFIABLE)
+    {
+        return RANGE_NOT_SATISFIABLE;
+    }
+    return result;
+}
+
+off_t HTTPConnection::fileSize() const
+{
+    return m_cached_file ? m_cached_file->size : m_file_stat.st_size;
+}
+
+// 每个压缩版本有自己的 ETag（原文件的 ETag 加上编码名），客户端缓存的不同编码的副本不会被混淆
+void HTTPConnection::selectEncoding()
+{
+    if (m_cached_file->gzip.empty() && m_cached_file->brotli.empty())
+    {
+        return;
+    }
+    m_vary = true;
+    if (m_parser.hasHeader(HEADER_RANGE))
+    {
+        return;
+    }
+    CONTENT_ENCODING encoding = Compressor::negotiate(m_parser.header(HEADER_ACCEPT_ENCODING));
+    if (encoding == ENCODING_IDENTITY || m_cached_file->encoded(encoding).empty())
+    {
+        return;
+    }
+    m_encoding = encoding;
+    m_etag.insert(m_etag.size() - 1, std::string("-") + Compressor::name(encoding));
+}
+
+void HTTPConnection::compressBody()
+{
+    if (!Compressor::m_enabled || m_file_buf.size() < Compressor::m_min_size ||
+        !Compressor::compressible(m_content_type))
+    {
+        return;
+    }
+    m_vary = true;
+    CONTENT_ENCODING encoding = Compressor::negotiate(m_parser.header(HEADER_ACCEPT_ENCODING));
+    std::string compressed;
+    if (encoding == ENCODING_IDENTITY ||
+        !Compressor::compress(encoding, m_file_buf.data(), m_file_buf.size(), true, compressed) ||
+        compressed.size() >= m_file_buf.size())
+    {
+        return;
+    }
+    Stats::getInstance()->compressed_responses++;
+    Stats::getInstance()->compressed_bytes_saved += m_file_buf.size() - compressed.size();
+    m_encoding = encoding;
+    m_file_buf.swap(compressed);
+}
+
+void HTTPConnection::readFile()
+{
+    FILE *file = fopen(m_file_path.c_str(), "r");
+    m_file_buf.resize(m_file_stat.st_size);
+    fread(const_cast<char *>(m_file_buf.data()), m_file_stat.st_size, 1, file);
+    fclose(file);
+}
+
+bool HTTPConnection::openFile()
+{
+    m_file_fd = open(m_file_path.c_str(), O_RDONLY);
+    if (m_file_fd == -1)
+    {
+        return false;
+    }
+    m_file_offset = 0;
+    m_file_end = m_file_stat.st_size;
+    // 明文连接总是使用 sendfile；TLS 连接只有握手后 OpenSSL 成功把发送方向的加密交给内核时，
+    // SSL_sendfile 才可用，否则在用户态读文件并加密。stat 得到的大小为 0 时（例如 /proc 下的文件）
+    // 不知道文件的实际长度，只能读到文件末尾为止
+    m_sendfile = m_file_stat.st_size > 0 && (m_ssl == NULL || BIO_get_ktls_send(SSL_get_wbio(m_ssl)));
+    // 不经过 sendfile 的小文件，或者后面还有流水线请求时能和其他响应合并发送的小文件，直接读入内存；
+    // 其他文件在发送时逐段读出，响应头不必等整个文件读完，写缓冲区也不超过 MAX_WRITE_BATCH。
+    // 范围请求只读出（或者 sendfile）请求的范围
+    size_t size = m_file_stat.st_size;
+    if (size > 0 && m_ranges.empty() && (m_sendfile ? m_pos < m_read_size && m_write_buf.size() + size <= (size_t)MAX_WRITE_BATCH
+                                : size <= (size_t)MAX_WRITE_BATCH))
+    {
+        m_file_buf.resize(size);
+        ssize_t len = pread(m_file_fd, &m_file_buf[0], size, 0);
+        closeFile();
+        if (len != (ssize_t)size)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void HTTPConnection::closeFile()
+{
+    if (m_file_fd != -1)
+    {
+        close(m_file_fd);
+        m_file_fd = -1;
+    }
+    m_ranges.clear();
+}
+
+int HTTPConnection::readFileChunk()
+{
+    size_t len = MAX_WRITE_BATCH;
+    bool until_eof = m_file_stat.st_size == 0; // 不知道文件的长度，读到文件末尾为止
+    if (!until_eof)
+    {
+        if (m_file_offset >= m_file_end)
+        {
+            return 0;
+        }
+        len = std::min(len, (size_t)(m_file_end - m_file_offset));
+    }
+    // 分块编码时每段作为一个块发送，块的大小行和结尾的 CRLF 和数据放在同一段中：
+    // 大小行固定为 8 个十六进制数字（允许前导 0），数据直接读到它后面，不需要读完后再移动
+    static const size_t SIZE_LINE = 10;
+    size_t head = m_chunked_response ? SIZE_LINE : 0;
+    char *buf = m_write_buf.prepare(head + len + (m_chunked_response ? 2 : 0));
+    ssize_t ret;
+    do
+    {
+        ret = pread(m_file_fd, buf + head, len, m_file_offset);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0 || (ret == 0 && !until_eof))
+    { // 读取出错，或者文件在发送过程中被截断
+        m_write_buf.commit(0);
+        return -1;
+    }
+    m_file_offset += ret;
+    if (!m_chunked_response)
+    {
+        // 读到文件末尾时（ret 为 0）没有追加数据，HTTP/1.0 的客户端以连接关闭作为响应的结束
+        m_write_buf.commit(ret);
+        return ret > 0 ? 1 : 0;
+    }
+    // 读到文件末尾时发送最后一个（大小为 0 的）块
+    char size[SIZE_LINE + 1];
+    snprintf(size, sizeof(size), "%08x\r\n", (unsigned)ret); // ret 不超过 MAX_WRITE_BATCH，8 位十六进制足够
+    memcpy(buf, size, SIZE_LINE);
+    memcpy(buf + SIZE_LINE + ret, "\r\n", 2);
+    m_write_buf.commit(SIZE_LINE + ret + 2);
+    if (ret == 0)
+    {
+        closeFile();
+    }
+    return 1;
+}
+
+bool HTTPConnection::nextRange()
+{
+    if (m_ranges.size() <= 1 || m_range_index >= m_ranges.size())
+    {
+        return false;
+    }
+    if (++m_range_index == m_ranges.size())
+    {
+        // 最后一个范围发送完毕，发送结尾的分隔符后响应结束
+        writeString("\r\n--" + m_boundary + "--\r\n");
+        closeFile();
+        return true;
+    }
+    writeString(rangePartHeader(m_range_index));
+    m_file_offset = m_ranges[m_range_index].first;
+    m_file_end = m_ranges[m_range_index].last + 1;
+    return true;
+}
+
+// 文件内容从页缓存直接发送（TLS 连接由内核加密），不经过用户态
+int HTTPConnection::sendFile()
+{
+    while (m_file_offset < m_file_end)
+    {
+        ssize_t ret;
+        if (m_ssl == NULL)
+        {
+            off_t offset = m_file_offset;
+            ret = sendfile(m_sock_fd, m_file_fd, &offset, m_file_end - m_file_offset);
+            if (ret < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return 0;
+                }
+                else if (errno == EINTR)
+                {
+                    continue;
+                }
+                LOG_DEBUG << "sendfile failed, errno: " << errno << Log::endl;
+                return -1;
+            }
+        }
+        else if ((ret = SSL_sendfile(m_ssl, m_file_fd, m_file_offset, m_file_end - m_file_offset, 0)) < 0)
+        {
+            if (SSL_get_error(m_ssl, ret) == SSL_ERROR_WANT_WRITE)
+            {
+                return 0;
+            }
+            LOG_DEBUG << "ssl sendfile failed, errno: " << errno << Log::endl;
+            return -1;
+        }
+        if (ret == 0)
+        { // 文件在发送过程中被截断
+            return -1;
+        }
+        m_file_offset += ret;
+        Stats::getInstance()->sendfile_bytes += ret;
+    }
+    return 1;
+}
+
+bool HTTPConnection::doAction()
+{
+    switch (m_action)
+    {
+    case LOGIN:
+        return doLogin();
+    case REGISTER:
+        return doRegister();
+    case QUIT:
+        return doQuit();
+    case CANCEL:
         return doCancel();
     case UPDATE:
         return doUpdate();
@@ -791,6 +1182,12 @@ bool HTTPConnection::doQuit()
 {
     m_user.clear();
     m_file_path = doc_root + "/index.html";
+    CachedFilePtr file = FileCache::getInstance()->get(m_file_path);
+    if (file)
+    {
+        m_file_buf = file->data;
+        return true;
+    }
     stat(m_file_path.c_str(), &m_file_stat);
     readFile();
     return true;
@@ -838,12 +1235,27 @@ bool HTTPConnection::doUpload()
     Database::values_array vs;
     bool flag = db_conn->find(m_user, vs);
     vs[PASSWD] = m_parameters["passwd"];
-    if (m_parameters["filename"] != "")
+    MultipartParser::File *portrait = m_multipart.file("portrait");
+    if (portrait)
     {
-        vs[PORTRAIT] = "images/" + m_user + "_portrait" + m_parameters["filename"].substr(m_parameters["filename"].find_last_of('.'));
-        std::ofstream fout((doc_root + "/" + vs[PORTRAIT]).c_str(), std::ios::out | std::ios::binary);
-        fout.write(m_parameters["portrait"].c_str(), m_parameters["portrait"].size());
-        fout.close();
+        // 只保留客户端文件名中的扩展名，扩展名中不能出现路径分隔符
+        auto dot_pos = portrait->filename.find_last_of('.');
+        std::string extension = dot_pos == std::string::npos ? "" : portrait->filename.substr(dot_pos);
+        if (extension.find('/') != std::string::npos)
+        {
+            extension.clear();
+        }
+        std::string path = "images/" + m_user + "_portrait" + extension;
+        // 头像已经在接收时写入了 upload_dir 下的临时文件，直接改名。改名失败时保留原来的头像
+        if (rename(portrait->path.c_str(), (doc_root + "/" + path).c_str()) == 0)
+        {
+            portrait->path.clear();
+            vs[PORTRAIT] = path;
+        }
+        else
+        {
+            LOG_WARN << "rename " << portrait->path << " failed, errno: " << errno << Log::endl;
+        }
     }
     vs[SIGNATURE] = m_parameters["signature"];
     db_conn->mod(m_user, vs);
@@ -860,86 +1272,268 @@ bool HTTPConnection::doUpload()
 // 写 HTTP 响应
 bool HTTPConnection::write()
 {
-    // printf("\n%s", m_write_buf.c_str());
-    const char *ptr = m_write_buf.c_str();
-    int bytes_to_send = m_write_buf.size();
-    int bytes_have_send = 0;
-    int tmp = 0;
-    while (bytes_to_send > 0)
+    while (true)
     {
-        tmp = SSL_write(m_ssl, ptr, bytes_to_send);
-        if (tmp < 0)
+        // 部分发送时只前移写缓冲区的发送位置，剩下的数据不移动
+        while (!m_write_buf.empty())
         {
-            if (errno == EINTR)
+            ssize_t tmp;
+            if (m_ssl)
             {
-                tmp = 0;
-                continue;
+                size_t len = 0;
+                const char *data = m_write_buf.peek(len);
+                tmp = SSL_write(m_ssl, data, len);
             }
-            // 如果 TCP 写缓冲没有空间，则等待下一轮 EPOLLOUT 事件，虽然在此期间
-            // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性
-            if (errno == EAGAIN)
+            else
             {
-                modfd(m_epoll_fd, m_sock_fd, EPOLLOUT);
-                break;
+                iovec iov[OutputChain::MAX_IOV];
+                tmp = writev(m_sock_fd, iov, m_write_buf.fill(iov, OutputChain::MAX_IOV));
+            }
+            if (tmp < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                // 如果 TCP 写缓冲没有空间，则等待下一轮 EPOLLOUT 事件，虽然在此期间
+                // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性
+                if (errno == EAGAIN)
+                {
+                    m_poller->mod(m_sock_fd, m_handle, EPOLLOUT);
+                    return true;
+                }
+                return false;
             }
+            m_write_buf.consume(tmp);
+        }
+        if (m_file_fd == -1)
+        {
+            break;
+        }
+        if (m_sendfile)
+        {
+            // 响应头发送完毕，接着发送文件内容
+            int ret = sendFile();
+            if (ret < 0)
+            {
+                return false;
+            }
+            if (ret == 0)
+            {
+                m_poller->mod(m_sock_fd, m_handle, EPOLLOUT);
+                return true;
+            }
+            if (nextRange())
+            {
+                continue;
+            }
+            break;
+        }
+        // 用户态发送文件：写缓冲区中的上一段发送完毕后再读出下一段
+        int ret = readFileChunk();
+        if (ret < 0)
+        {
             return false;
         }
-        bytes_have_send += tmp;
-        bytes_to_send -= tmp;
-        ptr += tmp;
+        if (ret == 0 && !nextRange())
+        {
+            break;
+        }
     }
-    if (bytes_to_send == 0)
+    // 将要发送的字节为 0，这一批响应结束。同一批中的请求是一起读到的，按同一个开始时间统计
+    uint64_t now = nowMicros();
+    for (int i = 0; i < m_responses; ++i)
     {
-        // 将要发送的字节为 0，这一次响应结束，重置该连接
-        modfd(m_epoll_fd, m_sock_fd, EPOLLIN);
-        init();
+        Stats::getInstance()->request.record(now - m_request_start);
     }
-    else
+    m_served += m_responses;
+    m_responses = 0;
+    closeFile();
+    if (m_rejected || m_close)
     {
-        m_write_buf = m_write_buf.substr(bytes_have_send);
+        // 响应头中已经告诉客户端关闭连接（包括热升级排空时），返回 false 由调用者关闭
+        return false;
+    }
+    m_request_start = m_read_buf.empty() ? 0 : now;
+    if (m_pending)
+    {
+        // 读缓冲区中还有完整的请求，不会再触发可读事件，由调用者直接交给工作线程
+        return true;
     }
+    m_poller->mod(m_sock_fd, m_handle, EPOLLIN);
     return true;
 }
 
 void HTTPConnection::writeString(std::string str)
 {
-    m_write_buf += str;
+    m_write_buf.append(str);
 }
 
 void HTTPConnection::addStatusLine(std::string status, std::string title)
 {
-    writeString(m_protocol + " " + status + " " + title + "\r\n");
+    // 请求行没有解析成功时还不知道客户端的协议版本
+    StringView protocol = m_parser.protocol();
+    writeString((protocol.empty() ? std::string("HTTP/1.1") : protocol.str()) + " " + status + " " + title + "\r\n");
 }
 
-void HTTPConnection::addHeaders(int content_length)
+// length_known 为 false 表示响应体的长度事先不知道，忽略 content_length。
+// 长度使用 off_t：sendfile 发送的文件可以超过 2 GB
+void HTTPConnection::addHeaders(off_t content_length, bool length_known)
 {
-    addContentLength(content_length);
+    m_chunked_response = false;
+    if (length_known)
+    {
+        addContentLength(content_length);
+    }
+    else
+    {
+        addTransferEncoding();
+    }
     addContentType();
+    addValidators();
+    addEncoding();
     addLinger();
     writeString("\r\n");
 }
 
-void HTTPConnection::addContentLength(int content_length)
+void HTTPConnection::addContentLength(off_t content_length)
+{
+    writeString("Content-Length: " + std::to_string((long long)content_length) + "\r\n");
+}
+
+void HTTPConnection::addTransferEncoding()
+{
+    if (m_parser.version() == HTTP_1_0)
+    {
+        // HTTP/1.0 不支持分块编码，发送完毕后关闭连接表示响应结束
+        m_close = true;
+        return;
+    }
+    m_chunked_response = true;
+    writeString("Transfer-Encoding: chunked\r\n");
+}
+
+void HTTPConnection::addValidators()
 {
-    writeString("Content-Length: " + std::to_string(content_length) + "\r\n");
+    if (m_etag.empty())
+    {
+        return;
+    }
+    writeString("ETag: " + m_etag + "\r\n");
+    writeString("Last-Modified: " + m_last_modified + "\r\n");
+    writeString("Accept-Ranges: bytes\r\n");
+}
+
+void HTTPConnection::addEncoding()
+{
+    if (m_encoding != ENCODING_IDENTITY)
+    {
+        writeString(std::string("Content-Encoding: ") + Compressor::name(m_encoding) + "\r\n");
+    }
+    if (m_vary)
+    {
+        writeString("Vary: Accept-Encoding\r\n");
+    }
+}
+
+std::string HTTPConnection::rangePartHeader(size_t i) const
+{
+    const ByteRange &range = m_ranges[i];
+    return "\r\n--" + m_boundary + "\r\nContent-Type: " + m_range_type + "\r\nContent-Range: bytes " +
+           std::to_string(range.first) + "-" + std::to_string(range.last) + "/" + std::to_string(fileSize()) +
+           "\r\n\r\n";
+}
+
+// 一个范围时响应体就是这个范围的内容；多个范围时是 multipart/byteranges，每个范围之前有自己的分隔符
+// 和 Content-Range，最后是结尾的分隔符，Content-Length 事先按这些部分算出。
+// 缓存中的文件直接引用各个范围；其他文件从第一个范围开始发送，其余的范围由 nextRange() 依次准备
+void HTTPConnection::addRanges()
+{
+    static std::atomic<uint64_t> boundary_seq(((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid());
+    off_t length = 0;
+    for (auto &range : m_ranges)
+    {
+        length += range.length();
+    }
+    bool multipart = m_ranges.size() > 1;
+    if (multipart)
+    {
+        char boundary[32];
+        snprintf(boundary, sizeof(boundary), "%016llx", (unsigned long long)boundary_seq++);
+        m_boundary = boundary;
+        m_range_type = m_content_type;
+        for (size_t i = 0; i < m_ranges.size(); ++i)
+        {
+            length += rangePartHeader(i).size();
+        }
+        length += m_boundary.size() + 8; // "\r\n--" boundary "--\r\n"
+    }
+    Stats::getInstance()->partial_content++;
+    addStatusLine("206", partial_206_title);
+    if (!multipart)
+    {
+        writeString("Content-Range: bytes " + std::to_string(m_ranges[0].first) + "-" +
+                    std::to_string(m_ranges[0].last) + "/" + std::to_string(fileSize()) + "\r\n");
+    }
+    addHeaders(length);
+    if (m_cached_file)
+    {
+        for (size_t i = 0; i < m_ranges.size(); ++i)
+        {
+            if (multipart)
+            {
+                writeString(rangePartHeader(i));
+            }
+            m_write_buf.appendRef(m_cached_file->data.data() + m_ranges[i].first, m_ranges[i].length(),
+                                  m_cached_file);
+        }
+        if (multipart)
+        {
+            writeString("\r\n--" + m_boundary + "--\r\n");
+        }
+        return;
+    }
+    m_range_index = 0;
+    if (multipart)
+    {
+        writeString(rangePartHeader(0));
+    }
+    m_file_offset = m_ranges[0].first;
+    m_file_end = m_ranges[0].last + 1;
 }
 
 void HTTPConnection::addContentType()
 {
-    writeString(std::string("Content-Type: ") + "text/html" + "\r\n");
+    if (m_ranges.size() > 1)
+    {
+        // 每个范围的 Content-Type 在它自己的头部中
+        writeString("Content-Type: multipart/byteranges; boundary=" + m_boundary + "\r\n");
+        return;
+    }
+    writeString(std::string("Content-Type: ") + m_content_type + "\r\n");
 }
 
 void HTTPConnection::addLinger()
 {
     std::string tmp("Connection: ");
+    if (m_draining)
+    {
+        m_linger = false;
+    }
+    if (m_close)
+    {
+        m_linger = false;
+    }
+    // 告诉客户端关闭连接之后不再处理它的后续请求
+    m_close = !m_linger;
     tmp += m_linger ? "keep-alive" : "close";
     tmp += "\r\n";
     writeString(tmp);
 }
 
-void HTTPConnection::addContent(std::string content)
+void HTTPConnection::addContent(const std::string &content)
 {
-    writeString(content);
+    m_write_buf.appendRef(content.data(), content.size());
 }
 
 bool HTTPConnection::generateResponse(PARSE_RESULT result)
@@ -966,10 +1560,59 @@ bool HTTPConnection::generateResponse(PARSE_RESULT result)
         addHeaders(error_403_form.size());
         addContent(error_403_form);
         break;
+    case PAYLOAD_TOO_LARGE:
+        addStatusLine("413", error_413_title);
+        addHeaders(error_413_form.size());
+        addContent(error_413_form);
+        break;
+    case HEADER_TOO_LARGE:
+        addStatusLine("431", error_431_title);
+        addHeaders(error_431_form.size());
+        addContent(error_431_form);
+        break;
+    case NOT_MODIFIED:
+        // 304 没有响应体，只带验证器，客户端继续使用自己的副本
+        Stats::getInstance()->not_modified++;
+        addStatusLine("304", not_modified_304_title);
+        addValidators();
+        addEncoding();
+        addLinger();
+        writeString("\r\n");
+        break;
+    case RANGE_NOT_SATISFIABLE:
+        addStatusLine("416", error_416_title);
+        writeString("Content-Range: bytes */" + std::to_string(fileSize()) + "\r\n");
+        m_content_type = "text/html";
+        addHeaders(error_416_form.size());
+        addContent(error_416_form);
+        break;
     case FILE_REQUEST:
+        if (!m_ranges.empty())
+        {
+            addRanges();
+            break;
+        }
         addStatusLine("200", ok_200_title);
+        if (m_cached_file)
+        {
+            // 响应体引用缓存中的文件（或者它的压缩版本），发送完毕之前文件即使被移出缓存也不会被释放
+            const std::string &body = m_cached_file->encoded(m_encoding);
+            addHeaders(body.size());
+            m_write_buf.appendRef(body.data(), body.size(), m_cached_file);
+            break;
+        }
+        if (m_file_fd != -1)
+        {
+            // 文件内容在发送时才读出
+            addHeaders(m_file_stat.st_size, m_file_stat.st_size > 0);
+            break;
+        }
+        if (m_etag.empty())
+        {
+            compressBody();
+        }
         addHeaders(m_file_buf.size());
-        addContent(m_file_buf);
+        m_write_buf.append(std::move(m_file_buf));
         break;
     default:
         return false;
@@ -980,21 +1623,103 @@ bool HTTPConnection::generateResponse(PARSE_RESULT result)
 // 由线程池中的工作线程调用，这是处理 HTTP 请求的入口函数
 void HTTPConnection::process()
 {
-    // 解析 HTTP 请求
+    if (m_conn_state == CONN_HANDSHAKING)
+    {
+        // 握手被交给工作线程时，RSA/ECDHE 的计算不占用 Reactor 线程
+        int ret = handshake();
+        if (ret < 0)
+        {
+            close_conn();
+            return;
+        }
+        if (ret == 0)
+        {
+            // 连接已经交还给 Reactor，可能正在被它处理
+            return;
+        }
+        // 请求数据已经随握手一起被读入 OpenSSL 的缓冲区，直接开始处理
+        if (!read())
+        {
+            close_conn();
+            return;
+        }
+    }
+    // 依次处理读缓冲区中的所有完整请求（HTTP/1.1 流水线），响应追加到写缓冲区中一起发送
     // printf("parse request.\n");
-    PARSE_RESULT parse_result = parseRequest();
-    if (parse_result == NO_REQUEST)
+    m_pending = false;
+    while (true)
     {
-        modfd(m_epoll_fd, m_sock_fd, EPOLLIN);
+        PARSE_RESULT parse_result = parseRequest();
+        if (parse_result == GET_REQUEST)
+        {
+            // 请求已经完整：分析目标文件，或者执行登录、上传等操作
+            parse_result = doRequest();
+        }
+        if (parse_result == NO_REQUEST)
+        {
+            compactReadBuffer();
+            size_t buffered = m_read_buf.size();
+            if (!m_read_buf.full() && hasBufferedData())
+            {
+                // 读缓冲区满时停止了读取，OpenSSL 中剩下的数据不会再触发可读事件，整理出空间后直接读
+                if (!read())
+                {
+                    close_conn();
+                    return;
+                }
+                if (m_read_buf.size() > buffered)
+                {
+                    continue;
+                }
+            }
+            if (!m_read_buf.full())
+            {
+                break;
+            }
+            // 读缓冲区中只有这一个请求仍然放不下：请求头或者请求体超过了读缓冲区的最大长度
+            m_close = true;
+            parse_result = m_parse_state == PARSE_STATE_CONTENT ? PAYLOAD_TOO_LARGE : HEADER_TOO_LARGE;
+        }
+        // 生成响应
+        if (!generateResponse(parse_result))
+        {
+            close_conn();
+            return;
+        }
+        ++m_responses;
+        nextRequest();
+        if (m_file_fd != -1 || m_close || m_write_buf.size() >= MAX_WRITE_BATCH)
+        {
+            // 文件内容要紧跟在这个响应头之后发送，或者连接即将关闭，或者这一批已经足够大：
+            // 剩下的请求等这一批发送完毕后再处理
+            m_pending = !m_close && (m_line < m_read_size || hasBufferedData());
+            break;
+        }
+    }
+    if (m_responses == 0)
+    {
+        // 等待请求剩下的部分，例如读完头部后进入请求体阶段
+        updateTimer();
+        m_poller->mod(m_sock_fd, m_handle, EPOLLIN);
         return;
     }
-    // 生成响应
-    bool write_ret = generateResponse(parse_result);
-    if (!write_ret)
+    m_poller->mod(m_sock_fd, m_handle, EPOLLOUT);
+}
+
+// 等待更多数据之前，丢弃当前请求之前已经处理完的请求，不完整的当前请求移到缓冲区开头
+// （只移动缓冲区的开始位置，尾部空间不够时才真正移动数据），解析器中记录的位置随之前移
+void HTTPConnection::compactReadBuffer()
+{
+    if (m_request_begin == 0)
     {
-        close_conn();
+        return;
     }
-    modfd(m_epoll_fd, m_sock_fd, EPOLLOUT);
+    m_read_buf.consume(m_request_begin);
+    m_parser.rebase(m_request_begin);
+    m_pos -= m_request_begin;
+    m_line -= m_request_begin;
+    m_read_size = m_read_buf.size();
+    m_request_begin = 0;
 }
 
 void HTTPConnection::setTimer(std::shared_ptr<TimerNode> timer_)
@@ -1004,10 +1729,82 @@ void HTTPConnection::setTimer(std::shared_ptr<TimerNode> timer_)
     m_timer = timer_;
 }
 
-void HTTPConnection::updateTimer(int timeout)
+ConnHandle HTTPConnection::getHandle() const
+{
+    return m_handle;
+}
+
+ConnectionSlab *HTTPConnection::getSlab() const
+{
+    return m_slab;
+}
+
+std::shared_ptr<TimerNode> HTTPConnection::getTimer() const
+{
+    return m_timer;
+}
+
+void HTTPConnection::lockProcess()
+{
+    m_process_locker.lock();
+}
+
+bool HTTPConnection::tryLockProcess()
 {
-    if(m_timer.get()) {
-        LOG_DEBUG << "update timer" << Log::endl;
-        m_timer->update(timeout);
+    return m_process_locker.trylock();
+}
+
+void HTTPConnection::unlockProcess()
+{
+    m_process_locker.unlock();
+}
+
+void HTTPConnection::updateTimer()
+{
+    if (m_timer.get())
+    {
+        CONN_PHASE current = phase();
+        if (current != m_timer->getPhase())
+        {
+            LOG_DEBUG << "connection phase " << m_timer->getPhase() << " -> " << current << Log::endl;
+        }
+        m_timer->update(current, deadline(current));
+    }
+}
+
+CONN_PHASE HTTPConnection::phase() const
+{
+    if (m_conn_state == CONN_HANDSHAKING)
+    {
+        return PHASE_HANDSHAKE;
+    }
+    if (!m_write_buf.empty() || m_file_fd != -1)
+    {
+        return PHASE_WRITE;
+    }
+    if (m_parse_state == PARSE_STATE_CONTENT)
+    {
+        return PHASE_BODY;
+    }
+    if (isIdle() && !isNew())
+    {
+        return PHASE_IDLE;
+    }
+    // 读缓冲区中有不完整的请求，或者新连接还没有发来第一个请求
+    return PHASE_HEADER;
+}
+
+// 握手和头部阶段从阶段开始的时间计算，其余阶段从现在（最近一次读写之后）计算
+uint64_t HTTPConnection::deadline(CONN_PHASE phase) const
+{
+    uint64_t start = nowMicros();
+    if (phase == PHASE_HANDSHAKE)
+    {
+        start = m_accept_time;
+    }
+    else if (phase == PHASE_HEADER)
+    {
+        start = m_request_start ? m_request_start : m_accept_time;
     }
+    return start / 1000 + m_timeouts[phase];
 }
\ No newline at end of file
@@ -19,28 +19,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
-#include <regex>
 #include <stdarg.h>
 #include <errno.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <atomic>
 #include <openssl/ssl.h>
 #include "locker.h"
 #include "database.h"
 #include "timer.h"
+#include "poller.h"
+#include "stats.h"
+#include "connslab.h"
+#include "httpparser.h"
+#include "urlencoded.h"
+#include "multipart.h"
+#include "chunked.h"
+#include "readbuffer.h"
+#include "outputchain.h"
+#include "filecache.h"
+#include "byterange.h"
+#include "compress.h"
 
 class TimerNode;
 
-// HTTP 请求方法
-enum METHOD
+extern const std::string doc_root; // 网站的根目录
+extern const std::string upload_dir; // 正在接收的上传文件所在的目录
+
+/* 连接的状态：
+ * CONN_HANDSHAKING : 正在进行 TLS 握手，由 I/O 事件驱动 SSL_do_handshake
+ * CONN_ESTABLISHED : 握手完成，开始读取和处理 HTTP 请求 */
+enum CONN_STATE
 {
-    GET = 0,
-    POST,
-    HEAD,
-    PUT,
-    DELETE,
-    TRACE,
-    OPTIONS,
-    CONNECT
+    CONN_HANDSHAKING = 0,
+    CONN_ESTABLISHED
 };
 
 /* 解析客户端请求时，主状态机的状态：
@@ -55,17 +67,6 @@ enum PARSE_STATE
     PARSE_DONE
 };
 
-/* 从状态机的三种可能状态，即行的读取状态，分别表示：
- * 1. 读取到一个完整的行；
- * 2. 行出错；
- * 3. 行数据尚且不完整 */
-enum LINE_STATUS
-{
-    LINE_OK = 0,
-    LINE_BAD,
-    LINE_OPEN
-};
-
 /* 服务器处理 HTTP 请求的可能结果，报文解析的结果：
  * NO_REQUEST:          请求不完整，需要继续读取客户端数据
  * GET_REQUEST:         表示获得一个完成的客户请求
@@ -74,6 +75,7 @@ enum LINE_STATUS
  * FORBIDDEN_REQUEST:   表示客户端对资源没有足够的访问权限
  * FILE_REQUEST:        文件请求，获取文件成功
  * INTERNAL_ERROR:      表示服务器内部错误
+ * PAYLOAD_TOO_LARGE:   请求体超过了允许的最大长度
  * DATABASE_REQUEST:    数据库访问请求 */
 enum PARSE_RESULT
 {
@@ -83,15 +85,11 @@ enum PARSE_RESULT
     NO_RESOURCE,
     FORBIDDEN_REQUEST,
     FILE_REQUEST,
-    INTERNAL_ERROR
-};
-
-enum HTTP_VERSION
-{
-    HTTP_1_0,
-    HTTP_1_1,
-    HTTP_2_0,
-    HTTP_3_0
+    INTERNAL_ERROR,
+    PAYLOAD_TOO_LARGE,
+    HEADER_TOO_LARGE,
+    NOT_MODIFIED, // 条件请求的验证器和目标文件匹配
+    RANGE_NOT_SATISFIABLE
 };
 
 enum ACTION
@@ -113,69 +111,135 @@ enum INFO_TYPE
 
 class HTTPConnection
 {
+    friend class RequestHarness; // test/request_bench.cpp 不经过 socket 直接驱动请求解析
+
 public:
-    static int m_epoll_fd;                     // 所有 socket 上的事件都被注册到同一个 epoll 对象中
-    static int m_user_count;                   // 统计用户的数量
-    static const int READ_BUFFER_SIZE = 4096;  // 读缓冲区的大小
+    static std::atomic<int> m_user_count;      // 统计用户的数量
+    static std::atomic<bool> m_draining;       // 热升级后旧进程正在排空连接，响应发送完毕即关闭连接
+    static const int READ_BUFFER_SIZE = 4096;  // 每次读 socket 时读缓冲区中至少准备的空间，连续读满时加倍
     static const int WRITE_BUFFER_SIZE = 4096; // 写缓冲区的大小
+    static const int MAX_READ_AHEAD = 65536;   // 请求体交给解析器之前，一次读事件最多读入读缓冲区的字节数
+    static const int MAX_WRITE_BATCH = 65536;  // 流水线请求的响应合并发送时，写缓冲区中最多积累的字节数
+    static size_t m_max_body_size;             // 请求体的最大长度，0 表示不限制
+    static int m_timeouts[PHASE_COUNT];        // 各个阶段的超时时间（毫秒），见 CONN_PHASE
 
-    HTTPConnection() {}
+    HTTPConnection() : m_sock_fd(-1), m_poller(NULL), m_reactor_load(NULL), m_slab(NULL), m_handle(0),
+                       m_parser(m_read_buf), m_file_fd(-1) {}
     ~HTTPConnection() {}
 
-    void init(int sock_fd, const sockaddr_in &addr, SSL *ssl); // 初始化新的连接
-    void process();                                            // 处理请求
-    void close_conn();                                         // 关闭连接
-    bool read();                                               // 非阻塞地读
-    bool write();                                              // 非阻塞地写
+    void init(int sock_fd, const sockaddr_in &addr, SSL *ssl, Poller *poller, std::atomic<int> *reactor_load,
+              ConnectionSlab *slab, ConnHandle handle); // 初始化新的连接，ssl 为 NULL 表示明文 HTTP 连接
+    void process();                                         // 处理请求，握手阶段则继续握手
+    int handshake();                                        // 非阻塞地推进 TLS 握手，-1 表示失败，返回值见定义处
+    bool isHandshaking() const;
+    bool hasBufferedData() const;                           // OpenSSL 中是否还有未读出的数据
+    bool isIdle() const;                                    // 是否为两个请求之间空闲的 keep-alive 连接
+    bool isNew() const;                                     // 连接上还没有发送过完整的响应
+    bool hasPendingRequest() const;                         // 读缓冲区中还有没有处理的流水线请求
+    void reject();                                          // 过载时不处理请求，回复 503 后关闭连接
+    static std::string serviceUnavailable();                // 带 Retry-After 的 503 响应
+    void close_conn();                                      // 关闭连接
+    bool read();                                            // 非阻塞地读
+    bool write();                                           // 非阻塞地写
     void setTimer(std::shared_ptr<TimerNode>);
-    void updateTimer(int timeout);
+    std::shared_ptr<TimerNode> getTimer() const;
+    void updateTimer();                                     // 按当前所处的阶段更新定时器的截止时间
+    // 工作线程处理连接期间持有 m_process_locker。Reactor 因超时或空闲关闭连接之前只尝试加锁，
+    // 失败说明连接正在线程池中处理，此时关闭会释放工作线程正在使用的 SSL、fd 和槽位
+    void lockProcess();
+    bool tryLockProcess();
+    void unlockProcess();
+    CONN_PHASE phase() const;                               // 连接当前所处的阶段，在连接不在线程池中时调用
+    uint64_t deadline(CONN_PHASE phase) const;              // 该阶段的截止时间，单调时钟的毫秒数
+    ConnHandle getHandle() const;
+    ConnectionSlab *getSlab() const;
 
 private:
     int m_sock_fd;             // 该 HTTP 连接的 socket
-    SSL *m_ssl;                // SSL
+    Poller *m_poller;          // 该连接所属 Reactor 的事件后端
+    std::atomic<int> *m_reactor_load; // 所属 Reactor 的连接计数，关闭连接时减一
+    ConnectionSlab *m_slab;    // 连接所在的连接表，关闭连接时归还槽位
+    ConnHandle m_handle;       // 连接的句柄，作为事件数据注册到事件后端中
+    SSL *m_ssl;                // SSL，明文 HTTP 连接为 NULL
     sockaddr_in m_address;     // 通信对方的 socket 地址
     Database::key_type m_user; // 当前连接的用户
     std::shared_ptr<TimerNode> m_timer;
+    Locker m_process_locker; // 见 lockProcess()，属于槽位而不是连接，槽位被复用时不重新初始化
+    CONN_STATE m_conn_state;
+    uint64_t m_accept_time;   // 连接建立的时间，用于统计握手耗时
+    uint64_t m_request_start; // 读到当前请求第一个字节的时间，用于统计请求耗时
+    int m_served;             // 连接上已经发送完毕的响应数
+    bool m_rejected;          // 当前响应是过载时的 503，发送完毕后关闭连接
+    bool m_close;             // 响应带有 Connection: close，或者请求体没有读完（超过最大长度或者上传出错），响应发送完毕后关闭连接
+    int m_responses;          // 写缓冲区中合并发送的响应数
+    bool m_pending;           // 这一批响应之后读缓冲区中还有请求，发送完毕后直接交给工作线程处理
 
-    std::string m_read_buf; // 读缓冲区
+    ReadBuffer m_read_buf;  // 读缓冲区，流水线请求依次排列
+    int m_request_begin;    // 当前请求在读缓冲区中的开始位置
     int m_pos;              // 目前正在读的位置
-    int m_line;             // 目前正在读的位置的行首位置
+    int m_line;             // 目前正在读的位置的行首位置，当前请求结束后是下一个请求的开始
     int m_read_size;        // 读缓冲区的大小
     PARSE_STATE m_parse_state;
     LINE_STATUS m_line_status;
+    HTTPParser m_parser;    // 请求行和请求头部，以视图的形式指向 m_read_buf
 
-    std::string m_file_path; // 客户请求的目标文件的完整路径，其内容等于 doc_root + m_url, doc_root 是网站根目录
-    METHOD m_method;         // 请求方法
-    std::string m_url;       // 请求目标文件的文件名
+    std::string m_file_path; // 客户请求的目标文件的完整路径，其内容等于 doc_root + url, doc_root 是网站根目录
     ACTION m_action;
-    std::string m_protocol; // 协议
-    HTTP_VERSION m_version; // 协议版本
-    // std::string m_host;                       // 主机名
     int m_content_length; // HTTP 请求的消息总长度
     bool m_linger;        // HTTP 请求是否保持连接
     std::unordered_map<std::string, std::string> m_parameters;
-    std::unordered_map<std::string, std::string> m_headers;
 
-    std::string m_write_buf; // 写缓冲区
+    OutputChain m_write_buf; // 写缓冲区，响应头之后的响应体尽量引用而不复制，见 OutputChain
     std::string m_file_buf;
+    CachedFilePtr m_cached_file; // 静态文件缓存中的目标文件，响应体从中复制，不再打开和读取文件
+    const char *m_content_type;  // 静态文件按扩展名确定，其他响应（包括错误页面和 CGI 输出）为 text/html
+    std::string m_etag;          // 静态文件的验证器，其他响应（以及不知道长度的文件）为空，不发送
+    std::string m_last_modified;
+    CONTENT_ENCODING m_encoding; // 响应体的编码：缓存中文件的压缩版本，或者压缩过的 CGI 输出
+    bool m_vary;                 // 响应体按 Accept-Encoding 选择，需要发送 Vary
+    int m_file_fd;           // 边发送边读取的文件，-1 表示没有或者文件内容已读入 m_file_buf
+    bool m_sendfile;         // 文件通过 sendfile/SSL_sendfile 发送，否则每次读出一段直接读入写缓冲区的新段中
+    bool m_chunked_response; // 响应体的长度事先不知道，使用分块编码发送
+    off_t m_file_offset;     // 文件中下一个要发送的字节
+    off_t m_file_end;        // 文件中正在发送的部分（整个文件或者一个范围）的结尾
+    // 范围请求（206）要发送的范围。从文件中发送时一个范围发送完毕后才准备下一个，
+    // 所以和 m_file_fd 一样保留到文件发送完毕（closeFile()），其他情况下在开始下一个请求时清空
+    std::vector<ByteRange> m_ranges;
+    size_t m_range_index;    // 正在从文件中发送的范围
+    std::string m_boundary;  // 多个范围时 multipart/byteranges 的分隔符
+    const char *m_range_type; // 多个范围时每个部分的 Content-Type，即目标文件的类型（m_content_type 随请求重置）
+
+    // 上传请求体由 multipart 解析器边接收边解析，文件部分直接写入临时文件
+    MultipartParser m_multipart;
+    size_t m_body_remaining;    // 还没有交给解析器的请求体字节数，read() 读到后直接交给解析器
+    ChunkedDecoder m_chunk_decoder; // 分块编码的请求体：上传时边接收边解码，其他请求在读缓冲区中原地解码
     struct stat m_file_stat; // 目标文件的状态。可以用来判断文件是否存在、是否为目录、是否可读，并获取文件大小等相关信息
 
     void init(); // 初始化除了连接以外的信息
+    void resetRequest(); // 重置解析单个请求的状态，不改变读写缓冲区
+    void nextRequest();  // 当前请求的响应已经生成，开始解析读缓冲区中的下一个请求
+    void freeBuffers(); // 释放所有缓冲区和容器占用的堆内存，关闭后的连接不持有堆内存
+    void compactReadBuffer(); // 丢弃读缓冲区开头已经处理完的请求
 
-    PARSE_RESULT parseRequest();
-    LINE_STATUS parseRequestLine();
-    bool readMethod(int end);
-    bool readURL(int end);
-    bool readProtocol(int end);
-    LINE_STATUS parseHeaders();
-    bool readHeader(int end);
+    PARSE_RESULT parseRequest(); // 解析读缓冲区中的当前请求，请求完整时返回 GET_REQUEST
     LINE_STATUS parseContent();
+    LINE_STATUS startUpload();
+    LINE_STATUS readBody();   // 整个请求体是否已经在读缓冲区中（从 m_pos 开始，长度为 m_content_length）
+    LINE_STATUS decodeChunked();
+    bool bodyTooLarge() const; // 分块编码的请求体超过了最大长度
+    LINE_STATUS feedUpload(); // 把读缓冲区中的请求体交给解析器
+    size_t feedBody(char *data, size_t size); // 把上传的请求体交给解析器，返回属于请求体的字节数
+    size_t consumeBody(char *data, size_t size); // 返回直接交给解析器的字节数
     LINE_STATUS isBlank();
     LINE_STATUS isSpecialSymbol();
     LINE_STATUS readString(std::string &);
     void parseURL();
-    void parseParameters(std::string);
     PARSE_RESULT doRequest();
+    bool notModified(time_t mtime) const; // 按 If-None-Match/If-Modified-Since 判断客户端的副本是否仍然有效
+    PARSE_RESULT checkRange(PARSE_RESULT result); // 按 Range/If-Range 确定要发送的范围，result 为没有范围时的结果
+    off_t fileSize() const;
+    void selectEncoding(); // 按 Accept-Encoding 选择缓存中文件的压缩版本，范围请求总是使用原文件
+    void compressBody();   // 压缩 m_file_buf 中 CGI 生成的响应体
     bool doAction();
     bool doLogin();
     bool doRegister();
@@ -184,13 +248,23 @@ private:
     bool doUpdate();
     bool doUpload();
     void readFile();
+    bool openFile();  // 打开目标文件，小文件直接读入 m_file_buf，其他文件留给 write() 边读边发送
+    void closeFile();
+    int sendFile();   // 返回 1 表示发送完毕，0 表示需要等待可写，-1 表示出错
+    bool nextRange();    // 从文件中发送的一个范围发送完毕后，把下一个范围的头部（或者结尾的分隔符）放入写缓冲区
+    int readFileChunk(); // 读出文件的下一段放入写缓冲区，返回 1 表示追加了数据，0 表示文件发送完毕，-1 表示出错
 
     bool generateResponse(PARSE_RESULT result); // 生成 HTTP 响应
     void writeString(std::string str);
     void addStatusLine(std::string status, std::string title);
-    void addHeaders(int content_length);
-    void addContentLength(int content_length);
+    void addHeaders(off_t content_length, bool length_known = true);
+    void addContentLength(off_t content_length);
+    void addTransferEncoding();
     void addContentType();
+    void addValidators(); // ETag、Last-Modified 和 Accept-Ranges
+    void addEncoding();   // Content-Encoding 和 Vary
+    void addRanges();     // 206 响应的响应头和响应体
+    std::string rangePartHeader(size_t i) const; // 多个范围时第 i 个范围之前的分隔符和头部
     void addLinger();
-    void addContent(std::string content);
+    void addContent(const std::string &content); // 引用静态的内容（错误页面），不复制
 };
@@ -0,0 +1,39 @@
+#include "httpdate.h"
+#include <string.h>
+
+std::string HTTPDate::format(time_t t)
+{
+    char buf[64];
+    tm result;
+    gmtime_r(&t, &result);
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &result);
+    return buf;
+}
+
+bool HTTPDate::parse(StringView input, time_t &t)
+{
+    static const char *FORMATS[] = {
+        "%a, %d %b %Y %H:%M:%S GMT", // IMF-fixdate
+        "%A, %d-%b-%y %H:%M:%S GMT", // RFC 850
+        "%a %b %e %H:%M:%S %Y",      // asctime
+    };
+    char buf[64];
+    if (input.size >= sizeof(buf))
+    {
+        return false;
+    }
+    memcpy(buf, input.data, input.size);
+    buf[input.size] = '\0';
+    for (const char *format : FORMATS)
+    {
+        tm result;
+        memset(&result, 0, sizeof(result));
+        const char *end = strptime(buf, format, &result);
+        if (end != NULL && *end == '\0')
+        {
+            t = timegm(&result);
+            return true;
+        }
+    }
+    return false;
+}
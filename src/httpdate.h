@@ -0,0 +1,14 @@
+#pragma once
+
+#include <time.h>
+#include <string>
+#include "stringview.h"
+
+/* HTTP 首部中的日期（Last-Modified、If-Modified-Since 等）。生成时总是使用 IMF-fixdate 格式
+ * "Sun, 06 Nov 1994 08:49:37 GMT"；解析时还接受 RFC 850 和 asctime 两种过时的格式（RFC 9110 5.6.7）。 */
+class HTTPDate
+{
+public:
+    static std::string format(time_t t);
+    static bool parse(StringView input, time_t &t); // 格式不正确时返回 false
+};
@@ -0,0 +1,262 @@
+#include "httpparser.h"
+#include <string.h>
+#include "scan.h"
+
+static_assert(HEADER_COUNT <= 32, "m_present holds one bit per well-known header");
+
+// 空白字符（OWS）：空格和水平制表符
+static bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+void HTTPParser::reset()
+{
+    m_method = GET;
+    m_version = HTTP_1_1;
+    m_url = slice(0, 0);
+    m_protocol = slice(0, 0);
+    m_present = 0; // 槽位只在对应的位被置位后才有效，这里不需要清空
+    m_headers.clear(); // 保留容量，同一连接上的后续请求不再分配
+    m_content_length = 0;
+    m_chunked = false;
+    m_keep_alive = false;
+}
+
+void HTTPParser::release()
+{
+    std::vector<Header>().swap(m_headers);
+}
+
+void HTTPParser::rebase(size_t delta)
+{
+    m_url.offset -= delta;
+    m_protocol.offset -= delta;
+    for (int i = 0; i < HEADER_COUNT; ++i)
+    {
+        m_known[i].offset -= delta; // 没有出现的首部的槽位不会被读取
+    }
+    for (size_t i = 0; i < m_headers.size(); ++i)
+    {
+        m_headers[i].name.offset -= delta;
+        m_headers[i].value.offset -= delta;
+    }
+}
+
+HTTPParser::Slice HTTPParser::slice(size_t begin, size_t end)
+{
+    Slice ret;
+    ret.offset = begin;
+    ret.length = end - begin;
+    return ret;
+}
+
+LINE_STATUS HTTPParser::parseRequestLine(int &pos)
+{
+    // "GET /index.html HTTP/1.1\r\n"
+    const char *begin = m_buf.data();
+    const char *line = begin + pos;
+    const char *enter = Scanner::findCRLF(line, begin + m_buf.size());
+    if (enter == NULL)
+    {
+        return LINE_OPEN;
+    }
+    const char *first = Scanner::findByte(line, enter, ' ');
+    if (first == NULL || !readMethod(StringView(line, first - line)))
+    {
+        return LINE_BAD;
+    }
+    const char *second = Scanner::findByte(first + 1, enter, ' ');
+    if (second == NULL)
+    {
+        return LINE_BAD;
+    }
+    m_url = slice(first + 1 - begin, second - begin);
+    if (!readProtocol(StringView(second + 1, enter - second - 1)))
+    {
+        return LINE_BAD;
+    }
+    m_protocol = slice(second + 1 - begin, enter - begin);
+    pos = enter + 2 - begin;
+    return LINE_OK;
+}
+
+LINE_STATUS HTTPParser::parseHeaders(int &pos)
+{
+    const char *begin = m_buf.data();
+    const char *end = begin + m_buf.size();
+    while (true)
+    {
+        const char *enter = Scanner::findCRLF(begin + pos, end);
+        if (enter == NULL)
+        {
+            return LINE_OPEN;
+        }
+        size_t enter_pos = enter - begin;
+        if (int(enter_pos) == pos)
+        {
+            break;
+        }
+        if (!readHeader(pos, enter_pos))
+        {
+            return LINE_BAD;
+        }
+        pos = enter_pos + 2;
+    }
+    pos += 2;
+    return LINE_OK;
+}
+
+StringView HTTPParser::header(StringView name) const
+{
+    HEADER_ID id = HTTPToken::header(name);
+    if (id != HEADER_UNKNOWN)
+    {
+        return header(id);
+    }
+    for (size_t i = 0; i < m_headers.size(); ++i)
+    {
+        if (view(m_headers[i].name).iequals(name))
+        {
+            return view(m_headers[i].value);
+        }
+    }
+    return StringView();
+}
+
+bool HTTPParser::hasHeader(StringView name) const
+{
+    HEADER_ID id = HTTPToken::header(name);
+    if (id != HEADER_UNKNOWN)
+    {
+        return hasHeader(id);
+    }
+    for (size_t i = 0; i < m_headers.size(); ++i)
+    {
+        if (view(m_headers[i].name).iequals(name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HTTPParser::readMethod(StringView token)
+{
+    return HTTPToken::method(token, m_method);
+}
+
+// 只接受 "HTTP/x.y" 这一种固定格式
+bool HTTPParser::readProtocol(StringView token)
+{
+    if (token.size != 8 || memcmp(token.data, "HTTP/", 5) != 0 || token[6] != '.')
+    {
+        return false;
+    }
+    switch ((token[5] << 8) | token[7])
+    {
+    case ('1' << 8) | '0':
+        m_version = HTTP_1_0;
+        break;
+    case ('1' << 8) | '1':
+        m_version = HTTP_1_1;
+        break;
+    case ('2' << 8) | '0':
+        m_version = HTTP_2_0;
+        break;
+    case ('3' << 8) | '0':
+        m_version = HTTP_3_0;
+        break;
+    default:
+        return false;
+    }
+    // HTTP/1.1 默认保持连接，HTTP/1.0 需要显式的 Connection: keep-alive
+    m_keep_alive = m_version == HTTP_1_1;
+    return true;
+}
+
+// "Name: value"，冒号后和行尾的空白不属于字段值
+bool HTTPParser::readHeader(size_t begin, size_t end)
+{
+    StringView line(m_buf.data() + begin, end - begin);
+    const char *colon_pos = Scanner::findByte(line.begin(), line.end(), ':');
+    if (colon_pos == NULL || colon_pos == line.begin())
+    {
+        return false;
+    }
+    size_t colon = colon_pos - line.begin();
+    size_t value_begin = colon + 1;
+    size_t value_end = line.size;
+    while (value_begin < value_end && isBlank(line[value_begin]))
+    {
+        ++value_begin;
+    }
+    while (value_end > value_begin && isBlank(line[value_end - 1]))
+    {
+        --value_end;
+    }
+    Header field;
+    field.name = slice(begin, begin + colon);
+    field.value = slice(begin + value_begin, begin + value_end);
+    StringView value = view(field.value);
+    HEADER_ID id = HTTPToken::header(view(field.name));
+    if (id == HEADER_UNKNOWN)
+    {
+        m_headers.push_back(field);
+        return true;
+    }
+    bool repeated = hasHeader(id);
+    if (repeated)
+    {
+        // 重复的常见首部放入溢出表，按名字查找时仍然返回第一次出现的值
+        m_headers.push_back(field);
+    }
+    else
+    {
+        m_known[id] = field.value;
+        m_present |= 1u << id;
+    }
+    switch (id)
+    {
+    case HEADER_CONTENT_LENGTH:
+    {
+        // 多个取值不同的 Content-Length 无法确定请求体的长度
+        if (repeated && value != header(HEADER_CONTENT_LENGTH))
+        {
+            return false;
+        }
+        int length = 0;
+        for (size_t i = 0; i < value.size; ++i)
+        {
+            if (value[i] < '0' || value[i] > '9' || length > (INT32_MAX - 9) / 10)
+            {
+                return false;
+            }
+            length = length * 10 + (value[i] - '0');
+        }
+        m_content_length = length;
+        break;
+    }
+    case HEADER_TRANSFER_ENCODING:
+        // 只支持分块编码，其他传输编码无法确定请求体的结尾
+        if (!value.iequals("chunked"))
+        {
+            return false;
+        }
+        m_chunked = true;
+        break;
+    case HEADER_CONNECTION:
+        if (value.iequals("keep-alive"))
+        {
+            m_keep_alive = true;
+        }
+        else if (value.iequals("close"))
+        {
+            m_keep_alive = false;
+        }
+        break;
+    default:
+        break;
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "httptoken.h"
+#include "readbuffer.h"
+#include "stringview.h"
+
+/* 从状态机的三种可能状态，即行的读取状态，分别表示：
+ * 1. 读取到一个完整的行；
+ * 2. 行出错；
+ * 3. 行数据尚且不完整 */
+enum LINE_STATUS
+{
+    LINE_OK = 0,
+    LINE_BAD,
+    LINE_OPEN
+};
+
+enum HTTP_VERSION
+{
+    HTTP_1_0,
+    HTTP_1_1,
+    HTTP_2_0,
+    HTTP_3_0
+};
+
+/* 请求行和请求头部的解析器。
+ * 解析时不复制请求的内容：方法、URL、协议和各个首部只记录它们在连接读缓冲区中的位置，
+ * 通过 StringView 访问，解析一个请求不需要分配堆内存（首部表的容量在连接上的请求之间复用）。
+ * 读缓冲区在读入更多数据时可能重新分配，所以这里保存偏移量而不是指针，访问时再按缓冲区当前的地址
+ * 转换为视图；视图在下一次向缓冲区追加数据之前有效。
+ * 常见首部（HEADER_ID）的位置保存在按编号索引的固定槽位中，查找时不需要比较字段名；
+ * 其他首部和重复出现的常见首部按出现顺序保存在溢出表中。 */
+class HTTPParser
+{
+public:
+    explicit HTTPParser(const ReadBuffer &buf) : m_buf(buf) { reset(); }
+
+    void reset();   // 开始解析一个新的请求
+    void release(); // 释放首部表占用的堆内存
+    void rebase(size_t delta); // 读缓冲区丢弃了开头的 delta 个字节，已经解析的位置随之前移
+    // 从 pos 开始解析，成功后 pos 移动到已经解析的行之后
+    LINE_STATUS parseRequestLine(int &pos);
+    LINE_STATUS parseHeaders(int &pos); // 解析到空行为止，数据不完整时 pos 停在第一个不完整的行
+
+    METHOD method() const { return m_method; }
+    HTTP_VERSION version() const { return m_version; }
+    StringView url() const { return view(m_url); }
+    StringView protocol() const { return view(m_protocol); }
+    StringView header(HEADER_ID id) const { return hasHeader(id) ? view(m_known[id]) : StringView(); } // 没有该首部时返回空视图
+    bool hasHeader(HEADER_ID id) const { return (m_present >> id) & 1; }
+    StringView header(StringView name) const; // 字段名不区分大小写，没有该首部时返回空视图
+    bool hasHeader(StringView name) const;
+    int contentLength() const { return m_content_length; }
+    bool chunked() const { return m_chunked; } // 请求体使用 Transfer-Encoding: chunked，此时忽略 Content-Length
+    bool keepAlive() const { return m_keep_alive; } // HTTP/1.1 没有 Connection: close，或者带有 Connection: keep-alive
+
+private:
+    struct Slice
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct Header
+    {
+        Slice name;
+        Slice value;
+    };
+
+    StringView view(Slice slice) const { return StringView(m_buf.data() + slice.offset, slice.length); }
+    static Slice slice(size_t begin, size_t end);
+    bool readMethod(StringView token);
+    bool readProtocol(StringView token);
+    bool readHeader(size_t begin, size_t end);
+
+    const ReadBuffer &m_buf; // 所属连接的读缓冲区
+    METHOD m_method;
+    HTTP_VERSION m_version;
+    Slice m_url;
+    Slice m_protocol;
+    Slice m_known[HEADER_COUNT]; // 常见首部第一次出现时的值
+    uint32_t m_present;          // 出现过的常见首部，按 HEADER_ID 置位
+    std::vector<Header> m_headers; // 溢出表
+    int m_content_length;
+    bool m_chunked;
+    bool m_keep_alive;
+};
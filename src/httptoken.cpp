@@ -0,0 +1,227 @@
+#include "httptoken.h"
+#include <stdint.h>
+#include <string.h>
+
+namespace
+{
+
+// 只折叠 ASCII 字母的大小写，非字母字符参与散列时同样按位或 0x20，不影响散列的一致性
+constexpr unsigned fold(char c)
+{
+    return (unsigned char)c | 0x20;
+}
+
+constexpr size_t length(const char *s)
+{
+    return *s ? 1 + length(s + 1) : 0;
+}
+
+// 方法名按 METHOD 的顺序排列，区分大小写。散列只取长度和首、尾两个字符
+struct MethodTable
+{
+    static constexpr unsigned SIZE = 16;
+    static constexpr unsigned COUNT = METHOD_COUNT;
+    static constexpr const char *NAMES[COUNT] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT"};
+
+    static constexpr unsigned hash(const char *s, size_t n)
+    {
+        return (n + fold(s[0]) * 3 + fold(s[n - 1]) * 5) & (SIZE - 1);
+    }
+};
+
+// 首部名按 HEADER_ID 的顺序排列，全部为小写。散列取首、中、尾三个字符，不区分大小写
+struct HeaderTable
+{
+    static constexpr unsigned SIZE = 64;
+    static constexpr unsigned COUNT = HEADER_COUNT;
+    static constexpr const char *NAMES[COUNT] = {
+        "host", "connection", "content-length", "content-type", "transfer-encoding", "user-agent",
+        "accept", "accept-encoding", "accept-language", "cookie", "referer", "if-none-match",
+        "if-modified-since", "range", "if-range", "cache-control", "origin", "upgrade", "expect",
+        "authorization", "pragma", "te"};
+
+    static constexpr unsigned hash(const char *s, size_t n)
+    {
+        return (fold(s[0]) * 2 + fold(s[n / 2]) * 2 + fold(s[n - 1]) * 3) & (SIZE - 1);
+    }
+};
+
+constexpr const char *MethodTable::NAMES[];
+constexpr const char *HeaderTable::NAMES[];
+
+template <typename T>
+constexpr unsigned slotOf(unsigned i)
+{
+    return T::hash(T::NAMES[i], length(T::NAMES[i]));
+}
+
+// 第 i 个名字和它之后的名字（从 j 开始）都不冲突
+template <typename T>
+constexpr bool unique(unsigned i, unsigned j)
+{
+    return j >= T::COUNT || (slotOf<T>(i) != slotOf<T>(j) && unique<T>(i, j + 1));
+}
+
+template <typename T>
+constexpr bool perfect(unsigned i = 0)
+{
+    return i >= T::COUNT || (unique<T>(i, i + 1) && perfect<T>(i + 1));
+}
+
+static_assert(perfect<MethodTable>(), "method names collide in the hash table");
+static_assert(perfect<HeaderTable>(), "header names collide in the hash table");
+
+// 散列到 slot 的名字的下标，空槽位为 COUNT
+template <typename T>
+constexpr unsigned owner(unsigned slot, unsigned i = 0)
+{
+    return i >= T::COUNT ? T::COUNT : slotOf<T>(i) == slot ? i : owner<T>(slot, i + 1);
+}
+
+template <size_t... I>
+struct Indices
+{
+};
+
+template <size_t N, size_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...>
+{
+};
+
+template <size_t... I>
+struct MakeIndices<0, I...>
+{
+    typedef Indices<I...> type;
+};
+
+// 编译期生成的查找表。槽位中直接保存名字和它的长度，查找时只依赖散列值读一次表；空槽位的长度为 0，不会和任何记号相等
+struct Slot
+{
+    const char *name;
+    uint8_t length;
+    uint8_t index;
+};
+
+template <typename T>
+struct Table
+{
+    Slot slots[T::SIZE];
+    uint8_t lengths[T::COUNT]; // 按下标
+};
+
+template <typename T>
+constexpr Slot makeSlot(unsigned index)
+{
+    return index == T::COUNT ? Slot{"", 0, (uint8_t)index}
+                             : Slot{T::NAMES[index], (uint8_t)length(T::NAMES[index]), (uint8_t)index};
+}
+
+template <typename T, size_t... S, size_t... N>
+constexpr Table<T> makeTable(Indices<S...>, Indices<N...>)
+{
+    return Table<T>{{makeSlot<T>(owner<T>(S))...}, {(uint8_t)length(T::NAMES[N])...}};
+}
+
+template <typename T>
+constexpr Table<T> makeTable()
+{
+    return makeTable<T>(typename MakeIndices<T::SIZE>::type(), typename MakeIndices<T::COUNT>::type());
+}
+
+constexpr Table<MethodTable> METHODS = makeTable<MethodTable>();
+constexpr Table<HeaderTable> HEADERS = makeTable<HeaderTable>();
+
+// 表中的首部名只包含小写字母和 '-'，字母所在的字节都有 0x40 位，右移一位就是折叠大小写需要的 0x20：
+// 字段名的字节或上 0x20 后等于小写字母，当且仅当它是这个字母的大写或小写；'-' 所在的字节要求完全相同
+constexpr bool lowerName(const char *s)
+{
+    return *s == 0 || (((*s >= 'a' && *s <= 'z') || *s == '-') && lowerName(s + 1));
+}
+
+template <typename T>
+constexpr bool lowerNames(unsigned i = 0)
+{
+    return i >= T::COUNT || (lowerName(T::NAMES[i]) && lowerNames<T>(i + 1));
+}
+
+static_assert(lowerNames<HeaderTable>(), "header names must be lowercase letters and '-'");
+
+template <bool Fold, typename Word>
+bool wordEqual(const char *token, const char *name)
+{
+    Word t;
+    Word n;
+    memcpy(&t, token, sizeof(Word));
+    memcpy(&n, name, sizeof(Word));
+    return (Fold ? t | ((n & (Word)0x4040404040404040ULL) >> 1) : t) == n;
+}
+
+// 长度已经相同。按 8 或 4 个字节一组比较，最后一组和前面的重叠，不会读出名字的范围。
+// Fold 为 true 时不区分大小写，此时 name 必须满足 lowerName
+template <bool Fold>
+bool same(const char *token, const char *name, size_t n)
+{
+    if (n < 4)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if ((Fold ? StringView::toLower(token[i]) : token[i]) != name[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (n < 8)
+    {
+        return wordEqual<Fold, uint32_t>(token, name) && wordEqual<Fold, uint32_t>(token + n - 4, name + n - 4);
+    }
+    for (size_t i = 0; i + 8 < n; i += 8)
+    {
+        if (!wordEqual<Fold, uint64_t>(token + i, name + i))
+        {
+            return false;
+        }
+    }
+    return wordEqual<Fold, uint64_t>(token + n - 8, name + n - 8);
+}
+
+} // namespace
+
+bool HTTPToken::method(StringView token, METHOD &method)
+{
+    if (token.empty())
+    {
+        return false;
+    }
+    const Slot &slot = METHODS.slots[MethodTable::hash(token.data, token.size)];
+    if (token.size != slot.length || !same<false>(token.data, slot.name, token.size))
+    {
+        return false;
+    }
+    method = METHOD(slot.index);
+    return true;
+}
+
+HEADER_ID HTTPToken::header(StringView name)
+{
+    if (name.empty())
+    {
+        return HEADER_UNKNOWN;
+    }
+    const Slot &slot = HEADERS.slots[HeaderTable::hash(name.data, name.size)];
+    if (name.size != slot.length || !same<true>(name.data, slot.name, name.size))
+    {
+        return HEADER_UNKNOWN;
+    }
+    return HEADER_ID(slot.index);
+}
+
+StringView HTTPToken::headerName(HEADER_ID id)
+{
+    if (id >= HEADER_COUNT)
+    {
+        return StringView();
+    }
+    return StringView(HeaderTable::NAMES[id], HEADERS.lengths[id]);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "stringview.h"
+
+// HTTP 请求方法
+enum METHOD
+{
+    GET = 0,
+    POST,
+    HEAD,
+    PUT,
+    DELETE,
+    TRACE,
+    OPTIONS,
+    CONNECT,
+    METHOD_COUNT
+};
+
+// 常见的请求首部，HTTPParser 把它们的值保存在固定的槽位中。顺序和 httptoken.cpp 中的名字表一致
+enum HEADER_ID
+{
+    HEADER_HOST = 0,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_USER_AGENT,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_ACCEPT_LANGUAGE,
+    HEADER_COOKIE,
+    HEADER_REFERER,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_RANGE,
+    HEADER_IF_RANGE,
+    HEADER_CACHE_CONTROL,
+    HEADER_ORIGIN,
+    HEADER_UPGRADE,
+    HEADER_EXPECT,
+    HEADER_AUTHORIZATION,
+    HEADER_PRAGMA,
+    HEADER_TE,
+    HEADER_COUNT,
+    HEADER_UNKNOWN = HEADER_COUNT
+};
+
+/* 方法名和常见首部名到枚举值的查找。
+ * 两张表都是编译期生成的完美散列表：散列值只取决于名字的长度和其中的两三个字符，
+ * 表中的名字两两不冲突（编译期检查），所以查找只需要计算一次散列，再和槽位中唯一的候选名字比较一次。
+ * 方法名区分大小写，首部名不区分大小写。 */
+class HTTPToken
+{
+public:
+    static bool method(StringView token, METHOD &method); // 不是已知的方法返回 false
+    static HEADER_ID header(StringView name);             // 不是常见首部返回 HEADER_UNKNOWN
+    static StringView headerName(HEADER_ID id);
+};
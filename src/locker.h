@@ -26,6 +26,11 @@ public:
     {
         return pthread_mutex_lock(&m_mutex) == 0;
     }
+    // 尝试加锁，互斥量已经被其他线程持有时立即返回 false
+    bool trylock()
+    {
+        return pthread_mutex_trylock(&m_mutex) == 0;
+    }
     // 对互斥量进行解锁
     bool unlock()
     {
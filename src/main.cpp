@@ -7,13 +7,28 @@ int main(int argc, char *argv[])
 {
     const std::string JSON_CONFIG_FILE_PATH = "config.json";
     const std::string JSON_KEY_PORT = "port";
+    const std::string JSON_KEY_HTTP_PORT = "http port";
     const std::string JSON_KEY_DEFAULT_FILE = "default file";
     const std::string JSON_KEY_LONG_CONN = "long connection";
     const std::string JSON_KEY_MAX_HTTP_CONN = "max http connection";
     const std::string JSON_KEY_MAX_EVENT = "max events";
     const std::string JSON_KEY_HTTP_TIMEOUT = "http timeout";
+    const std::string JSON_KEY_HANDSHAKE_TIMEOUT = "handshake timeout";
+    const std::string JSON_KEY_HEADER_TIMEOUT = "header timeout";
+    const std::string JSON_KEY_BODY_TIMEOUT = "body timeout";
+    const std::string JSON_KEY_WRITE_TIMEOUT = "write timeout";
+    const std::string JSON_KEY_FILE_CACHE_SIZE = "file cache size";
+    const std::string JSON_KEY_FILE_CACHE_MAX_FILE = "file cache max file";
+    const std::string JSON_KEY_COMPRESSION = "compression";
+    const std::string JSON_KEY_COMPRESSION_MIN_SIZE = "compression min size";
     const std::string JSON_KEY_THREAD_N = "thread number";
     const std::string JSON_KEY_MAX_REQUEST = "max requests";
+    const std::string JSON_KEY_REACTOR_N = "reactor number";
+    const std::string JSON_KEY_REACTOR_DISPATCH = "reactor dispatch";
+    const std::string JSON_KEY_REUSEPORT_WORKERS = "reuseport workers";
+    const std::string JSON_KEY_PIN_CPU = "pin worker cpu";
+    const std::string JSON_KEY_IO_BACKEND = "io backend";
+    const std::string JSON_KEY_HANDSHAKE_OFFLOAD = "tls handshake offload";
     const std::string JSON_KEY_DB_FILE = "database file";
     const std::string JSON_KEY_MAX_N_EDIT = "max number of edit";
     const std::string JSON_KEY_DUMP_INTERVAL = "dump interval";
@@ -23,6 +38,17 @@ int main(int argc, char *argv[])
     const std::string JSON_KEY_CERT_PATH = "cert path";
     const std::string JSON_KEY_CERT_PASSWD = "cert password";
     const std::string JSON_KEY_PRIVATE_KEY_PATH = "private key path";
+    const std::string JSON_KEY_TLS13 = "tls 1.3";
+    const std::string JSON_KEY_SESSION_CACHE_SIZE = "ssl session cache size";
+    const std::string JSON_KEY_SESSION_TIMEOUT = "ssl session timeout";
+    const std::string JSON_KEY_TICKET_ROTATION = "ssl ticket key rotation";
+    const std::string JSON_KEY_KTLS = "ktls";
+    const std::string JSON_KEY_UPGRADE_DRAIN_TIMEOUT = "upgrade drain timeout";
+    const std::string JSON_KEY_ADMISSION_QUEUE_DEPTH = "admission queue depth";
+    const std::string JSON_KEY_ADMISSION_QUEUE_WAIT = "admission queue wait";
+    const std::string JSON_KEY_RETRY_AFTER = "retry after";
+    const std::string JSON_KEY_MAX_BODY_SIZE = "max body size";
+    const std::string JSON_KEY_MAX_READ_BUFFER = "max read buffer";
 
     
     std::string content;
@@ -62,6 +88,32 @@ int main(int argc, char *argv[])
     server.init(json.get_object_value(JSON_KEY_CERT_PATH).get_string(),
                 json.get_object_value(JSON_KEY_CERT_PASSWD).get_string(),
                 json.get_object_value(JSON_KEY_PRIVATE_KEY_PATH).get_string());
+    server.setTLSSession(json.get_object_value(JSON_KEY_TLS13).get_type() == JSON_TRUE,
+                         json.get_object_value(JSON_KEY_SESSION_CACHE_SIZE).get_number(),
+                         json.get_object_value(JSON_KEY_SESSION_TIMEOUT).get_number(),
+                         json.get_object_value(JSON_KEY_TICKET_ROTATION).get_number());
+    server.setHTTPPort(json.get_object_value(JSON_KEY_HTTP_PORT).get_number());
+    server.setKTLS(json.get_object_value(JSON_KEY_KTLS).get_type() == JSON_TRUE);
+    server.setReactors(json.get_object_value(JSON_KEY_REACTOR_N).get_number(),
+                       json.get_object_value(JSON_KEY_REACTOR_DISPATCH).get_string());
+    server.setReuseportWorkers(json.get_object_value(JSON_KEY_REUSEPORT_WORKERS).get_number(),
+                               json.get_object_value(JSON_KEY_PIN_CPU).get_type() == JSON_TRUE);
+    server.setIOBackend(json.get_object_value(JSON_KEY_IO_BACKEND).get_string());
+    server.setHandshakeOffload(json.get_object_value(JSON_KEY_HANDSHAKE_OFFLOAD).get_type() == JSON_TRUE);
+    server.setUpgrade(argv, json.get_object_value(JSON_KEY_UPGRADE_DRAIN_TIMEOUT).get_number());
+    server.setAdmission(json.get_object_value(JSON_KEY_ADMISSION_QUEUE_DEPTH).get_number(),
+                        json.get_object_value(JSON_KEY_ADMISSION_QUEUE_WAIT).get_number(),
+                        json.get_object_value(JSON_KEY_RETRY_AFTER).get_number());
+    server.setMaxBodySize(json.get_object_value(JSON_KEY_MAX_BODY_SIZE).get_number());
+    server.setMaxReadBuffer(json.get_object_value(JSON_KEY_MAX_READ_BUFFER).get_number());
+    server.setTimeouts(json.get_object_value(JSON_KEY_HANDSHAKE_TIMEOUT).get_number(),
+                       json.get_object_value(JSON_KEY_HEADER_TIMEOUT).get_number(),
+                       json.get_object_value(JSON_KEY_BODY_TIMEOUT).get_number(),
+                       json.get_object_value(JSON_KEY_WRITE_TIMEOUT).get_number());
+    server.setCompression(json.get_object_value(JSON_KEY_COMPRESSION).get_type() == JSON_TRUE,
+                          json.get_object_value(JSON_KEY_COMPRESSION_MIN_SIZE).get_number());
+    server.setFileCache(json.get_object_value(JSON_KEY_FILE_CACHE_SIZE).get_number(),
+                        json.get_object_value(JSON_KEY_FILE_CACHE_MAX_FILE).get_number());
     LOG_INFO << "Server starting......" << Log::endl;
     server.start();
     LOG_INFO << "Server started." << Log::endl;
@@ -0,0 +1,403 @@
+#include "multipart.h"
+#include <errno.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "scan.h"
+
+static StringView trim(StringView str)
+{
+    while (!str.empty() && (str[0] == ' ' || str[0] == '\t'))
+    {
+        str = str.substr(1);
+    }
+    while (!str.empty() && (str[str.size - 1] == ' ' || str[str.size - 1] == '\t'))
+    {
+        str = str.substr(0, str.size - 1);
+    }
+    return str;
+}
+
+// 在 "type; key1=value1; key2=\"value2\"" 形式的首部值中查找参数 key，参数名不区分大小写
+static bool findParam(StringView value, StringView key, StringView &out)
+{
+    size_t pos = value.find(';');
+    while (pos != StringView::npos)
+    {
+        size_t equal = value.find('=', pos + 1);
+        size_t semicolon = value.find(';', pos + 1);
+        if (equal == StringView::npos)
+        {
+            return false;
+        }
+        if (semicolon < equal)
+        {
+            // 没有值的参数
+            pos = semicolon;
+            continue;
+        }
+        StringView name = trim(value.substr(pos + 1, equal - pos - 1));
+        size_t begin = equal + 1;
+        while (begin < value.size && (value[begin] == ' ' || value[begin] == '\t'))
+        {
+            ++begin;
+        }
+        StringView param;
+        if (begin < value.size && value[begin] == '\"')
+        {
+            // 引号中的值可以含有 ';'
+            size_t quote = value.find('\"', begin + 1);
+            if (quote == StringView::npos)
+            {
+                return false;
+            }
+            param = value.substr(begin + 1, quote - begin - 1);
+            pos = value.find(';', quote + 1);
+        }
+        else
+        {
+            pos = value.find(';', begin);
+            param = trim(value.substr(begin, pos == StringView::npos ? StringView::npos : pos - begin));
+        }
+        if (name.iequals(key))
+        {
+            out = param;
+            return true;
+        }
+    }
+    return false;
+}
+
+MultipartParser::MultipartParser()
+    : m_state(STATE_DATA), m_active(false), m_matched(0), m_fields(NULL), m_fields_size(0),
+      m_sink(SINK_NONE), m_value(NULL), m_fd(-1)
+{
+}
+
+MultipartParser::~MultipartParser()
+{
+    reset();
+}
+
+bool MultipartParser::init(StringView content_type, URLEncoded::Parameters *fields, const std::string &dir)
+{
+    reset();
+    StringView boundary;
+    if (!findParam(content_type, "boundary", boundary) || boundary.empty() || boundary.size > 70 ||
+        boundary.find('\r') != StringView::npos || boundary.find('\n') != StringView::npos)
+    {
+        return false;
+    }
+    m_delimiter.assign("\r\n--").append(boundary.data, boundary.size);
+    // 请求体的第一个分隔符前面没有 "\r\n"，当作已经匹配了这两个字节
+    m_matched = 2;
+    m_state = STATE_DATA;
+    m_sink = SINK_NONE;
+    m_fields = fields;
+    m_fields_size = 0;
+    m_dir = dir;
+    m_active = true;
+    return true;
+}
+
+LINE_STATUS MultipartParser::feed(const char *data, size_t size)
+{
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end && m_state != STATE_BAD && m_state != STATE_EPILOGUE)
+    {
+        switch (m_state)
+        {
+        case STATE_DATA:
+            p = feedData(p, end);
+            break;
+        case STATE_DELIMITER:
+            p = feedDelimiter(p, end);
+            break;
+        case STATE_HEADERS:
+            p = feedHeaders(p, end);
+            break;
+        default:
+            break;
+        }
+    }
+    if (m_state == STATE_BAD)
+    {
+        return LINE_BAD;
+    }
+    return m_state == STATE_EPILOGUE ? LINE_OK : LINE_OPEN;
+}
+
+// 输出分隔符之前的数据，找到完整的分隔符后转到 STATE_DELIMITER。
+// 边界字符串中不能出现 '\r'，分隔符中只有第一个字节是 '\r'，
+// 所以匹配失败时已经匹配的前缀中不可能开始另一个分隔符，可以整体作为数据输出
+const char *MultipartParser::feedData(const char *p, const char *end)
+{
+    while (p < end)
+    {
+        if (m_matched == 0)
+        {
+            const char *cr = Scanner::findByte(p, end, '\r');
+            if (cr == NULL)
+            {
+                emit(p, end - p);
+                return end;
+            }
+            if (!emit(p, cr - p))
+            {
+                return end;
+            }
+            p = cr + 1;
+            m_matched = 1;
+        }
+        while (m_matched < m_delimiter.size() && p < end && *p == m_delimiter[m_matched])
+        {
+            ++m_matched;
+            ++p;
+        }
+        if (m_matched == m_delimiter.size())
+        {
+            m_matched = 0;
+            endPart();
+            m_buf.clear();
+            m_state = STATE_DELIMITER;
+            return p;
+        }
+        if (p == end)
+        {
+            break;
+        }
+        size_t matched = m_matched;
+        m_matched = 0;
+        if (!emit(m_delimiter.data(), matched))
+        {
+            return end;
+        }
+    }
+    return end;
+}
+
+const char *MultipartParser::feedDelimiter(const char *p, const char *end)
+{
+    while (p < end && m_buf.size() < 2)
+    {
+        m_buf += *p++;
+    }
+    if (m_buf.size() < 2)
+    {
+        return p;
+    }
+    if (m_buf == "--")
+    {
+        m_state = STATE_EPILOGUE;
+    }
+    else if (m_buf == "\r\n")
+    {
+        // 保留这个 "\r\n"，没有头部的部分紧接着就是空行，同样能找到 "\r\n\r\n"
+        m_state = STATE_HEADERS;
+    }
+    else
+    {
+        m_state = STATE_BAD;
+    }
+    return p;
+}
+
+const char *MultipartParser::feedHeaders(const char *p, const char *end)
+{
+    size_t old_size = m_buf.size();
+    size_t len = std::min((size_t)(end - p), MAX_HEADER_SIZE + 2 - old_size);
+    m_buf.append(p, len);
+    size_t found = m_buf.find("\r\n\r\n", old_size >= 3 ? old_size - 3 : 0);
+    if (found == std::string::npos)
+    {
+        if (m_buf.size() >= MAX_HEADER_SIZE + 2)
+        {
+            m_state = STATE_BAD;
+        }
+        return p + len;
+    }
+    p += found + 4 - old_size;
+    m_buf.resize(found + 2);
+    m_state = startPart() ? STATE_DATA : STATE_BAD;
+    return p;
+}
+
+// 根据部分的头部（保存在 m_buf 中）决定内容的去向
+bool MultipartParser::startPart()
+{
+    StringView disposition;
+    StringView headers(m_buf);
+    size_t pos = 2;
+    while (pos < headers.size)
+    {
+        const char *enter = Scanner::findCRLF(headers.data + pos, headers.end());
+        if (enter == NULL)
+        {
+            break;
+        }
+        StringView line = headers.substr(pos, enter - headers.data - pos);
+        size_t colon = line.find(':');
+        if (colon != StringView::npos && trim(line.substr(0, colon)).iequals("Content-Disposition"))
+        {
+            disposition = line.substr(colon + 1);
+        }
+        pos = enter - headers.data + 2;
+    }
+    StringView name;
+    StringView filename;
+    if (!findParam(disposition, "name", name))
+    {
+        return false;
+    }
+    if (!findParam(disposition, "filename", filename))
+    {
+        if (m_fields == NULL)
+        {
+            m_sink = SINK_NONE;
+            return true;
+        }
+        m_value = &(*m_fields)[name.str()];
+        m_value->clear();
+        m_sink = SINK_FIELD;
+        return true;
+    }
+    if (filename.empty())
+    {
+        // 没有选择文件
+        m_sink = SINK_NONE;
+        return true;
+    }
+    std::string path = m_dir + "/.upload_XXXXXX";
+    std::vector<char> temp(path.begin(), path.end());
+    temp.push_back('\0');
+    m_fd = mkstemp(temp.data());
+    if (m_fd == -1)
+    {
+        return false;
+    }
+    // mkstemp 创建的文件权限为 0600，改名后仍然保持。上传的文件（头像）要作为静态文件被其他人读取
+    if (fchmod(m_fd, 0644) == -1)
+    {
+        close(m_fd);
+        unlink(temp.data());
+        m_fd = -1;
+        return false;
+    }
+    File file;
+    file.name = name.str();
+    file.filename = filename.str();
+    file.path = temp.data();
+    file.size = 0;
+    m_files.push_back(file);
+    m_sink = SINK_FILE;
+    return true;
+}
+
+bool MultipartParser::emit(const char *data, size_t size)
+{
+    if (size == 0)
+    {
+        return true;
+    }
+    switch (m_sink)
+    {
+    case SINK_FIELD:
+        m_fields_size += size;
+        if (m_fields_size > MAX_FIELDS_SIZE)
+        {
+            m_state = STATE_BAD;
+            return false;
+        }
+        m_value->append(data, size);
+        break;
+    case SINK_FILE:
+        m_files.back().size += size;
+        while (size > 0)
+        {
+            ssize_t len = ::write(m_fd, data, size);
+            if (len < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (len <= 0)
+            {
+                m_state = STATE_BAD;
+                return false;
+            }
+            data += len;
+            size -= len;
+        }
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+void MultipartParser::endPart()
+{
+    closeFile();
+    m_sink = SINK_NONE;
+    m_value = NULL;
+}
+
+void MultipartParser::closeFile()
+{
+    if (m_fd != -1)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool MultipartParser::active() const
+{
+    return m_active;
+}
+
+bool MultipartParser::finished() const
+{
+    return m_state == STATE_EPILOGUE;
+}
+
+bool MultipartParser::failed() const
+{
+    return m_state == STATE_BAD;
+}
+
+MultipartParser::File *MultipartParser::file(const std::string &name)
+{
+    for (size_t i = 0; i < m_files.size(); ++i)
+    {
+        if (m_files[i].name == name && !m_files[i].path.empty())
+        {
+            return &m_files[i];
+        }
+    }
+    return NULL;
+}
+
+void MultipartParser::reset()
+{
+    closeFile();
+    for (size_t i = 0; i < m_files.size(); ++i)
+    {
+        if (!m_files[i].path.empty())
+        {
+            unlink(m_files[i].path.c_str());
+        }
+    }
+    std::vector<File>().swap(m_files);
+    std::string().swap(m_buf);
+    std::string().swap(m_delimiter);
+    std::string().swap(m_dir);
+    m_state = STATE_DATA;
+    m_matched = 0;
+    m_sink = SINK_NONE;
+    m_value = NULL;
+    m_fields = NULL;
+    m_active = false;
+}
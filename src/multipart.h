@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "httpparser.h"
+#include "urlencoded.h"
+
+/* multipart/form-data 请求体的增量解析器。请求体的数据到达一段就喂入一段，不需要等待整个请求体：
+ * 文件部分（带 filename 的部分）边解析边写入 dir 下的临时文件，普通字段保存在内存中。
+ * 解析器自身只缓存当前部分的头部（不超过 MAX_HEADER_SIZE），普通字段合计不超过 MAX_FIELDS_SIZE，
+ * 所以无论上传的文件多大，每个连接占用的内存都有上限。
+ * 分隔符 "\r\n--boundary" 可能跨越两次 feed：已经匹配的前缀长度保存在 m_matched 中，
+ * 这些字节一定等于分隔符的前缀，不需要另外缓存；匹配失败时再作为数据输出。 */
+class MultipartParser
+{
+public:
+    static const size_t MAX_HEADER_SIZE = 8192;   // 每个部分头部的最大长度
+    static const size_t MAX_FIELDS_SIZE = 65536;  // 内存中保存的普通字段的总长度
+
+    struct File
+    {
+        std::string name;     // 表单中的字段名
+        std::string filename; // 客户端给出的文件名
+        std::string path;     // 保存内容的临时文件，被取走之后为空
+        size_t size;
+    };
+
+    MultipartParser();
+    ~MultipartParser();
+
+    // 从 Content-Type 中取出 boundary，普通字段保存到 fields 中，文件保存在 dir 下。格式错误返回 false
+    bool init(StringView content_type, URLEncoded::Parameters *fields, const std::string &dir);
+    // LINE_OK 表示结束分隔符已经出现，LINE_OPEN 表示需要更多数据，LINE_BAD 表示格式错误或写文件失败
+    LINE_STATUS feed(const char *data, size_t size);
+    bool active() const;
+    bool finished() const;
+    bool failed() const;
+    File *file(const std::string &name); // 字段名为 name 的文件，没有返回 NULL
+    void reset(); // 删除没有被取走的临时文件，释放所有内存
+
+private:
+    enum State
+    {
+        STATE_DATA = 0,    // 部分的内容，第一个分隔符之前是被忽略的前言
+        STATE_DELIMITER,   // 分隔符之后的 "\r\n"（下一个部分）或 "--"（结束）
+        STATE_HEADERS,     // 部分的头部
+        STATE_EPILOGUE,    // 结束分隔符之后，忽略剩余的数据
+        STATE_BAD
+    };
+
+    enum Sink
+    {
+        SINK_NONE = 0, // 丢弃：前言，或者没有选择文件的文件部分
+        SINK_FIELD,
+        SINK_FILE
+    };
+
+    const char *feedData(const char *p, const char *end);
+    const char *feedDelimiter(const char *p, const char *end);
+    const char *feedHeaders(const char *p, const char *end);
+    bool startPart();
+    bool emit(const char *data, size_t size);
+    void endPart();
+    void closeFile();
+
+    State m_state;
+    bool m_active;
+    std::string m_delimiter; // "\r\n--boundary"
+    size_t m_matched;        // 已经匹配的分隔符前缀的长度
+    std::string m_buf;       // 当前部分的头部，或者分隔符之后的两个字节
+    std::string m_dir;
+    URLEncoded::Parameters *m_fields;
+    size_t m_fields_size;
+    Sink m_sink;
+    std::string *m_value; // 当前普通字段的值
+    int m_fd;             // 当前文件部分的临时文件
+    std::vector<File> m_files;
+};
@@ -0,0 +1,152 @@
+#include "outputchain.h"
+#include <string.h>
+#include <algorithm>
+
+OutputChain::Segment &OutputChain::push()
+{
+    if (m_used == m_segments.size())
+    {
+        m_segments.emplace_back();
+    }
+    Segment &segment = m_segments[m_used++];
+    segment.buf.clear();
+    segment.ref = NULL;
+    segment.len = 0;
+    return segment;
+}
+
+void OutputChain::append(const char *data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    // 最后一段已经开始发送时也可以追加，发送位置用偏移记录，不受 buf 重新分配的影响
+    if (m_used == 0 || m_segments[m_used - 1].ref != NULL)
+    {
+        push();
+    }
+    m_segments[m_used - 1].buf.append(data, len);
+    m_size += len;
+}
+
+void OutputChain::append(std::string &&str)
+{
+    if (str.empty())
+    {
+        return;
+    }
+    m_size += str.size();
+    push().buf.swap(str);
+}
+
+void OutputChain::appendRef(const char *data, size_t len, std::shared_ptr<const void> owner)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    Segment &segment = push();
+    segment.ref = data;
+    segment.len = len;
+    segment.owner = std::move(owner);
+    m_size += len;
+}
+
+char *OutputChain::prepare(size_t len)
+{
+    Segment &segment = push();
+    segment.buf.resize(len);
+    return &segment.buf[0];
+}
+
+void OutputChain::commit(size_t len)
+{
+    Segment &segment = m_segments[m_used - 1];
+    segment.buf.resize(len);
+    m_size += len;
+    if (len == 0)
+    {
+        --m_used;
+    }
+}
+
+int OutputChain::fill(iovec *iov, int max) const
+{
+    int count = 0;
+    size_t offset = m_offset;
+    for (size_t i = m_head; i < m_used && count < max; ++i)
+    {
+        const Segment &segment = m_segments[i];
+        iov[count].iov_base = const_cast<char *>(segment.data() + offset);
+        iov[count].iov_len = segment.size() - offset;
+        ++count;
+        offset = 0;
+    }
+    return count;
+}
+
+const char *OutputChain::peek(size_t &len)
+{
+    const Segment &head = m_segments[m_head];
+    len = head.size() - m_offset;
+    if (len >= TLS_RECORD_SIZE || m_head + 1 == m_used)
+    {
+        return head.data() + m_offset;
+    }
+    m_record.assign(head.data() + m_offset, len);
+    for (size_t i = m_head + 1; i < m_used && m_record.size() < TLS_RECORD_SIZE; ++i)
+    {
+        const Segment &segment = m_segments[i];
+        m_record.append(segment.data(), std::min(segment.size(), TLS_RECORD_SIZE - m_record.size()));
+    }
+    len = m_record.size();
+    return m_record.data();
+}
+
+void OutputChain::consume(size_t len)
+{
+    m_size -= len;
+    if (m_size == 0)
+    {
+        clear();
+        return;
+    }
+    len += m_offset;
+    while (len >= m_segments[m_head].size())
+    {
+        len -= m_segments[m_head].size();
+        // 缓存的文件可能已经被移出缓存，发送完后立即释放引用
+        m_segments[m_head].owner.reset();
+        ++m_head;
+    }
+    m_offset = len;
+}
+
+void OutputChain::clear()
+{
+    for (size_t i = 0; i < m_used; ++i)
+    {
+        Segment &segment = m_segments[i];
+        segment.owner.reset();
+        if (segment.buf.capacity() > KEEP_SIZE)
+        {
+            std::string().swap(segment.buf);
+        }
+    }
+    if (m_record.capacity() > KEEP_SIZE)
+    {
+        std::string().swap(m_record);
+    }
+    m_used = 0;
+    m_head = 0;
+    m_offset = 0;
+    m_size = 0;
+}
+
+void OutputChain::release()
+{
+    clear();
+    std::vector<Segment>().swap(m_segments);
+    std::string().swap(m_record);
+}
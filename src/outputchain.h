@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* 连接的写缓冲区：按顺序发送的一串数据段。响应头和 CGI 生成的网页保存在自己持有的段中，
+ * 缓存的文件和静态的错误页面只以指针引用，不复制；引用的内存由 owner 保持有效（静态数据的 owner 为空）。
+ * 发送位置用 (m_head, m_offset) 记录，部分发送后只前移位置，不移动剩余的数据；
+ * 明文连接用 writev 一次发送多个段，TLS 连接每次 SSL_write 一个连续块，见 peek()。
+ * 全部发送完毕后 clear() 保留段对象和不超过 KEEP_SIZE 的内存，下一批响应的响应头直接写入，不重新分配；
+ * 发送大响应时扩大的内存被释放，空闲的 keep-alive 连接不持有它。 */
+class OutputChain
+{
+public:
+    static const size_t TLS_RECORD_SIZE = 16384; // TLS 记录的最大明文长度
+    static const int MAX_IOV = 64;               // 每次 writev 最多的段数
+    static const size_t KEEP_SIZE = 4096;        // clear() 时每个段最多保留的内存
+
+    OutputChain() : m_used(0), m_head(0), m_offset(0), m_size(0) {}
+    OutputChain(const OutputChain &) = delete;
+    OutputChain &operator=(const OutputChain &) = delete;
+
+    size_t size() const { return m_size; } // 还没有发送的字节数
+    bool empty() const { return m_size == 0; }
+
+    void append(const char *data, size_t len); // 复制，和前一个自己持有的段合并
+    void append(const std::string &str) { append(str.data(), str.size()); }
+    void append(std::string &&str); // 接管 str 的内存作为新的段
+    // 引用 [data, data + len)，owner 在这一段发送完毕之前保持内存有效
+    void appendRef(const char *data, size_t len, std::shared_ptr<const void> owner = nullptr);
+    char *prepare(size_t len); // 添加一个 len 字节的段并返回它的内存，由调用者直接写入
+    void commit(size_t len);   // prepare() 的段实际写入了 len 个字节
+
+    int fill(iovec *iov, int max) const; // 从发送位置开始填充 iov，返回填充的个数
+    // 返回从发送位置开始的一个连续块：当前段剩余不少于 TLS_RECORD_SIZE 时直接指向它，
+    // 否则把后面的小段一起复制到 m_record 中，凑满一个 TLS 记录。发送位置不变时两次调用返回的内容相同，
+    // SSL_write 返回 SSL_ERROR_WANT_WRITE 后可以原样重试
+    const char *peek(size_t &len);
+    void consume(size_t len); // 前 len 个字节已经发送，释放发送完的段引用的内存
+
+    void clear();   // 丢弃所有数据，保留不超过 KEEP_SIZE 的内存
+    void release(); // 释放全部内存
+
+private:
+    struct Segment
+    {
+        std::string buf;                   // 自己持有的数据
+        const char *ref;                   // 引用的数据，NULL 表示数据在 buf 中
+        size_t len;                        // 引用的数据的长度
+        std::shared_ptr<const void> owner; // 保持引用的数据有效
+
+        const char *data() const { return ref ? ref : buf.data(); }
+        size_t size() const { return ref ? len : buf.size(); }
+    };
+
+    Segment &push(); // 添加一个空的自己持有的段，复用 clear() 保留下来的段对象
+
+    std::vector<Segment> m_segments; // 只有前 m_used 个在使用中
+    size_t m_used;
+    size_t m_head;   // 发送位置所在的段
+    size_t m_offset; // 发送位置在这个段中的偏移
+    size_t m_size;
+    std::string m_record; // peek() 合并小段的缓冲区
+};
@@ -0,0 +1,430 @@
+#include "poller.h"
+#include "log.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+
+// 设置文件描述符 fd 非阻塞
+static void setnonblocking(int fd)
+{
+    int old_flag = fcntl(fd, F_GETFL);
+    int new_flag = old_flag | O_NONBLOCK;
+    fcntl(fd, F_SETFL, new_flag);
+}
+
+Poller *Poller::create(const std::string &backend, int max_events)
+{
+    if (backend == "io_uring")
+    {
+        UringPoller *uring = new UringPoller();
+        if (uring->init(max_events))
+        {
+            return uring;
+        }
+        delete uring;
+        LOG_WARN << "io_uring is not supported by the kernel, fall back to epoll." << Log::endl;
+    }
+    EpollPoller *epoll = new EpollPoller();
+    if (!epoll->init(max_events))
+    {
+        delete epoll;
+        return NULL;
+    }
+    return epoll;
+}
+
+EpollPoller::EpollPoller() : m_epoll_fd(-1)
+{
+}
+
+EpollPoller::~EpollPoller()
+{
+    if (m_epoll_fd != -1)
+    {
+        close(m_epoll_fd);
+    }
+}
+
+bool EpollPoller::init(int max_events)
+{
+    m_epoll_fd = epoll_create(6);
+    m_epoll_events.resize(max_events);
+    m_events.resize(max_events);
+    return m_epoll_fd != -1;
+}
+
+// 添加文件描述符到 epoll 中
+void EpollPoller::add(int fd, uint64_t data, bool one_shot)
+{
+    epoll_event event;
+    event.data.u64 = data;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET; // ET 触发
+    if (one_shot)
+    {
+        event.events |= EPOLLONESHOT; // 防止同一个通信被不同的线程处理
+    }
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    // 设置文件描述符非阻塞
+    setnonblocking(fd);
+}
+
+void EpollPoller::addListener(int fd)
+{
+    add(fd, fd, false);
+}
+
+void EpollPoller::removeListener(int fd)
+{
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+// 修改文件描述符，重置 socket 上的 EPOLLONESHOT 事件，
+// 以确保下一次可读时，EPOLLIN 事件能被触发
+void EpollPoller::mod(int fd, uint64_t data, int ev)
+{
+    epoll_event event;
+    event.data.u64 = data;
+    event.events = ev | EPOLLONESHOT | EPOLLET | EPOLLRDHUP;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+// 从 epoll 中移除监听的文件描述符
+void EpollPoller::remove(int fd, uint64_t)
+{
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int EpollPoller::wait(int timeout)
+{
+    int num = epoll_wait(m_epoll_fd, &*m_epoll_events.begin(), m_epoll_events.size(), timeout);
+    for (int i = 0; i < num; ++i)
+    {
+        m_events[i].data = m_epoll_events[i].data.u64;
+        m_events[i].events = m_epoll_events[i].events;
+        m_events[i].accept_fd = -1;
+    }
+    return num;
+}
+
+const PollEvent &EpollPoller::event(int i) const
+{
+    return m_events[i];
+}
+
+const char *EpollPoller::name() const
+{
+    return "epoll";
+}
+
+// io_uring 请求的 user_data：低 60 位为事件数据，高 4 位为请求类型
+static inline uint64_t makeUserData(uint64_t data, int kind)
+{
+    return (data & Poller::DATA_MASK) | ((uint64_t)kind << 60);
+}
+
+UringPoller::UringPoller()
+    : m_ring_fd(-1),
+      m_sq_ptr(MAP_FAILED),
+      m_sq_size(0),
+      m_cq_ptr(MAP_FAILED),
+      m_cq_size(0),
+      m_sqes((io_uring_sqe *)MAP_FAILED),
+      m_owner_set(false),
+      m_max_events(0)
+{
+}
+
+UringPoller::~UringPoller()
+{
+    if (m_sqes != MAP_FAILED)
+    {
+        munmap(m_sqes, m_sq_entries * sizeof(io_uring_sqe));
+    }
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+    {
+        munmap(m_cq_ptr, m_cq_size);
+    }
+    if (m_sq_ptr != MAP_FAILED)
+    {
+        munmap(m_sq_ptr, m_sq_size);
+    }
+    if (m_ring_fd != -1)
+    {
+        close(m_ring_fd);
+    }
+}
+
+bool UringPoller::init(int max_events)
+{
+    m_max_events = max_events;
+    m_events.resize(max_events);
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 16384;
+    m_ring_fd = syscall(__NR_io_uring_setup, 1024, &params);
+    if (m_ring_fd < 0)
+    {
+        m_ring_fd = -1;
+        return false;
+    }
+    // 需要 IORING_FEAT_EXT_ARG（5.11，带超时的等待）和 IORING_FEAT_RSRC_TAGS（5.13，同时支持 multishot poll）
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_RSRC_TAGS) ||
+        !(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP))
+    {
+        return false;
+    }
+    m_sq_entries = params.sq_entries;
+    m_cq_entries = params.cq_entries;
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_sq_size = m_cq_size = m_sq_size > m_cq_size ? m_sq_size : m_cq_size;
+    m_sq_ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+    {
+        return false;
+    }
+    m_cq_ptr = m_sq_ptr;
+    m_sqes = (io_uring_sqe *)mmap(NULL, m_sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+    {
+        return false;
+    }
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + params.sq_off.array);
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    // 提交队列的下标数组和 sqe 一一对应
+    for (unsigned i = 0; i < m_sq_entries; ++i)
+    {
+        m_sq_array[i] = i;
+    }
+    return true;
+}
+
+int UringPoller::enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, m_ring_fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+io_uring_sqe *UringPoller::getSqe()
+{
+    unsigned tail = *m_sq_tail;
+    while (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries)
+    {
+        // 提交队列已满，先把已有的请求交给内核
+        if (enter(m_sq_entries, 0, 0, NULL, 0) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+        {
+            LOG_ERROR << "io_uring_enter failed, the errno is: " << errno << Log::endl;
+        }
+    }
+    io_uring_sqe *sqe = &m_sqes[tail & *m_sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void UringPoller::submit(bool deferrable)
+{
+    // getSqe() 填好之后才推进队尾，内核只会看到完整的请求
+    __atomic_store_n(m_sq_tail, *m_sq_tail + 1, __ATOMIC_RELEASE);
+    if (deferrable && m_owner_set && pthread_equal(m_owner, pthread_self()))
+    {
+        return;
+    }
+    enter(m_sq_entries, 0, 0, NULL, 0);
+}
+
+void UringPoller::prepPoll(int fd, uint64_t data, uint32_t ev, bool multishot)
+{
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = ev | POLLRDHUP;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = makeUserData(data, multishot ? KIND_POLL_MULTI : KIND_POLL_ONESHOT);
+}
+
+void UringPoller::prepAccept(int fd)
+{
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = makeUserData(fd, KIND_ACCEPT);
+}
+
+void UringPoller::add(int fd, uint64_t data, bool one_shot)
+{
+    setnonblocking(fd);
+    m_sq_locker.lock();
+    prepPoll(fd, data, POLLIN, !one_shot);
+    submit(true);
+    m_sq_locker.unlock();
+}
+
+void UringPoller::addListener(int fd)
+{
+    setnonblocking(fd);
+    m_sq_locker.lock();
+    prepAccept(fd);
+    submit(true);
+    m_sq_locker.unlock();
+}
+
+void UringPoller::removeListener(int fd)
+{
+    // 取消 multishot accept，以及内核不支持时退回使用的 multishot poll。
+    // 取消前已经 accept 的连接仍会作为完成事件返回
+    m_sq_locker.lock();
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(fd, KIND_ACCEPT);
+    sqe->user_data = makeUserData(fd, KIND_REMOVE);
+    submit(false);
+    sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(fd, KIND_POLL_MULTI);
+    sqe->user_data = makeUserData(fd, KIND_REMOVE);
+    submit(false);
+    m_sq_locker.unlock();
+}
+
+void UringPoller::mod(int fd, uint64_t data, int ev)
+{
+    if (fd < 0)
+    {
+        return;
+    }
+    m_sq_locker.lock();
+    prepPoll(fd, data, ev, false);
+    submit(true);
+    m_sq_locker.unlock();
+}
+
+void UringPoller::remove(int, uint64_t data)
+{
+    // 尚未触发的 poll 请求持有文件的引用，关闭 fd 之前必须先取消，并且立即提交，
+    // 保证在 fd 被新连接复用之前取消请求已经到达内核
+    m_sq_locker.lock();
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(data, KIND_POLL_ONESHOT);
+    sqe->user_data = makeUserData(data, KIND_REMOVE);
+    submit(false);
+    m_sq_locker.unlock();
+}
+
+int UringPoller::wait(int timeout)
+{
+    if (!m_owner_set)
+    {
+        m_owner = pthread_self();
+        m_owner_set = true;
+    }
+    unsigned head = *m_cq_head;
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    // 已经有完成事件时不需要等待，只提交推迟的请求
+    unsigned min_complete = head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) ? 1 : 0;
+    __kernel_timespec ts;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout >= 0)
+    {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    int ret = enter(m_sq_entries, min_complete, flags, &arg, sizeof(arg));
+    if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+    {
+        return -1;
+    }
+
+    int num = 0;
+    unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && num < m_max_events)
+    {
+        io_uring_cqe *cqe = &m_cqes[head & *m_cq_mask];
+        ++head;
+        // 需要自动重新提交的 multishot 请求只用于监听 socket 和 eventfd，它们的事件数据就是 fd
+        uint64_t data = cqe->user_data & DATA_MASK;
+        int fd = (int)data;
+        int kind = (int)(cqe->user_data >> 60);
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        int res = cqe->res;
+        if (kind == KIND_ACCEPT)
+        {
+            if (res >= 0)
+            {
+                m_events[num].data = data;
+                m_events[num].events = EPOLLIN;
+                m_events[num].accept_fd = res;
+                ++num;
+            }
+            else if (res == -EINVAL)
+            {
+                // 内核不支持 multishot accept，改为 multishot poll，由上层自己调用 accept
+                LOG_WARN << "multishot accept is not supported, fall back to poll." << Log::endl;
+                m_sq_locker.lock();
+                prepPoll(fd, data, POLLIN, true);
+                submit(true);
+                m_sq_locker.unlock();
+                continue;
+            }
+            if (!more && res != -EBADF && res != -ECANCELED)
+            {
+                m_sq_locker.lock();
+                prepAccept(fd);
+                submit(true);
+                m_sq_locker.unlock();
+            }
+        }
+        else if (kind == KIND_POLL_ONESHOT || kind == KIND_POLL_MULTI)
+        {
+            if (kind == KIND_POLL_MULTI && !more && res > 0)
+            {
+                m_sq_locker.lock();
+                prepPoll(fd, data, POLLIN, true);
+                submit(true);
+                m_sq_locker.unlock();
+            }
+            if (res <= 0)
+            {
+                // 被取消或 fd 已经关闭
+                continue;
+            }
+            m_events[num].data = data;
+            m_events[num].events = res & (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+            m_events[num].accept_fd = -1;
+            ++num;
+        }
+    }
+    __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    return num;
+}
+
+const PollEvent &UringPoller::event(int i) const
+{
+    return m_events[i];
+}
+
+const char *UringPoller::name() const
+{
+    return "io_uring";
+}
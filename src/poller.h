@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <string>
+#include <vector>
+#include <linux/io_uring.h>
+#include "locker.h"
+
+// 事件循环一次返回的事件，events 使用 EPOLLIN/EPOLLOUT/EPOLLRDHUP/EPOLLHUP/EPOLLERR 的取值
+struct PollEvent
+{
+    uint64_t data; // 注册时传入的数据：连接为 ConnHandle，监听 socket 和 eventfd 为 fd 本身
+    uint32_t events;
+    int accept_fd; // 监听 socket 上由 multishot accept 直接得到的新连接，没有则为 -1
+};
+
+/* I/O 事件后端的抽象：Reactor 和 HTTPConnection 只通过它注册、修改和等待事件。
+ * 和原来的 addfd/modfd 一样，连接上的事件是 one-shot 的，处理完后需要 mod() 重新注册。
+ * data 随事件一起返回，最高 4 位必须为 0。 */
+class Poller
+{
+public:
+    static const uint64_t DATA_MASK = (1ULL << 60) - 1;
+
+    virtual ~Poller() {}
+    virtual bool init(int max_events) = 0;
+    virtual void add(int fd, uint64_t data, bool one_shot) = 0; // 注册可读事件，并设置 fd 非阻塞
+    virtual void addListener(int fd) = 0;                       // 注册监听 socket，事件数据为 fd
+    virtual void removeListener(int fd) = 0;                    // 停止在监听 socket 上 accept
+    virtual void mod(int fd, uint64_t data, int ev) = 0;        // 重新注册 one-shot 的 fd
+    virtual void remove(int fd, uint64_t data) = 0;             // 注销 fd，调用者随后负责 close
+    virtual int wait(int timeout) = 0;           // timeout 单位为毫秒，-1 表示一直等待
+    virtual const PollEvent &event(int i) const = 0;
+    virtual const char *name() const = 0;
+
+    // 按配置创建后端，backend 为 "io_uring" 但内核不支持时回退到 epoll
+    static Poller *create(const std::string &backend, int max_events);
+};
+
+class EpollPoller : public Poller
+{
+public:
+    EpollPoller();
+    ~EpollPoller();
+    bool init(int max_events);
+    void add(int fd, uint64_t data, bool one_shot);
+    void addListener(int fd);
+    void removeListener(int fd);
+    void mod(int fd, uint64_t data, int ev);
+    void remove(int fd, uint64_t data);
+    int wait(int timeout);
+    const PollEvent &event(int i) const;
+    const char *name() const;
+
+private:
+    int m_epoll_fd;
+    std::vector<epoll_event> m_epoll_events;
+    std::vector<PollEvent> m_events;
+};
+
+/* io_uring 后端：
+ * 1. 监听 socket 使用 multishot accept，一次提交持续产生新连接，不再需要每个连接一次 accept 调用；
+ *    内核不支持 multishot accept 时退回到 multishot poll + accept。
+ * 2. 连接上的 one-shot 事件用 POLL_ADD 实现，user_data 的低 60 位为事件数据，高 4 位为请求类型。Reactor 线程自己的 mod()/remove() 只写入提交队列，
+ *    在下一次 wait() 时和等待一起由一次 io_uring_enter 批量提交；
+ *    工作线程调用 mod() 时立即提交，避免 Reactor 阻塞在 wait() 中时事件迟迟不能注册。
+ * SSL_read/SSL_write 直接读写 socket，因此读写本身仍由 OpenSSL 完成。 */
+class UringPoller : public Poller
+{
+public:
+    UringPoller();
+    ~UringPoller();
+    bool init(int max_events);
+    void add(int fd, uint64_t data, bool one_shot);
+    void addListener(int fd);
+    void removeListener(int fd);
+    void mod(int fd, uint64_t data, int ev);
+    void remove(int fd, uint64_t data);
+    int wait(int timeout);
+    const PollEvent &event(int i) const;
+    const char *name() const;
+
+private:
+    enum REQUEST_KIND
+    {
+        KIND_POLL_ONESHOT = 1,
+        KIND_POLL_MULTI,
+        KIND_ACCEPT,
+        KIND_REMOVE
+    };
+
+    io_uring_sqe *getSqe();                      // 调用者需持有 m_sq_locker
+    void submit(bool deferrable);                // deferrable 为 true 且在 Reactor 线程中时推迟到 wait() 提交
+    void prepPoll(int fd, uint64_t data, uint32_t ev, bool multishot);
+    void prepAccept(int fd);
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz);
+
+    int m_ring_fd;
+    unsigned m_sq_entries;
+    unsigned m_cq_entries;
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    io_uring_sqe *m_sqes;
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    io_uring_cqe *m_cqes;
+
+    Locker m_sq_locker; // 提交队列可能被 Reactor 线程和工作线程同时写入
+    pthread_t m_owner;  // 调用 wait() 的 Reactor 线程
+    bool m_owner_set;
+    std::vector<PollEvent> m_events;
+    int m_max_events;
+};
@@ -0,0 +1,381 @@
+#include "reactor.h"
+#include "log.h"
+#include "admission.h"
+
+Reactor::Reactor(int id, ConnectionSlab &slab, ThreadPool<ConnTask> *pool,
+                 int max_events, const std::string &backend)
+    : m_id(id),
+      m_backend(backend),
+      m_wakeup_fd(-1),
+      m_cpu(-1),
+      m_offload_handshake(false),
+      m_slab(slab),
+      m_pool(pool),
+      m_max_events(max_events),
+      m_load(0),
+      m_drain_requested(false),
+      m_close_idle_requested(false),
+      m_running(false),
+      m_stop(false)
+{
+}
+
+Reactor::~Reactor()
+{
+    stop();
+    if (m_wakeup_fd != -1)
+    {
+        close(m_wakeup_fd);
+    }
+}
+
+bool Reactor::init()
+{
+    m_poller.reset(Poller::create(m_backend, m_max_events));
+    if (!m_poller)
+    {
+        LOG_ERROR << "reactor " << m_id << " create poller failed." << Log::endl;
+        return false;
+    }
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup_fd == -1)
+    {
+        LOG_ERROR << "reactor " << m_id << " eventfd failed." << Log::endl;
+        return false;
+    }
+    m_poller->add(m_wakeup_fd, m_wakeup_fd, false);
+    LOG_INFO << "reactor " << m_id << " uses " << m_poller->name() << " backend." << Log::endl;
+    return true;
+}
+
+void Reactor::addListener(int listen_fd, std::function<void(int)> on_accept)
+{
+    m_listeners[listen_fd] = on_accept;
+    m_poller->addListener(listen_fd);
+}
+
+void Reactor::setHandshakeOffload(bool offload)
+{
+    m_offload_handshake = offload;
+}
+
+void Reactor::setCpu(int cpu)
+{
+    m_cpu = cpu;
+}
+
+bool Reactor::start()
+{
+    if (pthread_create(&m_thread, NULL, reactor_thread_run, this) != 0)
+    {
+        LOG_ERROR << "reactor " << m_id << " thread create failed." << Log::endl;
+        return false;
+    }
+    m_running = true;
+    return true;
+}
+
+void Reactor::stop()
+{
+    m_stop = true;
+    if (m_wakeup_fd != -1)
+    {
+        // 由主线程运行的 Reactor 也可能被其他线程停止，同样需要唤醒
+        uint64_t one = 1;
+        ::write(m_wakeup_fd, &one, sizeof(one));
+    }
+    if (m_running)
+    {
+        pthread_join(m_thread, NULL);
+        m_running = false;
+    }
+}
+
+void Reactor::drain()
+{
+    m_drain_requested = true;
+    uint64_t one = 1;
+    ::write(m_wakeup_fd, &one, sizeof(one));
+}
+
+void Reactor::closeIdle()
+{
+    m_close_idle_requested = true;
+    uint64_t one = 1;
+    ::write(m_wakeup_fd, &one, sizeof(one));
+}
+
+// 热升级后监听 socket 已经交给新进程：不再 accept，已经 accept 的连接继续处理，
+// 并在下一个响应发送完毕后关闭。一段时间后仍然空闲的 keep-alive 连接由 closeIdle() 关闭
+void Reactor::handleDrain()
+{
+    if (m_drain_requested.exchange(false))
+    {
+        for (auto &listener : m_listeners)
+        {
+            m_poller->removeListener(listener.first);
+        }
+        LOG_INFO << "reactor " << m_id << " draining, " << m_load << " connections left." << Log::endl;
+    }
+    if (m_close_idle_requested.exchange(false))
+    {
+        m_timer_heap.closeIdleConnections();
+    }
+}
+
+void *Reactor::reactor_thread_run(void *arg)
+{
+    auto obj_ptr = (Reactor *)arg;
+    obj_ptr->run();
+    return obj_ptr;
+}
+
+void Reactor::run()
+{
+    if (m_cpu >= 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(m_cpu, &cpu_set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0)
+        {
+            LOG_WARN << "reactor " << m_id << " failed to bind cpu " << m_cpu << Log::endl;
+        }
+    }
+    loop();
+}
+
+void Reactor::loop()
+{
+    LOG_INFO << "reactor " << m_id << " running." << Log::endl;
+    while (!m_stop)
+    {
+        int num = wait();
+        if (num < 0 && errno != EINTR)
+        {
+            LOG_ERROR << "reactor " << m_id << " epoll failure." << Log::endl;
+            break;
+        }
+        uint64_t loop_start = nowMicros();
+        for (int i = 0; i < num; ++i)
+        {
+            const PollEvent &ev = m_poller->event(i);
+            if (ev.data == (uint64_t)m_wakeup_fd)
+            {
+                handlePending();
+                handleDrain();
+                continue;
+            }
+            auto listener = ConnectionSlab::isHandle(ev.data) ? m_listeners.end() : m_listeners.find((int)ev.data);
+            if (listener != m_listeners.end())
+            {
+                listener->second(ev.accept_fd);
+            }
+            else
+            {
+                handleEvent(ev);
+            }
+        }
+        handleExpireEvent();
+        Admission::getInstance()->loopFinished(num > 0 ? nowMicros() - loop_start : 0);
+    }
+    LOG_INFO << "reactor " << m_id << " stops running." << Log::endl;
+}
+
+void Reactor::dispatch(int conn_fd, const sockaddr_in &addr, SSL *ssl)
+{
+    PendingConn conn;
+    conn.fd = conn_fd;
+    conn.addr = addr;
+    conn.ssl = ssl;
+    // 在投递时就计入负载，保证主 Reactor 按最少连接分配时看到的是最新值
+    ++m_load;
+    m_pending_locker.lock();
+    m_pending.push_back(conn);
+    m_pending_locker.unlock();
+    uint64_t one = 1;
+    ::write(m_wakeup_fd, &one, sizeof(one));
+}
+
+void Reactor::handlePending()
+{
+    uint64_t cnt;
+    while (::read(m_wakeup_fd, &cnt, sizeof(cnt)) > 0)
+    {
+    }
+    std::vector<PendingConn> pending;
+    m_pending_locker.lock();
+    pending.swap(m_pending);
+    m_pending_locker.unlock();
+    for (auto &conn : pending)
+    {
+        registerConnection(conn.fd, conn.addr, conn.ssl);
+    }
+}
+
+void Reactor::addConnection(int conn_fd, const sockaddr_in &addr, SSL *ssl)
+{
+    ++m_load;
+    registerConnection(conn_fd, addr, ssl);
+}
+
+void Reactor::registerConnection(int conn_fd, const sockaddr_in &addr, SSL *ssl)
+{
+    ConnHandle handle;
+    HTTPConnection *conn = m_slab.acquire(handle);
+    if (conn == NULL)
+    {
+        LOG_WARN << "reactor " << m_id << " connection table is full." << Log::endl;
+        if (ssl)
+        {
+            SSL_free(ssl);
+        }
+        close(conn_fd);
+        --m_load;
+        return;
+    }
+    conn->init(conn_fd, addr, ssl, m_poller.get(), &m_load, &m_slab, handle);
+    m_timer_heap.addTimer(conn);
+    LOG_INFO << "reactor " << m_id << " new client: " << conn_fd << Log::endl;
+}
+
+int Reactor::wait()
+{
+    // 最多等到最早的截止时间；空闲时也定期结束一轮循环，让准入控制中事件循环耗时的平均值衰减
+    int timeout = m_timer_heap.nextTimeout();
+    return m_poller->wait(timeout < 0 || timeout > MAX_WAIT ? MAX_WAIT : timeout);
+}
+
+const PollEvent &Reactor::event(int i) const
+{
+    return m_poller->event(i);
+}
+
+void Reactor::handleEvent(const PollEvent &ev)
+{
+    HTTPConnection *conn_ptr = m_slab.get(ev.data);
+    if (conn_ptr == NULL)
+    {
+        // 连接已经关闭，这是残留在事件后端中的旧事件
+        Stats::getInstance()->stale_events++;
+        return;
+    }
+    HTTPConnection &conn = *conn_ptr;
+    if (ev.events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))
+    {
+        // 客户端异常断开或者发生了错误事件
+        if (ev.events & EPOLLHUP)
+        {
+            LOG_DEBUG << "EPOLLHUP" << Log::endl;
+        }
+        if (ev.events & EPOLLRDHUP)
+        {
+            LOG_DEBUG << "EPOLLRDHUP" << Log::endl;
+        }
+        if (ev.events & EPOLLERR)
+        {
+            LOG_DEBUG << "EPOLLERR" << Log::endl;
+        }
+        conn.close_conn();
+    }
+    else if (conn.isHandshaking())
+    {
+        if (m_offload_handshake && m_pool && Admission::getInstance()->admitNew() && enqueue(conn))
+        {
+            return;
+        }
+        // 过载或线程池队列已满时握手在本线程中进行，新连接的握手不和已有连接的请求争抢队列，
+        // 握手完成后第一个请求会被回复 503
+        int ret = conn.handshake();
+        if (ret < 0)
+        {
+            conn.close_conn();
+        }
+        else if (ret > 0)
+        {
+            // 请求数据和握手的最后一条消息一起到达，已经被 OpenSSL 读入缓冲区，不会再触发可读事件
+            handleRead(conn);
+        }
+        else
+        {
+            // 握手完成后进入读取头部的阶段
+            m_timer_heap.updateTimer(conn);
+        }
+    }
+    else if (ev.events & EPOLLIN)
+    {
+        handleRead(conn);
+    }
+    else if (ev.events & EPOLLOUT)
+    {
+        if (!conn.write())
+        {
+            conn.close_conn();
+            return;
+        }
+        m_timer_heap.updateTimer(conn);
+        if (conn.hasPendingRequest())
+        {
+            // 流水线中剩下的请求已经在读缓冲区中
+            handleRequest(conn);
+        }
+    }
+}
+
+void Reactor::handleRead(HTTPConnection &conn)
+{
+    if (conn.read())
+    {
+        m_timer_heap.updateTimer(conn);
+        handleRequest(conn);
+    }
+    else
+    {
+        conn.close_conn();
+    }
+}
+
+void Reactor::handleRequest(HTTPConnection &conn)
+{
+    if (conn.isNew() && !Admission::getInstance()->admitNew())
+    {
+        // 过载时优先拒绝新连接上的请求，已经在处理中的 keep-alive 连接不受影响
+        Stats::getInstance()->rejected_new++;
+        conn.reject();
+    }
+    else if (!m_pool)
+    {
+        conn.process();
+    }
+    else if (!enqueue(conn))
+    {
+        Stats::getInstance()->rejected_queue_full++;
+        conn.reject();
+    }
+}
+
+bool Reactor::enqueue(HTTPConnection &conn)
+{
+    ConnTask task = {&m_slab, conn.getHandle(), nowMicros()};
+    if (!m_pool->append(task))
+    {
+        return false;
+    }
+    Admission::getInstance()->enqueued();
+    return true;
+}
+
+void Reactor::handleExpireEvent()
+{
+    m_timer_heap.handleExpireEvent();
+}
+
+Poller *Reactor::getPoller() const
+{
+    return m_poller.get();
+}
+
+int Reactor::getLoad() const
+{
+    return m_load;
+}
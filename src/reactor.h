@@ -0,0 +1,91 @@
+#pragma once
+
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <openssl/ssl.h>
+#include "httpconnection.h"
+#include "threadpool.h"
+#include "timer.h"
+#include "locker.h"
+#include "poller.h"
+#include "connslab.h"
+
+/* Reactor 负责一组客户端连接上的 I/O 事件：
+ * 每个 Reactor 拥有独立的 epoll 对象和时间堆，连接对象从所有 Reactor 共享的 ConnectionSlab 中分配，
+ * 事件数据是连接句柄，连接关闭后残留的事件会被丢弃。
+ * 单 Reactor 模式下由主线程直接驱动；多 Reactor 模式下每个从 Reactor 运行在自己的线程中，
+ * 主 Reactor 只负责 accept，然后通过 dispatch() 把新连接交给从 Reactor。
+ * SO_REUSEPORT 模式下每个 Reactor 监听自己的 socket，pool 为 NULL，请求在本线程内直接处理。 */
+class Reactor
+{
+public:
+    static const int MAX_WAIT = 100; // 一次等待 I/O 事件的最长时间（毫秒）
+
+    Reactor(int id, ConnectionSlab &slab, ThreadPool<ConnTask> *pool,
+            int max_events, const std::string &backend);
+    ~Reactor();
+    bool init();                                                         // 创建事件后端和用于唤醒的 eventfd
+    void addListener(int listen_fd, std::function<void(int)> on_accept); // 由本 Reactor 监听 listen_fd
+    void setCpu(int cpu);                                                // 将运行 Reactor 的线程绑定到指定 CPU
+    void setHandshakeOffload(bool offload);                              // TLS 握手交给线程池处理
+    bool start();                                                        // 以独立线程运行 run()
+    void run();                                                          // 在当前线程中运行事件循环
+    void stop();                                                         // 停止事件循环
+    void drain();                                                        // 由其他线程调用：停止 accept
+    void closeIdle();                                                    // 由其他线程调用：关闭空闲的 keep-alive 连接
+    void dispatch(int conn_fd, const sockaddr_in &addr, SSL *ssl);       // 由其他线程调用，投递新连接
+    void addConnection(int conn_fd, const sockaddr_in &addr, SSL *ssl); // 在本 Reactor 所在线程中注册新连接
+    int wait();                                                          // 等待 I/O 事件
+    const PollEvent &event(int i) const;
+    void handleEvent(const PollEvent &ev); // 处理连接上的读、写和异常事件
+    void handleExpireEvent();              // 处理超时的连接
+    Poller *getPoller() const;
+    int getLoad() const; // 当前负责的连接数
+
+private:
+    static void *reactor_thread_run(void *);
+    void loop();
+    void handlePending(); // 把主 Reactor 投递过来的连接注册到本 Reactor
+    void handleDrain();
+    void registerConnection(int conn_fd, const sockaddr_in &addr, SSL *ssl);
+    void handleRead(HTTPConnection &conn);
+    void handleRequest(HTTPConnection &conn); // 处理已经读入缓冲区的请求
+    bool enqueue(HTTPConnection &conn); // 交给线程池处理，队列已满时返回 false
+
+    struct PendingConn
+    {
+        int fd;
+        sockaddr_in addr;
+        SSL *ssl;
+    };
+
+    int m_id;
+    std::string m_backend;
+    std::unique_ptr<Poller> m_poller;
+    int m_wakeup_fd; // 主 Reactor 投递新连接后通过它唤醒 epoll_wait
+    // 本 Reactor 自己监听的 socket 及其回调，回调的参数为后端直接 accept 得到的连接，-1 表示需要自己 accept
+    std::unordered_map<int, std::function<void(int)>> m_listeners;
+    int m_cpu;       // 绑定的 CPU，-1 表示不绑定
+    bool m_offload_handshake;
+    ConnectionSlab &m_slab;
+    ThreadPool<ConnTask> *m_pool; // 为 NULL 时在本线程内处理请求
+    TimerHeap m_timer_heap; // 连接各个阶段的截止时间
+    int m_max_events;
+    std::atomic<int> m_load;
+
+    std::vector<PendingConn> m_pending;
+    Locker m_pending_locker;
+
+    std::atomic<bool> m_drain_requested;
+    std::atomic<bool> m_close_idle_requested;
+
+    pthread_t m_thread;
+    bool m_running;
+    volatile bool m_stop;
+};
@@ -0,0 +1,106 @@
+#include "readbuffer.h"
+#include <stdlib.h>
+#include <string.h>
+
+size_t ReadBuffer::m_max_size = 65536;
+
+ReadBuffer::~ReadBuffer()
+{
+    free(m_data);
+}
+
+char *ReadBuffer::prepare(size_t want, size_t &len)
+{
+    if (m_capacity - m_end < want && m_begin > 0)
+    {
+        // 先整理：剩余数据移到内存开头
+        memmove(m_data, m_data + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if (m_capacity - m_end < want && m_capacity < m_max_size)
+    {
+        size_t capacity = m_capacity > 0 ? m_capacity : INITIAL_SIZE;
+        while (capacity - m_end < want && capacity < m_max_size)
+        {
+            capacity *= 2;
+        }
+        capacity = capacity < m_max_size ? capacity : m_max_size;
+        // 分配失败时保留原来的内存，只返回现有的空闲空间
+        char *data = (char *)realloc(m_data, capacity);
+        if (data != NULL)
+        {
+            m_data = data;
+            m_capacity = capacity;
+        }
+    }
+    size_t room = m_capacity - m_end;
+    size_t allowed = m_max_size - size();
+    len = room < allowed ? room : allowed;
+    return m_data + m_end;
+}
+
+void ReadBuffer::commit(size_t len)
+{
+    m_end += len;
+}
+
+void ReadBuffer::append(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t room;
+        char *p = prepare(len, room);
+        if (room == 0)
+        {
+            return;
+        }
+        room = room < len ? room : len;
+        memcpy(p, data, room);
+        commit(room);
+        data += room;
+        len -= room;
+    }
+}
+
+void ReadBuffer::consume(size_t len)
+{
+    m_begin += len < size() ? len : size();
+    if (m_begin == m_end)
+    {
+        m_begin = m_end = 0;
+    }
+}
+
+void ReadBuffer::erase(size_t pos, size_t len)
+{
+    char *p = data() + pos;
+    memmove(p, p + len, size() - pos - len);
+    m_end -= len;
+}
+
+void ReadBuffer::truncate(size_t size)
+{
+    m_end = m_begin + size;
+}
+
+void ReadBuffer::clear()
+{
+    m_begin = m_end = 0;
+}
+
+void ReadBuffer::shrink()
+{
+    if (empty() && m_capacity > INITIAL_SIZE)
+    {
+        release();
+    }
+}
+
+void ReadBuffer::release()
+{
+    free(m_data);
+    m_data = NULL;
+    m_capacity = 0;
+    m_begin = m_end = 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+
+/* 连接的读缓冲区。数据保存在一块连续的内存中，[m_begin, m_end) 是还没有处理完的数据：
+ * recv/SSL_read_ex 通过 prepare()/commit() 直接写入尾部的空闲空间，不经过中间缓冲区；
+ * 开头处理完的数据用 consume() 丢弃时只移动 m_begin，尾部空间不够时才把剩余数据移到内存开头，
+ * 仍然不够时按倍数扩大，但不超过 m_max_size。请求行和首部要以连续内存的视图交给 HTTPParser，
+ * 所以这里不使用首尾相接的环形存储。缓冲区为空时 shrink() 释放超过初始大小的内存，
+ * 空闲的 keep-alive 连接最多只保留 INITIAL_SIZE 字节。 */
+class ReadBuffer
+{
+public:
+    static const size_t INITIAL_SIZE = 4096; // 第一次写入时分配的大小
+    static size_t m_max_size;                // 缓冲区的最大长度
+
+    ReadBuffer() : m_data(NULL), m_capacity(0), m_begin(0), m_end(0) {}
+    ~ReadBuffer();
+    ReadBuffer(const ReadBuffer &) = delete;
+    ReadBuffer &operator=(const ReadBuffer &) = delete;
+
+    const char *data() const { return m_data + m_begin; }
+    char *data() { return m_data + m_begin; }
+    size_t size() const { return m_end - m_begin; }
+    bool empty() const { return m_end == m_begin; }
+    bool full() const { return size() >= m_max_size; } // 已经达到最大长度，不能再写入
+    char &operator[](size_t i) { return m_data[m_begin + i]; }
+
+    // 返回尾部至少 want 字节（达到最大长度时可能更少，已满时为 0）的可写空间，长度保存在 len 中
+    char *prepare(size_t want, size_t &len);
+    void commit(size_t len); // 尾部新写入了 len 个字节
+    void append(const char *data, size_t len); // 超过最大长度的部分被丢弃
+    void consume(size_t len); // 丢弃开头的 len 个字节
+    void erase(size_t pos, size_t len);
+    void truncate(size_t size);
+    void clear();
+    void shrink();  // 缓冲区为空时释放超过 INITIAL_SIZE 的内存
+    void release(); // 释放全部内存
+
+private:
+    char *m_data;
+    size_t m_capacity;
+    size_t m_begin;
+    size_t m_end;
+};
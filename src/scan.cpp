@@ -0,0 +1,234 @@
+#include "scan.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static const char *findCRLFScalar(const char *begin, const char *end)
+{
+    const char *p = begin;
+    while (p < end)
+    {
+        p = (const char *)memchr(p, '\r', end - p);
+        if (p == NULL || p + 1 >= end)
+        {
+            return NULL;
+        }
+        if (p[1] == '\n')
+        {
+            return p;
+        }
+        ++p;
+    }
+    return NULL;
+}
+
+static const char *findByteScalar(const char *begin, const char *end, char c)
+{
+    if (begin >= end)
+    {
+        return NULL;
+    }
+    return (const char *)memchr(begin, c, end - begin);
+}
+
+#ifdef SCAN_X86
+
+// 掩码 mask 中的每一位对应 p 开始的一个 '\r'，其后紧跟 '\n' 的第一个即为 CRLF。
+// '\r' 在请求中几乎只出现在行尾，所以向量循环只比较 '\r'，'\n' 逐个检查
+static inline const char *matchCRLF(const char *p, const char *end, uint64_t mask, bool &stop)
+{
+    while (mask)
+    {
+        const char *cr = p + __builtin_ctzll(mask);
+        if (cr + 1 >= end)
+        {
+            stop = true;
+            return NULL;
+        }
+        if (cr[1] == '\n')
+        {
+            stop = true;
+            return cr;
+        }
+        mask &= mask - 1;
+    }
+    stop = false;
+    return NULL;
+}
+
+// SSE2 每次比较 16 字节，四路展开，每轮 64 字节
+static const char *findCRLFSSE2(const char *begin, const char *end)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const char *p = begin;
+    bool stop;
+    while (end - p >= 64)
+    {
+        __m128i m0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), cr);
+        __m128i m1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), cr);
+        __m128i m2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 32)), cr);
+        __m128i m3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 48)), cr);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(m2, m3))))
+        {
+            uint64_t mask = (uint64_t)(unsigned)_mm_movemask_epi8(m0) |
+                            (uint64_t)(unsigned)_mm_movemask_epi8(m1) << 16 |
+                            (uint64_t)(unsigned)_mm_movemask_epi8(m2) << 32 |
+                            (uint64_t)(unsigned)_mm_movemask_epi8(m3) << 48;
+            const char *ret = matchCRLF(p, end, mask, stop);
+            if (stop)
+            {
+                return ret;
+            }
+        }
+        p += 64;
+    }
+    while (end - p >= 16)
+    {
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), cr));
+        const char *ret = matchCRLF(p, end, mask, stop);
+        if (stop)
+        {
+            return ret;
+        }
+        p += 16;
+    }
+    return findCRLFScalar(p, end);
+}
+
+static const char *findByteSSE2(const char *begin, const char *end, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    const char *p = begin;
+    while (end - p >= 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), needle));
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return findByteScalar(p, end, c);
+}
+
+// AVX2 每次比较 32 字节，四路展开，每轮 128 字节；剩余不足 128 字节的部分交给 SSE2 内核
+__attribute__((target("avx2"))) static const char *findCRLFAVX2(const char *begin, const char *end)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const char *p = begin;
+    bool stop;
+    while (end - p >= 128)
+    {
+        __m256i m0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), cr);
+        __m256i m1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 32)), cr);
+        __m256i m2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 64)), cr);
+        __m256i m3 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 96)), cr);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m2, m3));
+        if (!_mm256_testz_si256(any, any))
+        {
+            uint64_t low = (uint64_t)(unsigned)_mm256_movemask_epi8(m0) |
+                           (uint64_t)(unsigned)_mm256_movemask_epi8(m1) << 32;
+            uint64_t high = (uint64_t)(unsigned)_mm256_movemask_epi8(m2) |
+                            (uint64_t)(unsigned)_mm256_movemask_epi8(m3) << 32;
+            const char *ret = matchCRLF(p, end, low, stop);
+            if (stop)
+            {
+                return ret;
+            }
+            ret = matchCRLF(p + 64, end, high, stop);
+            if (stop)
+            {
+                return ret;
+            }
+        }
+        p += 128;
+    }
+    return findCRLFSSE2(p, end);
+}
+
+__attribute__((target("avx2"))) static const char *findByteAVX2(const char *begin, const char *end, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    const char *p = begin;
+    while (end - p >= 32)
+    {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), needle));
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findByteSSE2(p, end, c);
+}
+
+#endif
+
+Scanner::Level Scanner::m_level = Scanner::SCALAR;
+Scanner::FindCRLF Scanner::m_find_crlf = findCRLFScalar;
+Scanner::FindByte Scanner::m_find_byte = findByteScalar;
+
+// 在 main 之前选择实现，此后只读
+static bool g_scanner_selected = Scanner::setLevel(Scanner::detect());
+
+Scanner::Level Scanner::detect()
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return AVX2;
+    }
+    return SSE2; // x86-64 的基本指令集
+#endif
+    return SCALAR;
+}
+
+bool Scanner::setLevel(Level level)
+{
+    if (level > detect())
+    {
+        return false;
+    }
+    switch (level)
+    {
+#ifdef SCAN_X86
+    case AVX2:
+        m_find_crlf = findCRLFAVX2;
+        m_find_byte = findByteAVX2;
+        break;
+    case SSE2:
+        m_find_crlf = findCRLFSSE2;
+        m_find_byte = findByteSSE2;
+        break;
+#endif
+    default:
+        m_find_crlf = findCRLFScalar;
+        m_find_byte = findByteScalar;
+        break;
+    }
+    m_level = level;
+    return true;
+}
+
+Scanner::Level Scanner::level()
+{
+    return m_level;
+}
+
+const char *Scanner::levelName(Level level)
+{
+    switch (level)
+    {
+    case AVX2:
+        return "avx2";
+    case SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+
+/* 请求解析中查找分隔符（CRLF、':'、' '）的内核。
+ * 启动时通过 CPUID 选择实现：AVX2 每次比较 32 字节，SSE2 每次比较 16 字节，非 x86 平台使用基于 memchr 的标量实现。
+ * AVX2 内核通过函数级的 target 属性编译，不需要给整个程序加 -mavx2。
+ * SSE4.2 的 PCMPESTRI 可以直接查找子串 "\r\n"，但每 16 字节需要数个周期，实测比标量实现还慢，因此不使用。 */
+class Scanner
+{
+public:
+    enum Level
+    {
+        SCALAR = 0,
+        SSE2,
+        AVX2
+    };
+
+    // 在 [begin, end) 中查找 "\r\n"，返回 '\r' 的位置，找不到返回 NULL
+    static const char *findCRLF(const char *begin, const char *end) { return m_find_crlf(begin, end); }
+    // 在 [begin, end) 中查找字节 c，找不到返回 NULL
+    static const char *findByte(const char *begin, const char *end, char c) { return m_find_byte(begin, end, c); }
+
+    static Level detect();          // 当前 CPU 支持的最高级别
+    static bool setLevel(Level);    // 切换实现，CPU 不支持时返回 false（基准测试用）
+    static Level level();
+    static const char *levelName(Level);
+
+private:
+    typedef const char *(*FindCRLF)(const char *, const char *);
+    typedef const char *(*FindByte)(const char *, const char *, char);
+
+    static Level m_level;
+    static FindCRLF m_find_crlf;
+    static FindByte m_find_byte;
+};
@@ -1,10 +1,11 @@
 
 #include "server.h"
 #include "log.h"
-
-extern void addfd(int epollfd, int fd, bool one_shot);
-extern void modfd(int epollfd, int fd, int ev);
-extern void removefd(int epollfd, int fd);
+#include "ticketkey.h"
+#include "upgrade.h"
+#include "admission.h"
+#include "filecache.h"
+#include "compress.h"
 
 // 添加信号捕捉
 void addsig(int sig, void(handler)(int))
@@ -16,14 +17,46 @@ void addsig(int sig, void(handler)(int))
     assert(sigaction(sig, &sa, NULL) != -1);
 }
 
+// SIGUSR2 的写端，信号处理函数中只做异步信号安全的 write，由升级线程完成实际工作
+static int upgrade_signal_fd = -1;
+
+static void upgradeSignalHandler(int)
+{
+    int saved_errno = errno;
+    char c = 'U';
+    ::write(upgrade_signal_fd, &c, 1);
+    errno = saved_errno;
+}
+
 Server::Server(int _port, int max_fd_, int max_events_, int thread_number_, int max_request_, int timeout_)
     : port(_port),
-      pool(new ThreadPool<HTTPConnection>(thread_number_, max_request_)),
+      http_port(0),
+      thread_number(thread_number_),
+      max_request(max_request_),
       clients(max_fd_),
-      events(max_events_),
+      listen_fd(-1),
+      http_listen_fd(-1),
       stop(true),
-      conn_timeout(timeout_)
+      conn_timeout(timeout_),
+      max_events(max_events_),
+      reactor_number(0),
+      dispatch_policy(DISPATCH_ROUND_ROBIN),
+      next_reactor(0),
+      reuseport_workers(0),
+      pin_cpu(false),
+      io_backend("epoll"),
+      handshake_offload(false),
+      tls13(true),
+      session_cache_size(20480),
+      session_timeout(300),
+      ticket_rotation(3600),
+      ktls(false),
+      drain_timeout(60),
+      upgrade_channel(-1),
+      wakeup_fd(-1),
+      upgrade_thread_running(false)
 {
+    signal_pipe[0] = signal_pipe[1] = -1;
 }
 
 void Server::init(const std::string cert_path, const std::string cert_passwd, const std::string prikey_path)
@@ -37,10 +70,15 @@ void Server::init(const std::string cert_path, const std::string cert_passwd, co
         LOG_ERROR << "create ctx wrong." << Log::endl;
         return;
     }
-    SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
+    // SSL_write 返回 WANT_WRITE 后重试时，合并小段的缓冲区可能被重新填充，地址会变化（见 OutputChain::peek）。
+    // 空闲连接上 OpenSSL 的读写缓冲区在用完后释放（RELEASE_BUFFERS）
+    SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+    // 预读：一次 recv 读入 socket 中尽可能多的数据（而不是先读 5 字节的记录头再读记录体），
+    // 之后的记录直接从 OpenSSL 的缓冲区中解密
+    SSL_CTX_set_read_ahead(ctx, 1);
     SSL_CTX_set_options(ctx,
                         SSL_OP_ALL | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 |
-                            SSL_OP_NO_COMPRESSION | SSL_OP_NO_TLSv1_3 |
+                            SSL_OP_NO_COMPRESSION |
                             SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION);
     // 加载证书
     if (SSL_CTX_use_certificate_chain_file(ctx, cert_path.c_str()) != 1)
@@ -59,139 +97,665 @@ void Server::init(const std::string cert_path, const std::string cert_passwd, co
     stop = false;
 }
 
-void Server::start()
+void Server::setTLSSession(bool tls13_, int cache_size, int timeout, int ticket_rotation_)
 {
-    addsig(SIGPIPE, SIG_IGN);
-    // 创建监听套接字
-    listen_fd = socket(PF_INET, SOCK_STREAM, 0);
-    if (listen_fd == -1)
+    tls13 = tls13_;
+    session_cache_size = cache_size;
+    session_timeout = timeout;
+    ticket_rotation = ticket_rotation_;
+}
+
+// 配置 TLS 版本和会话恢复：
+// 会话缓存保存在 SSL_CTX 中，由所有线程共享；ticket_rotation 大于 0 时启用会话票据并定期轮换密钥，
+// 否则关闭票据，只使用服务端会话缓存（TLS 1.3 下为有状态票据）
+void Server::configureTLSSession()
+{
+    if (!tls13)
+    {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TLSv1_3);
+    }
+    if (session_cache_size > 0)
+    {
+        const unsigned char sid_ctx[] = "MyHTTPServer";
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, session_cache_size);
+        SSL_CTX_set_timeout(ctx, session_timeout);
+        SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    }
+    else
+    {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+    if (ticket_rotation > 0)
+    {
+        TicketKeyRing::getInstance()->init(ticket_rotation);
+        if (!TicketKeyRing::getInstance()->install(ctx))
+        {
+            LOG_WARN << "install session ticket key callback failed, tickets use the default key." << Log::endl;
+        }
+    }
+    else
+    {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+}
+
+void Server::setKTLS(bool enable)
+{
+    ktls = enable;
+}
+
+void Server::setHTTPPort(int port_)
+{
+    http_port = port_ > 0 ? port_ : 0;
+}
+
+void Server::setUpgrade(char *argv[], int drain_timeout_)
+{
+    // 按启动时的路径 exec，部署时替换了这个文件就会启动新版本
+    char path[PATH_MAX];
+    exe_path = realpath(argv[0], path) ? path : argv[0];
+    exe_args.clear();
+    for (int i = 0; argv[i]; ++i)
+    {
+        exe_args.push_back(argv[i]);
+    }
+    drain_timeout = drain_timeout_;
+}
+
+void Server::setAdmission(int max_queue_depth, int max_queue_wait, int retry_after)
+{
+    Admission::getInstance()->init(max_queue_depth, max_queue_wait, retry_after);
+}
+
+void Server::setMaxBodySize(int megabytes)
+{
+    HTTPConnection::m_max_body_size = megabytes > 0 ? (size_t)megabytes << 20 : 0;
+}
+
+void Server::setMaxReadBuffer(int kilobytes)
+{
+    if (kilobytes > 0)
+    {
+        ReadBuffer::m_max_size = (size_t)kilobytes << 10;
+    }
+}
+
+// 空闲 keep-alive 连接的超时时间是构造时传入的 http timeout
+void Server::setTimeouts(int handshake, int header, int body, int write_)
+{
+    int seconds[PHASE_COUNT] = {handshake, header, body, write_, (int)conn_timeout};
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        if (seconds[i] > 0)
+        {
+            HTTPConnection::m_timeouts[i] = seconds[i] * 1000;
+        }
+    }
+}
+
+void Server::setCompression(bool enable, int min_size)
+{
+    Compressor::m_enabled = enable;
+    if (min_size > 0)
+    {
+        Compressor::m_min_size = min_size;
+    }
+}
+
+void Server::setFileCache(int megabytes, int max_file_kilobytes)
+{
+    if (megabytes > 0 && max_file_kilobytes > 0)
+    {
+        FileCache::getInstance()->init(doc_root, (size_t)megabytes << 20, (size_t)max_file_kilobytes << 10);
+    }
+}
+
+void Server::setReactors(int number, const std::string &policy)
+{
+    reactor_number = number > 0 ? number : 0;
+    dispatch_policy = policy == "least loaded" ? DISPATCH_LEAST_LOADED : DISPATCH_ROUND_ROBIN;
+}
+
+void Server::setIOBackend(const std::string &backend)
+{
+    io_backend = backend;
+}
+
+void Server::setHandshakeOffload(bool offload)
+{
+    handshake_offload = offload;
+}
+
+void Server::setReuseportWorkers(int number, bool pin_cpu_)
+{
+    reuseport_workers = number > 0 ? number : 0;
+    pin_cpu = pin_cpu_;
+}
+
+// 创建、绑定并监听一个 socket，reuseport 为 true 时开启 SO_REUSEPORT 以便多个 socket 绑定同一端口
+int Server::createListenSocket(int port_, bool reuseport)
+{
+    // 由热升级启动时优先使用旧进程交过来的 socket，它的监听队列中可能已经有等待 accept 的连接
+    for (auto iter = inherited_fds.begin(); iter != inherited_fds.end(); ++iter)
+    {
+        int inherited = *iter;
+        if (HotUpgrade::socketPort(inherited) == port_)
+        {
+            inherited_fds.erase(iter);
+            listen_fds.push_back(inherited);
+            LOG_INFO << "inherited listen socket " << inherited << " on port " << port_ << Log::endl;
+            return inherited;
+        }
+    }
+    int fd = socket(PF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
     {
         LOG_ERROR << "socket" << Log::endl;
-        stop = true;
-        return;
+        return -1;
     }
     // 设置端口复用
     int reuse = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1)
+    {
+        LOG_ERROR << "SO_REUSEPORT" << Log::endl;
+        close(fd);
+        return -1;
+    }
     // 端口绑定
     struct sockaddr_in address;
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
-    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+    address.sin_port = htons(port_);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1)
     {
         LOG_ERROR << "bind" << Log::endl;
+        close(fd);
+        return -1;
+    }
+    // 监听。积压队列太短时突发的新连接在内核中被丢弃，客户端要等 SYN 重传（1 秒起），
+    // 准入控制也看不到它们；放宽到 SOMAXCONN，由 accept 之后的准入控制决定是否回复 503
+    if (listen(fd, SOMAXCONN) == -1)
+    {
+        LOG_ERROR << "listen" << Log::endl;
+        close(fd);
+        return -1;
+    }
+    listen_fds.push_back(fd);
+    return fd;
+}
+
+// 创建并初始化一个 Reactor，pool 为 NULL 表示请求在 Reactor 线程内直接处理
+Reactor *Server::createReactor(int id, ThreadPool<ConnTask> *pool_)
+{
+    Reactor *reactor = new Reactor(id, clients, pool_, max_events, io_backend);
+    reactors.emplace_back(reactor);
+    if (!reactor->init())
+    {
+        return NULL;
+    }
+    reactor->setHandshakeOffload(handshake_offload);
+    return reactor;
+}
+
+void Server::start()
+{
+    addsig(SIGPIPE, SIG_IGN);
+    if (stop)
+    {
+        return;
+    }
+    upgrade_channel = HotUpgrade::inheritedChannel();
+    if (upgrade_channel != -1 && !HotUpgrade::recvFds(upgrade_channel, inherited_fds))
+    {
+        LOG_WARN << "receive listen sockets from the old process failed." << Log::endl;
+    }
+    configureTLSSession();
+    // 上传的临时文件只有服务器自己读写，改名到 doc_root 之前其他用户不能访问
+    if (mkdir(upload_dir.c_str(), 0700) == -1 && errno != EEXIST)
+    {
+        LOG_WARN << "create upload directory " << upload_dir << " failed, errno: " << errno << Log::endl;
+    }
+    if (ktls)
+    {
+        // 握手完成后 OpenSSL 会尝试把密钥交给内核，内核或套件不支持时该连接自动使用用户态加密
+#ifdef SSL_OP_ENABLE_KTLS
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#else
+        LOG_WARN << "OpenSSL is built without kTLS support." << Log::endl;
+#endif
+    }
+    if (reuseport_workers > 0)
+    {
+        // SO_REUSEPORT：每个工作线程拥有自己的监听 socket 和 Reactor，由内核把连接分散到各个 socket 上，
+        // 请求在 Reactor 线程内直接处理，不经过线程池的请求队列
+        int cpu_number = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int i = 0; i < reuseport_workers; ++i)
+        {
+            int fd = createListenSocket(port, true);
+            Reactor *reactor = createReactor(i, NULL);
+            if (fd == -1 || reactor == NULL)
+            {
+                stop = true;
+                return;
+            }
+            reactor->addListener(fd, [this, fd, reactor](int accept_fd)
+                                 { acceptConnection(fd, reactor, accept_fd, true); });
+            if (http_port)
+            {
+                int http_fd = createListenSocket(http_port, true);
+                if (http_fd == -1)
+                {
+                    stop = true;
+                    return;
+                }
+                reactor->addListener(http_fd, [this, http_fd, reactor](int accept_fd)
+                                     { acceptConnection(http_fd, reactor, accept_fd, false); });
+            }
+            if (pin_cpu)
+            {
+                reactor->setCpu(i % cpu_number);
+            }
+        }
+        // 第 0 个 Reactor 由主线程在 loop() 中运行
+        for (int i = 1; i < reuseport_workers; ++i)
+        {
+            if (!reactors[i]->start())
+            {
+                stop = true;
+                return;
+            }
+        }
+        LOG_INFO << reuseport_workers << " SO_REUSEPORT workers started." << Log::endl;
+        return;
+    }
+    pool.reset(new ThreadPool<ConnTask>(thread_number, max_request));
+    // 创建监听套接字
+    listen_fd = createListenSocket(port, false);
+    if (listen_fd == -1)
+    {
         stop = true;
         return;
     }
-    // 监听
-    if (listen(listen_fd, 5) == -1)
+    if (http_port)
+    {
+        http_listen_fd = createListenSocket(http_port, false);
+        if (http_listen_fd == -1)
+        {
+            stop = true;
+            return;
+        }
+        LOG_INFO << "plain HTTP listening on port " << http_port << Log::endl;
+    }
+    if (reactor_number == 0)
+    {
+        // 单 Reactor：监听 socket 和所有连接都注册在同一个 epoll 对象中，由主线程处理
+        Reactor *reactor = createReactor(0, pool.get());
+        if (reactor == NULL)
+        {
+            stop = true;
+            return;
+        }
+        reactor->addListener(listen_fd, [this, reactor](int accept_fd)
+                             { acceptConnection(listen_fd, reactor, accept_fd, true); });
+        if (http_listen_fd != -1)
+        {
+            reactor->addListener(http_listen_fd, [this, reactor](int accept_fd)
+                                 { acceptConnection(http_listen_fd, reactor, accept_fd, false); });
+        }
+        return;
+    }
+    // 多 Reactor：主 Reactor 只负责监听 socket，连接交给各个从 Reactor
+    acceptor.reset(Poller::create(io_backend, max_events));
+    if (!acceptor)
+    {
+        stop = true;
+        return;
+    }
+    acceptor->addListener(listen_fd);
+    if (http_listen_fd != -1)
+    {
+        acceptor->addListener(http_listen_fd);
+    }
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd == -1)
     {
-        LOG_ERROR << "listen" << Log::endl;
         stop = true;
         return;
     }
-    // 创建 epoll 对象
-    epoll_fd = epoll_create(6);
-    // 将监听的文件描述符添加到 epoll 对象中
-    addfd(epoll_fd, listen_fd, false);
-    HTTPConnection::m_epoll_fd = epoll_fd;
+    acceptor->add(wakeup_fd, wakeup_fd, false);
+    for (int i = 0; i < reactor_number; ++i)
+    {
+        Reactor *reactor = createReactor(i + 1, pool.get());
+        if (reactor == NULL || !reactor->start())
+        {
+            stop = true;
+            return;
+        }
+    }
+    LOG_INFO << reactor_number << " sub reactors started." << Log::endl;
+}
+
+// 拒绝刚刚 accept 的连接
+void Server::rejectConnection(int fd, bool tls)
+{
+    if (!tls)
+    {
+        std::string response = HTTPConnection::serviceUnavailable();
+        send(fd, response.c_str(), response.size(), MSG_DONTWAIT);
+        // 先发送 FIN 并读掉已经到达的请求，避免 close 时因接收缓冲区有数据而发送 RST 冲掉响应
+        shutdown(fd, SHUT_WR);
+        char buf[1024];
+        while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        {
+        }
+    }
+    close(fd);
+}
+
+// 接受 fd 上所有已完成三次握手的连接。owner 不为 NULL 时连接直接注册到 owner 中，
+// 否则由主 Reactor 按分配策略投递给从 Reactor。
+// accept_fd 不为 -1 时表示事件后端（io_uring 的 multishot accept）已经接受了这个连接，
+// tls 为 false 时是明文 HTTP 连接，不创建 SSL 对象
+void Server::acceptConnection(int fd, Reactor *owner, int accept_fd, bool tls)
+{
+    bool accepted = accept_fd >= 0; // 事件后端已经接受的连接只处理这一个
+    while (true)
+    {
+        struct sockaddr_in client_address;
+        socklen_t client_addrlen = sizeof(client_address);
+        int connect_fd;
+        if (accepted)
+        {
+            if (accept_fd < 0)
+            {
+                return;
+            }
+            // multishot accept 不返回对端地址，而连接上也没有用到它
+            memset(&client_address, 0, sizeof(client_address));
+            connect_fd = accept_fd;
+            accept_fd = -1;
+        }
+        else
+        {
+            connect_fd = accept(fd, (struct sockaddr *)&client_address, &client_addrlen);
+        }
+        if (connect_fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                LOG_ERROR << "An error occurred, the errno is: " << errno << Log::endl;
+            }
+            return;
+        }
+        if (HTTPConnection::m_user_count >= clients.capacity())
+        {
+            // 目前已达到最大连接数：明文连接回复 503，TLS 连接在握手之前无法发送 HTTP 响应，只能直接关闭
+            Stats::getInstance()->rejected_conns++;
+            rejectConnection(connect_fd, tls);
+            continue;
+        }
+        if (!tls && !Admission::getInstance()->admitNew())
+        {
+            // 过载时明文的新连接不注册到 Reactor，直接回复 503；TLS 连接需要先握手，由 Reactor 在第一个请求时拒绝
+            Stats::getInstance()->rejected_new++;
+            rejectConnection(connect_fd, tls);
+            continue;
+        }
+        // 关闭 Nagle 算法：握手消息、会话票据和响应都是小包，否则会被对端的延迟确认拖慢约 40ms
+        int nodelay = 1;
+        setsockopt(connect_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        // 将新的客户端连接数据初始化，放入到数组中
+        SSL *new_ssl = NULL;
+        if (tls)
+        {
+            new_ssl = SSL_new(ctx);
+            if (new_ssl == NULL)
+            {
+                LOG_ERROR << "ssl new wrong." << Log::endl;
+                close(connect_fd);
+                continue;
+            }
+            SSL_set_fd(new_ssl, connect_fd);
+            // 握手由连接所属的 Reactor 根据 I/O 事件非阻塞地推进
+            SSL_set_accept_state(new_ssl);
+        }
+        if (owner)
+        {
+            owner->addConnection(connect_fd, client_address, new_ssl);
+        }
+        else
+        {
+            selectReactor()->dispatch(connect_fd, client_address, new_ssl);
+        }
+    }
+}
+
+Reactor *Server::selectReactor()
+{
+    if (dispatch_policy == DISPATCH_LEAST_LOADED)
+    {
+        Reactor *target = reactors[0].get();
+        for (auto &reactor : reactors)
+        {
+            if (reactor->getLoad() < target->getLoad())
+            {
+                target = reactor.get();
+            }
+        }
+        return target;
+    }
+    Reactor *target = reactors[next_reactor].get();
+    next_reactor = (next_reactor + 1) % reactors.size();
+    return target;
 }
 
 void Server::loop()
 {
+    if (!stop)
+    {
+        prepareUpgrade();
+    }
+    if (!stop && (reactor_number == 0 || reuseport_workers > 0))
+    {
+        // 单 Reactor 和 SO_REUSEPORT 模式下，主线程直接运行第 0 个 Reactor
+        reactors[0]->run();
+        stop = true;
+    }
     while (!stop)
     {
-        int num = epoll_wait(epoll_fd, &*events.begin(), events.size(), conn_timeout);
+        int num = acceptor->wait(-1);
         if (num < 0 && errno != EINTR)
         {
-            // cout << "epoll failure." << endl;
             LOG_ERROR << "epoll failure." << Log::endl;
-            stop = true;
             break;
         }
-        // 循环遍历事件数组
         for (int i = 0; i < num; ++i)
         {
-            int sock_fd = events[i].data.fd;
-            if (sock_fd == listen_fd)
-            { // 有客户端连接进来
-                struct sockaddr_in client_address;
-                socklen_t client_addrlen = sizeof(client_address);
-                int connect_fd = accept(listen_fd, (struct sockaddr *)&client_address, &client_addrlen);
-                if (connect_fd < 0)
-                {
-                    LOG_ERROR << "An error occurred, the errno is: " << errno << Log::endl;
-                    continue;
-                }
-                if (HTTPConnection::m_user_count >= clients.size())
+            const PollEvent &ev = acceptor->event(i);
+            int fd = (int)ev.data;
+            if (fd == wakeup_fd)
+            {
+                uint64_t cnt;
+                while (::read(wakeup_fd, &cnt, sizeof(cnt)) > 0)
                 {
-                    // 目前已达到最大连接数
-                    // 给客户端回复信息："服务器忙"
-                    std::string tmp = "Internal server busy.";
-                    send(connect_fd, tmp.c_str(), tmp.size(), 0);
-                    close(connect_fd);
-                    continue;
                 }
-                // 将新的客户端连接数据初始化，放入到数组中
-                SSL *new_ssl = SSL_new(ctx);
-                if (new_ssl == NULL)
+                if (HTTPConnection::m_draining)
                 {
-                    LOG_ERROR << "ssl new wrong." << Log::endl;
-                    continue;
+                    acceptor->removeListener(listen_fd);
+                    if (http_listen_fd != -1)
+                    {
+                        acceptor->removeListener(http_listen_fd);
+                    }
                 }
-                SSL_set_fd(new_ssl, connect_fd);
-                SSL_accept(new_ssl);
-                clients[connect_fd].init(connect_fd, client_address, new_ssl);
-                timer_heap.addTimer(&clients[connect_fd], conn_timeout);
-                LOG_INFO << "new client: " << connect_fd << Log::endl;
             }
-            else if (events[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))
+            else if (fd == listen_fd || fd == http_listen_fd)
             {
-                // 客户端异常断开或者发生了错误事件
-                if(events[i].events & EPOLLHUP) {
-                    LOG_DEBUG << "EPOLLHUP" << Log::endl;
-                }
-                if(events[i].events & EPOLLRDHUP) {
-                    LOG_DEBUG << "EPOLLRDHUP" << Log::endl;
-                }
-                if(events[i].events & EPOLLERR) {
-                    LOG_DEBUG << "EPOLLERR" << Log::endl;
-                }
-                clients[sock_fd].close_conn();
+                acceptConnection(fd, NULL, ev.accept_fd, fd == listen_fd);
             }
-            else if (events[i].events & EPOLLIN)
-            {
-                // printf("come request.\n");
-                if (clients[sock_fd].read())
-                { 
-                    pool->append(&clients[sock_fd]);
-                    clients[sock_fd].updateTimer(conn_timeout);
-                }
-                else
-                {
-                    clients[sock_fd].close_conn();
-                }
-            }
-            else if (events[i].events & EPOLLOUT)
+        }
+    }
+    stop = true;
+    LOG_INFO << "The server stops running." << Log::endl;
+}
+
+void Server::wakeup()
+{
+    uint64_t one = 1;
+    ::write(wakeup_fd, &one, sizeof(one));
+}
+
+void Server::prepareUpgrade()
+{
+    if (upgrade_channel != -1)
+    {
+        // 监听 socket 都已经注册，旧进程可以停止 accept 了；没有用到的旧 socket 直接关闭
+        HotUpgrade::notifyReady(upgrade_channel);
+        close(upgrade_channel);
+        upgrade_channel = -1;
+        for (int fd : inherited_fds)
+        {
+            close(fd);
+        }
+        inherited_fds.clear();
+        LOG_INFO << "took over the listen sockets from the old process." << Log::endl;
+    }
+    if (exe_path.empty() || pipe2(signal_pipe, O_CLOEXEC) == -1)
+    {
+        return;
+    }
+    fcntl(signal_pipe[1], F_SETFL, O_NONBLOCK);
+    upgrade_signal_fd = signal_pipe[1];
+    if (pthread_create(&upgrade_thread, NULL, upgrade_thread_run, this) != 0)
+    {
+        LOG_ERROR << "upgrade thread create failed." << Log::endl;
+        return;
+    }
+    upgrade_thread_running = true;
+    addsig(SIGUSR2, upgradeSignalHandler);
+}
+
+void *Server::upgrade_thread_run(void *arg)
+{
+    auto obj_ptr = (Server *)arg;
+    obj_ptr->upgradeLoop();
+    return obj_ptr;
+}
+
+// 每收到一次 SIGUSR2 尝试升级一次，失败时继续服务并等待下一次信号；收到 'Q' 时退出
+void Server::upgradeLoop()
+{
+    char c;
+    while (true)
+    {
+        ssize_t ret = ::read(signal_pipe[0], &c, 1);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret <= 0 || c == 'Q')
+        {
+            return;
+        }
+        if (upgrade())
+        {
+            drain();
+            return;
+        }
+    }
+}
+
+bool Server::upgrade()
+{
+    LOG_INFO << "upgrade: starting " << exe_path << Log::endl;
+    // 新进程启动时从数据文件加载数据，先把内存中的修改写回去
+    Database::flush();
+    int channel;
+    pid_t pid = HotUpgrade::spawn(exe_path, exe_args, channel);
+    if (pid == -1)
+    {
+        return false;
+    }
+    bool ok = HotUpgrade::sendFds(channel, listen_fds) &&
+              HotUpgrade::waitReady(channel, HotUpgrade::READY_TIMEOUT);
+    close(channel);
+    if (!ok)
+    {
+        LOG_ERROR << "upgrade: new process " << pid << " failed to start, keep serving." << Log::endl;
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return false;
+    }
+    LOG_INFO << "upgrade: new process " << pid << " is accepting, draining "
+             << HTTPConnection::m_user_count << " connections." << Log::endl;
+    return true;
+}
+
+// 停止 accept，等待已有连接处理完当前请求后关闭，然后结束主线程的事件循环。
+// 此后数据文件由新进程负责，本进程在排空期间的修改不再写回
+void Server::drain()
+{
+    Database::detach();
+    HTTPConnection::m_draining = true;
+    for (auto &reactor : reactors)
+    {
+        reactor->drain();
+    }
+    if (acceptor)
+    {
+        wakeup();
+    }
+    // 有请求的连接会在下一个响应中带上 "Connection: close" 并随后关闭。
+    // 立即关闭空闲连接会和客户端正在发出的请求竞争，因此先等待 IDLE_GRACE 秒
+    time_t start = time(NULL);
+    bool idle_closed = false;
+    while (HTTPConnection::m_user_count > 0 && time(NULL) < start + drain_timeout)
+    {
+        if (!idle_closed && time(NULL) >= start + IDLE_GRACE)
+        {
+            for (auto &reactor : reactors)
             {
-                if (!clients[sock_fd].write())
-                { 
-                    clients[sock_fd].close_conn();
-                }
-                clients[sock_fd].updateTimer(conn_timeout);
-                // printf("send file.\n");
+                reactor->closeIdle();
             }
+            idle_closed = true;
         }
-        timer_heap.handleExpireEvent();
+        usleep(100000);
     }
+    LOG_INFO << "upgrade: drained, " << HTTPConnection::m_user_count << " connections left, exiting." << Log::endl;
     stop = true;
-    LOG_INFO << "The server stops running." << Log::endl;
+    if (acceptor)
+    {
+        wakeup();
+    }
+    else
+    {
+        reactors[0]->stop();
+    }
 }
 
 Server::~Server()
 {
-    close(epoll_fd);
-    close(listen_fd);
+    if (upgrade_thread_running)
+    {
+        char quit = 'Q';
+        ::write(signal_pipe[1], &quit, 1);
+        pthread_join(upgrade_thread, NULL);
+    }
+    // 先停止各个 Reactor 线程，再关闭监听 socket
+    reactors.clear();
+    acceptor.reset();
+    for (int fd : listen_fds)
+    {
+        close(fd);
+    }
+    upgrade_signal_fd = -1;
+    for (int fd : {signal_pipe[0], signal_pipe[1], wakeup_fd})
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
     SSL_CTX_free(ctx);
-}
\ No newline at end of file
+}
@@ -8,34 +8,101 @@
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
 #include <memory>
 #include <vector>
 #include <openssl/ssl.h>
-#include <sys/epoll.h>
 #include "httpconnection.h"
 #include "threadpool.h"
+#include "reactor.h"
+
+// 多 Reactor 模式下主 Reactor 分配新连接的策略
+enum DISPATCH_POLICY
+{
+    DISPATCH_ROUND_ROBIN = 0, // 轮询
+    DISPATCH_LEAST_LOADED     // 选择当前连接数最少的从 Reactor
+};
 
 class Server
 {
 public:
+    static const int IDLE_GRACE = 1; // 热升级后等待多久再关闭空闲的 keep-alive 连接（秒）
+
     Server(int _port, int, int, int, int, int);
     ~Server();
     void init(const std::string, const std::string, const std::string);
+    void setTLSSession(bool tls13_, int cache_size, int timeout, int ticket_rotation_); // TLS 版本和会话恢复
+    void setReactors(int number, const std::string &policy); // number 为 0 表示单 Reactor 模式
+    void setReuseportWorkers(int number, bool pin_cpu_);      // number 为 0 表示不使用 SO_REUSEPORT 分片
+    void setIOBackend(const std::string &backend);            // "epoll" 或 "io_uring"
+    void setHandshakeOffload(bool offload);                   // 是否把 TLS 握手交给线程池
+    void setKTLS(bool enable);                                // 是否尝试启用内核 TLS
+    void setHTTPPort(int port_);                              // 明文 HTTP 端口，0 表示不监听
+    void setUpgrade(char *argv[], int drain_timeout_);        // 热升级时 exec 的命令行和旧进程排空连接的最长时间
+    void setAdmission(int max_queue_depth, int max_queue_wait, int retry_after); // 过载时拒绝新请求的阈值
+    void setMaxBodySize(int megabytes);                       // 请求体的最大长度（MB），0 表示不限制
+    void setMaxReadBuffer(int kilobytes);                     // 每个连接读缓冲区的最大长度（KB），0 表示使用默认值
+    void setTimeouts(int handshake, int header, int body, int write_); // 连接各阶段的超时时间（秒），0 表示使用默认值
+    void setCompression(bool enable, int min_size);           // 是否压缩响应，以及值得压缩的最小响应体（字节）
+    void setFileCache(int megabytes, int max_file_kilobytes); // 静态文件缓存的容量（MB，0 表示不缓存）和可缓存的最大文件（KB）
     void start();
     void loop();
 
 private:
-    int port;                                         // 端口号
-    std::unique_ptr<ThreadPool<HTTPConnection>> pool; // 线程池
-    std::vector<HTTPConnection> clients;              // 用于保存所有的客户端信息
+    void configureTLSSession();
+    int createListenSocket(int port_, bool reuseport);
+    Reactor *createReactor(int id, ThreadPool<ConnTask> *pool_);
+    void acceptConnection(int fd, Reactor *owner, int accept_fd, bool tls);
+    void rejectConnection(int fd, bool tls); // 明文连接回复 503 后关闭，TLS 连接直接关闭
+    Reactor *selectReactor();
+    void prepareUpgrade();                 // 通知旧进程启动完成，并开始响应 SIGUSR2
+    static void *upgrade_thread_run(void *);
+    void upgradeLoop();
+    bool upgrade();                        // 启动新进程并交出监听 socket，成功后本进程开始排空连接
+    void drain();
+    void wakeup();                         // 唤醒主线程的事件循环
+
+private:
+    int port;                                         // HTTPS 端口号
+    int http_port;                                    // 明文 HTTP 端口号，0 表示不监听
+    std::unique_ptr<ThreadPool<ConnTask>> pool;       // 线程池
+    int thread_number;
+    int max_request;
+    ConnectionSlab clients;                           // 所有客户端连接，按需分配
     /* SSL_CTX 数据结构主要用于 SSL 握手前的环境准备，设置 CA 文件和目录、
     设置 SSL 握手中的证书文件和私钥、设置协议版本以及其他一些 SSL 握手时的选项。 */
     SSL_CTX *ctx;
     int listen_fd; // 监听的 socket 文件描述符
-    int epoll_fd;  // epoll 对象的文件描述符
-    std::vector<epoll_event> events;
-    bool stop;
-    TimerHeap timer_heap;
+    int http_listen_fd; // 明文 HTTP 监听的 socket，没有则为 -1
+    std::vector<int> listen_fds; // 所有创建的监听 socket，SO_REUSEPORT 模式下每个工作线程一个
+    std::unique_ptr<Poller> acceptor; // 多 Reactor 模式下主 Reactor 的事件后端，只监听 listen_fd
+    volatile bool stop; // 热升级后由升级线程设置
     time_t conn_timeout;
+    int max_events;
+    int reactor_number;                             // 从 Reactor 的数量
+    DISPATCH_POLICY dispatch_policy;                // 新连接的分配策略
+    unsigned int next_reactor;                      // 轮询时下一个分配的从 Reactor
+    std::vector<std::unique_ptr<Reactor>> reactors; // 单 Reactor 模式下只有一个，由主线程驱动
+    int reuseport_workers;                          // SO_REUSEPORT 工作线程的数量
+    bool pin_cpu;                                   // 是否把每个工作线程绑定到一个 CPU 上
+    std::string io_backend;                         // I/O 事件后端
+    bool handshake_offload;                         // TLS 握手是否在工作线程中进行
+    bool tls13;                                     // 是否启用 TLS 1.3
+    int session_cache_size;                         // 服务端会话缓存的大小，0 表示关闭
+    int session_timeout;                            // 会话缓存的过期时间（秒）
+    int ticket_rotation;                            // 会话票据密钥的轮换周期（秒），0 表示关闭票据
+    bool ktls;                                      // 是否尝试启用内核 TLS，静态文件使用 SSL_sendfile 发送
+    std::string exe_path;                           // 热升级时 exec 的可执行文件，空表示不支持热升级
+    std::vector<std::string> exe_args;
+    int drain_timeout;                              // 热升级后旧进程排空连接的最长时间（秒）
+    int upgrade_channel;                            // 由热升级启动时和旧进程之间的通道，否则为 -1
+    std::vector<int> inherited_fds;                 // 从旧进程继承、尚未使用的监听 socket
+    int signal_pipe[2];                             // SIGUSR2 的处理函数写入，升级线程读取
+    int wakeup_fd;                                  // 唤醒主线程 loop() 中的 epoll_wait
+    pthread_t upgrade_thread;
+    bool upgrade_thread_running;
 };
@@ -0,0 +1,122 @@
+#include "stats.h"
+#include "httpconnection.h"
+#include "admission.h"
+#include "filecache.h"
+#include <algorithm>
+
+LatencyStat::LatencyStat() : m_count(0), m_sum(0), m_max(0)
+{
+    for (int i = 0; i < BUCKET_NUMBER; ++i)
+    {
+        m_buckets[i] = 0;
+    }
+}
+
+void LatencyStat::record(uint64_t us)
+{
+    int bucket = 0;
+    while (bucket < BUCKET_NUMBER - 1 && (1ULL << bucket) < us)
+    {
+        ++bucket;
+    }
+    m_buckets[bucket]++;
+    m_count++;
+    m_sum += us;
+    uint64_t old_max = m_max;
+    while (us > old_max && !m_max.compare_exchange_weak(old_max, us))
+    {
+    }
+}
+
+uint64_t LatencyStat::count() const
+{
+    return m_count;
+}
+
+uint64_t LatencyStat::percentile(double p) const
+{
+    uint64_t total = m_count;
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t target = total * p / 100.0;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_NUMBER; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen > target)
+        {
+            // 桶的上界可能超过实际观测到的最大值，截到 m_max，避免 p99 大于 max
+            return std::min<uint64_t>(1ULL << i, m_max);
+        }
+    }
+    return m_max;
+}
+
+std::string LatencyStat::toString(const std::string &name) const
+{
+    uint64_t cnt = m_count;
+    std::string ret = name + "_count " + std::to_string(cnt) + "\n";
+    ret += name + "_avg_us " + std::to_string(cnt ? m_sum / cnt : 0) + "\n";
+    ret += name + "_p50_us " + std::to_string(percentile(50)) + "\n";
+    ret += name + "_p99_us " + std::to_string(percentile(99)) + "\n";
+    ret += name + "_max_us " + std::to_string(m_max) + "\n";
+    return ret;
+}
+
+Stats::Stats() : handshake_failed(0), handshake_full(0), handshake_resumed(0),
+                 ktls_connections(0), sendfile_bytes(0),
+                 conn_slots(0), conn_slot_bytes(0), stale_events(0),
+                 rejected_conns(0), rejected_new(0), rejected_queue_full(0),
+                 timeout_handshake(0), timeout_header(0), timeout_body(0), timeout_write(0), timeout_idle(0),
+                 file_cache_hits(0), file_cache_misses(0), file_cache_evictions(0), file_cache_invalidations(0),
+                 not_modified(0), partial_content(0),
+                 compressed_responses(0), compressed_bytes_saved(0)
+{
+}
+
+Stats *Stats::getInstance()
+{
+    static Stats stats;
+    return &stats;
+}
+
+std::string Stats::toString() const
+{
+    std::string ret;
+    ret += handshake.toString("handshake");
+    ret += "handshake_failed " + std::to_string(handshake_failed) + "\n";
+    ret += "handshake_full " + std::to_string(handshake_full) + "\n";
+    ret += "handshake_resumed " + std::to_string(handshake_resumed) + "\n";
+    ret += "ktls_connections " + std::to_string(ktls_connections) + "\n";
+    ret += "sendfile_bytes " + std::to_string(sendfile_bytes) + "\n";
+    ret += "conn_active " + std::to_string(HTTPConnection::m_user_count) + "\n";
+    ret += "conn_slots " + std::to_string(conn_slots) + "\n";
+    ret += "conn_slot_bytes " + std::to_string(conn_slot_bytes) + "\n";
+    ret += "stale_events " + std::to_string(stale_events) + "\n";
+    ret += "queue_depth " + std::to_string(Admission::getInstance()->queueDepth()) + "\n";
+    ret += "queue_wait_ewma_us " + std::to_string(Admission::getInstance()->queueWait()) + "\n";
+    ret += queue_wait.toString("queue_wait");
+    ret += "loop_busy_ewma_us " + std::to_string(Admission::getInstance()->loopBusy()) + "\n";
+    ret += "rejected_conns " + std::to_string(rejected_conns) + "\n";
+    ret += "rejected_new " + std::to_string(rejected_new) + "\n";
+    ret += "rejected_queue_full " + std::to_string(rejected_queue_full) + "\n";
+    ret += "timeout_handshake " + std::to_string(timeout_handshake) + "\n";
+    ret += "timeout_header " + std::to_string(timeout_header) + "\n";
+    ret += "timeout_body " + std::to_string(timeout_body) + "\n";
+    ret += "timeout_write " + std::to_string(timeout_write) + "\n";
+    ret += "timeout_idle " + std::to_string(timeout_idle) + "\n";
+    ret += "file_cache_hits " + std::to_string(file_cache_hits) + "\n";
+    ret += "file_cache_misses " + std::to_string(file_cache_misses) + "\n";
+    ret += "file_cache_evictions " + std::to_string(file_cache_evictions) + "\n";
+    ret += "file_cache_invalidations " + std::to_string(file_cache_invalidations) + "\n";
+    ret += "file_cache_entries " + std::to_string(FileCache::getInstance()->entries()) + "\n";
+    ret += "file_cache_bytes " + std::to_string(FileCache::getInstance()->bytes()) + "\n";
+    ret += "not_modified " + std::to_string(not_modified) + "\n";
+    ret += "partial_content " + std::to_string(partial_content) + "\n";
+    ret += "compressed_responses " + std::to_string(compressed_responses) + "\n";
+    ret += "compressed_bytes_saved " + std::to_string(compressed_bytes_saved) + "\n";
+    ret += request.toString("request");
+    return ret;
+}
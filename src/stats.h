@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+
+// 单调时钟的当前时间，单位为微秒
+inline uint64_t nowMicros()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 延迟统计：记录次数、总和、最大值，并按 2 的幂分桶以估算分位数
+class LatencyStat
+{
+public:
+    static const int BUCKET_NUMBER = 40;
+
+    LatencyStat();
+    void record(uint64_t us);
+    uint64_t count() const;
+    uint64_t percentile(double p) const; // 返回所在桶的上界（微秒）
+    std::string toString(const std::string &name) const;
+
+private:
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+    std::atomic<uint64_t> m_buckets[BUCKET_NUMBER];
+};
+
+// 服务器运行时的统计信息，各线程无锁地更新，通过 /stats 页面查看
+class Stats
+{
+public:
+    static Stats *getInstance();
+    std::string toString() const;
+
+    LatencyStat handshake;                   // TLS 握手耗时，从 accept 到握手完成
+    std::atomic<uint64_t> handshake_failed;  // TLS 握手失败次数
+    std::atomic<uint64_t> handshake_full;    // 完整握手次数
+    std::atomic<uint64_t> handshake_resumed; // 通过会话缓存或票据恢复的握手次数
+    std::atomic<uint64_t> ktls_connections;  // 发送方向启用了内核 TLS 的连接数
+    std::atomic<uint64_t> sendfile_bytes;    // 通过 sendfile/SSL_sendfile 发送的文件字节数
+    std::atomic<uint64_t> conn_slots;        // 连接表中已经分配了内存的槽位数，包括空闲槽位
+    std::atomic<uint64_t> conn_slot_bytes;   // 每个槽位（空闲连接）占用的字节数
+    std::atomic<uint64_t> stale_events;      // 因连接已关闭而丢弃的事件和线程池任务数
+    std::atomic<uint64_t> rejected_conns;    // 连接数已达上限时拒绝的新连接数
+    std::atomic<uint64_t> rejected_new;      // 过载时回复 503 的新连接上的第一个请求数
+    std::atomic<uint64_t> rejected_queue_full; // 线程池队列已满时回复 503 的请求数
+    std::atomic<uint64_t> timeout_handshake; // 各阶段超时关闭的连接数，阶段见 CONN_PHASE
+    std::atomic<uint64_t> timeout_header;
+    std::atomic<uint64_t> timeout_body;
+    std::atomic<uint64_t> timeout_write;
+    std::atomic<uint64_t> timeout_idle;
+    std::atomic<uint64_t> file_cache_hits;          // 静态文件缓存命中的次数
+    std::atomic<uint64_t> file_cache_misses;        // 没有命中的次数，包括不能缓存的文件
+    std::atomic<uint64_t> file_cache_evictions;     // 缓存满时被置换出的文件数
+    std::atomic<uint64_t> file_cache_invalidations; // 因文件变化（inotify）失效的文件数
+    std::atomic<uint64_t> not_modified;             // 条件请求的验证器匹配，回复 304 的次数
+    std::atomic<uint64_t> partial_content;          // 范围请求回复 206 的次数
+    std::atomic<uint64_t> compressed_responses;     // 即时压缩的动态响应数（静态文件的压缩版本只在读入缓存时生成一次）
+    std::atomic<uint64_t> compressed_bytes_saved;   // 即时压缩节省的字节数
+    LatencyStat queue_wait;                  // 任务在线程池队列中的等待时间
+    LatencyStat request;                     // 请求耗时，从读到请求的第一个字节到响应发送完毕
+
+private:
+    Stats();
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+/* 不持有内存的字符串视图，相当于 C++17 的 std::string_view 的一个子集。
+ * 视图只记录首地址和长度，所指向的内存必须在视图使用期间保持有效。 */
+struct StringView
+{
+    static const size_t npos = (size_t)-1;
+
+    const char *data;
+    size_t size;
+
+    StringView() : data(NULL), size(0) {}
+    StringView(const char *str, size_t len) : data(str), size(len) {}
+    StringView(const char *str) : data(str), size(strlen(str)) {}
+    StringView(const std::string &str) : data(str.data()), size(str.size()) {}
+
+    bool empty() const { return size == 0; }
+    const char *begin() const { return data; }
+    const char *end() const { return data + size; }
+    char operator[](size_t i) const { return data[i]; }
+    std::string str() const { return std::string(data, size); }
+
+    StringView substr(size_t pos, size_t len = npos) const
+    {
+        if (pos > size)
+        {
+            pos = size;
+        }
+        if (len > size - pos)
+        {
+            len = size - pos;
+        }
+        return StringView(data + pos, len);
+    }
+
+    size_t find(char c, size_t pos = 0) const
+    {
+        if (pos >= size)
+        {
+            return npos;
+        }
+        const char *p = (const char *)memchr(data + pos, c, size - pos);
+        return p ? p - data : npos;
+    }
+
+    size_t rfind(char c) const
+    {
+        for (size_t i = size; i > 0; --i)
+        {
+            if (data[i - 1] == c)
+            {
+                return i - 1;
+            }
+        }
+        return npos;
+    }
+
+    bool operator==(StringView other) const
+    {
+        return size == other.size && memcmp(data, other.data, size) == 0;
+    }
+
+    bool operator!=(StringView other) const
+    {
+        return !(*this == other);
+    }
+
+    // 只转换 ASCII 字母，不受 locale 影响，也不需要调用 tolower
+    static char toLower(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    }
+
+    // 忽略 ASCII 大小写比较，用于首部字段名和 keep-alive 等记号
+    bool iequals(StringView other) const
+    {
+        if (size != other.size)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (toLower(data[i]) != toLower(other.data[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -7,14 +7,14 @@
 #include <cstdio>
 #include "locker.h"
 
-// 线程池类，模板类
+// 线程池类，模板类。请求按值保存在队列中，T 需要提供 process() 方法
 template <typename T>
 class ThreadPool
 {
 public:
     ThreadPool(int thread_number = 8, int max_requests = 10000);
     ~ThreadPool();
-    bool append(T *request);
+    bool append(const T &request);
 
 private:
     // 线程的数量
@@ -24,7 +24,7 @@ private:
     // 请求队列最大的等待数量
     int m_max_requests;
     // 请求队列
-    std::list<T *> m_work_queue;
+    std::list<T> m_work_queue;
     // 互斥锁
     Locker m_queue_locker;
     // 信号量用来判断是否有任务需要处理
@@ -78,7 +78,7 @@ ThreadPool<T>::~ThreadPool()
 }
 
 template <typename T>
-bool ThreadPool<T>::append(T *request)
+bool ThreadPool<T>::append(const T &request)
 {
     m_queue_locker.lock(); // 对请求队列加锁
     if (m_work_queue.size() > m_max_requests)
@@ -113,13 +113,9 @@ void ThreadPool<T>::run()
             m_queue_locker.unlock(); // 解锁
             continue;
         }
-        T *request = m_work_queue.front(); // 获取请求
+        T request = m_work_queue.front(); // 获取请求
         m_work_queue.pop_front();
         m_queue_locker.unlock();
-        if (!request)
-        {
-            continue;
-        }
-        request->process(); // 处理获取到的请求
+        request.process(); // 处理获取到的请求
     }
 }
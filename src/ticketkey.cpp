@@ -0,0 +1,121 @@
+#include "ticketkey.h"
+#include "log.h"
+#include <string.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+TicketKeyRing::TicketKeyRing() : m_rotate_interval(3600)
+{
+    m_current.valid = false;
+    m_previous.valid = false;
+}
+
+TicketKeyRing *TicketKeyRing::getInstance()
+{
+    static TicketKeyRing ring;
+    return &ring;
+}
+
+void TicketKeyRing::init(int rotate_interval)
+{
+    m_rotate_interval = rotate_interval;
+}
+
+bool TicketKeyRing::generate(TicketKey &key)
+{
+    if (RAND_bytes(key.name, KEY_NAME_SIZE) != 1 ||
+        RAND_bytes(key.aes_key, KEY_SIZE) != 1 ||
+        RAND_bytes(key.hmac_key, KEY_SIZE) != 1)
+    {
+        return false;
+    }
+    key.created = time(NULL);
+    key.valid = true;
+    return true;
+}
+
+bool TicketKeyRing::install(SSL_CTX *ctx)
+{
+    m_locker.lock();
+    bool ok = generate(m_current);
+    m_locker.unlock();
+    if (!ok)
+    {
+        LOG_ERROR << "generate session ticket key failed." << Log::endl;
+        return false;
+    }
+    return SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticketCallback) == 1;
+}
+
+// 调用者需持有 m_locker
+void TicketKeyRing::rotateIfNeeded()
+{
+    if (time(NULL) - m_current.created < m_rotate_interval)
+    {
+        return;
+    }
+    TicketKey next;
+    if (!generate(next))
+    {
+        return;
+    }
+    m_previous = m_current;
+    m_current = next;
+    LOG_INFO << "session ticket key rotated." << Log::endl;
+}
+
+/* enc 为 1 时用当前密钥加密新票据，返回 1；
+ * enc 为 0 时按 key_name 查找密钥解密票据：找不到返回 0（进行完整握手），
+ * 用上一个密钥解密时返回 2，让 OpenSSL 换发用当前密钥加密的新票据。 */
+int TicketKeyRing::ticketCallback(SSL *, unsigned char *key_name, unsigned char *iv,
+                                  EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *mac_ctx, int enc)
+{
+    TicketKeyRing *ring = getInstance();
+    TicketKey key;
+    int ret = 1;
+    ring->m_locker.lock();
+    ring->rotateIfNeeded();
+    if (enc)
+    {
+        key = ring->m_current;
+    }
+    else if (memcmp(key_name, ring->m_current.name, KEY_NAME_SIZE) == 0)
+    {
+        key = ring->m_current;
+    }
+    else if (ring->m_previous.valid && memcmp(key_name, ring->m_previous.name, KEY_NAME_SIZE) == 0)
+    {
+        key = ring->m_previous;
+        ret = 2;
+    }
+    else
+    {
+        ring->m_locker.unlock();
+        return 0;
+    }
+    ring->m_locker.unlock();
+
+    OSSL_PARAM params[3];
+    params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key, KEY_SIZE);
+    params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0);
+    params[2] = OSSL_PARAM_construct_end();
+    if (enc)
+    {
+        memcpy(key_name, key.name, KEY_NAME_SIZE);
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1 ||
+            EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1)
+        {
+            return -1;
+        }
+    }
+    else if (EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1)
+    {
+        return -1;
+    }
+    if (EVP_MAC_CTX_set_params(mac_ctx, params) != 1)
+    {
+        return -1;
+    }
+    return ret;
+}
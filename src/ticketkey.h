@@ -0,0 +1,41 @@
+#pragma once
+
+#include <time.h>
+#include <openssl/ssl.h>
+#include "locker.h"
+
+/* 会话票据（session ticket）密钥环：
+ * 保存当前密钥和上一个密钥，每隔 rotate_interval 秒生成新密钥。
+ * 新票据总是用当前密钥加密；用上一个密钥加密的票据仍然可以恢复会话，并会被换发新票据。
+ * 所有线程共享同一个 SSL_CTX，因此密钥的读写需要加锁。 */
+class TicketKeyRing
+{
+public:
+    static TicketKeyRing *getInstance();
+    void init(int rotate_interval);
+    bool install(SSL_CTX *ctx); // 在 ctx 上注册票据加解密回调
+
+private:
+    static const int KEY_NAME_SIZE = 16;
+    static const int KEY_SIZE = 32;
+
+    struct TicketKey
+    {
+        unsigned char name[KEY_NAME_SIZE];
+        unsigned char aes_key[KEY_SIZE];
+        unsigned char hmac_key[KEY_SIZE];
+        time_t created;
+        bool valid;
+    };
+
+    TicketKeyRing();
+    bool generate(TicketKey &key);
+    void rotateIfNeeded();
+    static int ticketCallback(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                              EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *mac_ctx, int enc);
+
+    TicketKey m_current;
+    TicketKey m_previous;
+    int m_rotate_interval;
+    Locker m_locker;
+};
@@ -1,35 +1,32 @@
-
 #include "timer.h"
+#include "stats.h"
+#include "log.h"
 
-TimerNode::TimerNode(HTTPConnection *conn, int timeout)
+TimerNode::TimerNode(HTTPConnection *conn)
 {
     deleted = false;
-    expire = time(NULL) + timeout;
-    // printf("%ld %ld\n", cur_time, expire);
-    http_conn = conn;
+    CONN_PHASE current = conn->phase();
+    phase = current;
+    expire = conn->deadline(current);
+    queued = 0;
+    slab = conn->getSlab();
+    handle = conn->getHandle();
 }
 
 TimerNode::~TimerNode()
 {
+    ConnHandle h = handle;
+    HTTPConnection *http_conn = h ? slab->get(h) : NULL;
     if (http_conn) {
         http_conn->close_conn();
         // printf("~TimerNode()\n");
     }
 }
 
-bool TimerNode::isExpired()
+bool TimerNode::isExpired(uint64_t now)
 {
-    time_t now = time(NULL);
     // printf("%ld %ld\n", now, expire);
-    if (expire <= now)
-    {
-        deleted = true;
-        return true;
-    }
-    else
-    {
-        return false;
-    }
+    return expire <= now;
 }
 
 bool TimerNode::isDeleted()
@@ -40,45 +37,182 @@ bool TimerNode::isDeleted()
 void TimerNode::setDeleted()
 {
     deleted = true;
-    http_conn = nullptr;
+    handle = 0;
 }
 
-void TimerNode::update(int timeout)
+void TimerNode::update(CONN_PHASE phase_, uint64_t expire_)
 {
-    expire = time(NULL) + timeout;
+    phase = phase_;
+    expire = expire_;
 }
 
-time_t TimerNode::getExpireTime()
+uint64_t TimerNode::getExpireTime()
 {
     return expire;
 }
 
-void TimerHeap::addTimer(HTTPConnection *conn, int timeout)
+CONN_PHASE TimerNode::getPhase()
+{
+    return (CONN_PHASE)phase.load();
+}
+
+uint64_t TimerNode::getQueuedTime()
+{
+    return queued;
+}
+
+void TimerNode::setQueuedTime(uint64_t time)
+{
+    queued = time;
+}
+
+HTTPConnection *TimerNode::connection()
+{
+    ConnHandle h = handle;
+    return deleted || h == 0 ? NULL : slab->get(h);
+}
+
+// 堆中的元素按 expire 排序，通常就是节点的截止时间；过期时连接正忙的节点按重试的时间入堆
+void TimerHeap::push(const timer_node_ptr &node, uint64_t expire)
+{
+    TimerEntry entry = {expire, node};
+    node->setQueuedTime(expire);
+    timer_queue.push(entry);
+}
+
+void TimerHeap::addTimer(HTTPConnection *conn)
 {
     // printf("timer heap add timer.\n");
-    std::shared_ptr<TimerNode> new_node(new TimerNode(conn, timeout));
-    timer_queue.push(new_node);
+    std::shared_ptr<TimerNode> new_node(new TimerNode(conn));
+    push(new_node, new_node->getExpireTime());
     conn->setTimer(new_node);
 }
 
+// 由 Reactor 线程在连接的读写事件处理完之后调用，此时连接不在线程池中
+void TimerHeap::updateTimer(HTTPConnection &conn)
+{
+    timer_node_ptr node = conn.getTimer();
+    if (!node)
+    {
+        return;
+    }
+    uint64_t old_expire = node->getExpireTime();
+    conn.updateTimer();
+    if (node->getExpireTime() < old_expire)
+    {
+        push(node, node->getExpireTime());
+    }
+}
+
 void TimerHeap::handleExpireEvent()
 {
+    uint64_t now = nowMicros() / 1000;
+    std::vector<timer_node_ptr> busy;
     while (!timer_queue.empty())
     {
-        timer_node_ptr top_node = timer_queue.top();
-        if (top_node->isDeleted())
+        TimerEntry top = timer_queue.top();
+        timer_node_ptr top_node = top.node;
+        if (top_node->isDeleted() || top.expire != top_node->getQueuedTime())
+        {
+            // 连接已经关闭，或者截止时间提前后堆中已经有了更新的元素
+            timer_queue.pop();
+        }
+        else if (top.expire != top_node->getExpireTime())
         {
-            // printf("deleted.\n");
+            // 截止时间变过，按新的时间重新入堆
             timer_queue.pop();
+            push(top_node, top_node->getExpireTime());
         }
-        else if (top_node->isExpired())
+        else if (top_node->isExpired(now))
         {
             // printf("expire.\n");
             timer_queue.pop();
+            HTTPConnection *conn = top_node->connection();
+            if (conn == NULL)
+            {
+                continue;
+            }
+            if (!conn->tryLockProcess())
+            {
+                // 例如头部的最后一个字节恰好在截止时间之前到达，请求正在工作线程中处理。
+                // 处理完后截止时间通常已经按新的阶段推后，重试时按新的时间重新入堆
+                busy.push_back(top_node);
+                continue;
+            }
+            switch (top_node->getPhase())
+            {
+            case PHASE_HANDSHAKE:
+                Stats::getInstance()->timeout_handshake++;
+                break;
+            case PHASE_HEADER:
+                Stats::getInstance()->timeout_header++;
+                break;
+            case PHASE_BODY:
+                Stats::getInstance()->timeout_body++;
+                break;
+            case PHASE_WRITE:
+                Stats::getInstance()->timeout_write++;
+                break;
+            default:
+                Stats::getInstance()->timeout_idle++;
+                break;
+            }
+            LOG_DEBUG << "connection timeout in phase " << top_node->getPhase() << Log::endl;
+            // 持有锁直到关闭完成：已经排队的任务在槽位释放后才能拿到锁，然后发现句柄已经失效
+            conn->close_conn();
+            conn->unlockProcess();
         }
         else
         {
             break;
         }
     }
-}
\ No newline at end of file
+    for (auto &node : busy)
+    {
+        push(node, now + BUSY_RETRY);
+    }
+}
+
+int TimerHeap::nextTimeout()
+{
+    if (timer_queue.empty())
+    {
+        return -1;
+    }
+    uint64_t now = nowMicros() / 1000;
+    uint64_t expire = timer_queue.top().expire;
+    return expire > now ? (int)(expire - now) : 0;
+}
+
+void TimerHeap::closeIdleConnections()
+{
+    // 优先队列不能遍历，全部取出后再把仍在使用的连接放回去
+    std::vector<TimerEntry> entries;
+    while (!timer_queue.empty())
+    {
+        entries.push_back(timer_queue.top());
+        timer_queue.pop();
+    }
+    for (auto &entry : entries)
+    {
+        HTTPConnection *conn = entry.node->connection();
+        if (conn == NULL)
+        {
+            continue;
+        }
+        if (!conn->tryLockProcess())
+        {
+            // 正在工作线程中处理，不是空闲的连接
+            timer_queue.push(entry);
+            continue;
+        }
+        if (conn->isIdle())
+        {
+            conn->close_conn();
+            conn->unlockProcess();
+            continue;
+        }
+        conn->unlockProcess();
+        timer_queue.push(entry);
+    }
+}
@@ -1,10 +1,30 @@
-
 #pragma once
 
+#include <stdint.h>
 #include <time.h>
 #include <vector>
 #include <queue>
 #include <memory>
+#include <atomic>
+#include "connslab.h"
+
+/* 连接所处的阶段，每个阶段有各自的超时时间：
+ * PHASE_HANDSHAKE : TLS 握手，从建立连接开始计算
+ * PHASE_HEADER    : 读取请求行和请求头部，从读到请求的第一个字节开始计算（新连接从建立连接开始），
+ *                   之后陆续读到的数据不延长期限，缓慢发送头部的客户端不能一直占用连接
+ * PHASE_BODY      : 读取请求体，每次读到数据后重新计算
+ * PHASE_WRITE     : 发送响应，每次发送出数据后重新计算
+ * PHASE_IDLE      : 两个请求之间空闲的 keep-alive 连接 */
+enum CONN_PHASE
+{
+    PHASE_HANDSHAKE = 0,
+    PHASE_HEADER,
+    PHASE_BODY,
+    PHASE_WRITE,
+    PHASE_IDLE,
+    PHASE_COUNT
+};
+
 #include "httpconnection.h"
 
 class HTTPConnection;
@@ -12,37 +32,65 @@ class HTTPConnection;
 class TimerNode
 {
 public:
-    TimerNode(HTTPConnection *conn, int timeout);
+    TimerNode(HTTPConnection *conn); // conn 必须已经初始化，定时器记录它当前的句柄和阶段
     ~TimerNode();
-    bool isExpired();
+    bool isExpired(uint64_t now);
     bool isDeleted();
     void setDeleted();
-    void update(int timeout);
-    time_t getExpireTime();
+    void update(CONN_PHASE phase, uint64_t expire);
+    uint64_t getExpireTime();
+    CONN_PHASE getPhase();
+    uint64_t getQueuedTime();
+    void setQueuedTime(uint64_t time);
+    HTTPConnection *connection(); // 连接已经关闭时返回 NULL
 
 private:
-    bool deleted;
-    time_t expire;
-    HTTPConnection *http_conn;
-};
-
-struct TimerCmp
-{
-    bool operator()(std::shared_ptr<TimerNode> &a, std::shared_ptr<TimerNode> &b) const
-    {
-        return a->getExpireTime() > b->getExpireTime();
-    }
+    // 除了 queued，这些字段都可能被工作线程修改：处理完请求、等待更多数据之前更新截止时间
+    // （例如读完头部进入请求体阶段），或者在工作线程中关闭连接。Reactor 线程同时读取
+    std::atomic<bool> deleted;
+    std::atomic<int> phase;
+    std::atomic<uint64_t> expire; // 截止时间，单调时钟的毫秒数
+    uint64_t queued;              // 最近一次放入时间堆时的截止时间，只由 Reactor 线程访问
+    ConnectionSlab *slab;
+    std::atomic<ConnHandle> handle; // 连接关闭后句柄失效，过期时不会误关闭复用了同一槽位的新连接
 };
 
+/* 时间堆。堆中的元素记录入堆时的截止时间：
+ * 截止时间推后时不调整堆，元素到达堆顶时按新的截止时间重新入堆；
+ * Reactor 线程中截止时间提前时（例如空闲连接开始读取头部）另外插入一个元素，旧的元素到达堆顶时丢弃。
+ * 工作线程不能访问堆，它提前的截止时间要等旧的元素到达堆顶时才生效，见 TimerHeap::updateTimer 的调用位置。
+ * 过期的连接如果正在工作线程中处理，不能关闭（见 HTTPConnection::lockProcess()），BUSY_RETRY 毫秒后再检查 */
 class TimerHeap
 {
 public:
+    static const int BUSY_RETRY = 10;
+
     TimerHeap() {}
     ~TimerHeap() {}
-    void addTimer(HTTPConnection *, int timeout);
+    void addTimer(HTTPConnection *);
+    void updateTimer(HTTPConnection &conn); // 在 Reactor 线程中按连接当前所处的阶段重新设置截止时间
     void handleExpireEvent();
+    int nextTimeout();           // 距离最早的截止时间的毫秒数，没有定时器时返回 -1
+    void closeIdleConnections(); // 关闭堆中所有空闲的 keep-alive 连接，其余连接保留
 
 private:
     typedef std::shared_ptr<TimerNode> timer_node_ptr;
-    std::priority_queue<timer_node_ptr, std::vector<timer_node_ptr>, TimerCmp> timer_queue;
+
+    struct TimerEntry
+    {
+        uint64_t expire;
+        timer_node_ptr node;
+    };
+
+    struct TimerCmp
+    {
+        bool operator()(const TimerEntry &a, const TimerEntry &b) const
+        {
+            return a.expire > b.expire;
+        }
+    };
+
+    void push(const timer_node_ptr &node, uint64_t expire);
+
+    std::priority_queue<TimerEntry, std::vector<TimerEntry>, TimerCmp> timer_queue;
 };
@@ -0,0 +1,200 @@
+#include "upgrade.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+extern char **environ;
+
+const char *HotUpgrade::ENV_CHANNEL = "MYHTTPSERVER_UPGRADE_FD";
+
+int HotUpgrade::inheritedChannel()
+{
+    const char *value = getenv(ENV_CHANNEL);
+    if (value == NULL)
+    {
+        return -1;
+    }
+    int channel = atoi(value);
+    // 不再传给之后由本进程启动的新进程
+    unsetenv(ENV_CHANNEL);
+    if (fcntl(channel, F_GETFD) == -1)
+    {
+        return -1;
+    }
+    fcntl(channel, F_SETFD, FD_CLOEXEC);
+    return channel;
+}
+
+pid_t HotUpgrade::spawn(const std::string &exe, const std::vector<std::string> &args, int &channel)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+    {
+        LOG_ERROR << "upgrade socketpair failed, the errno is: " << errno << Log::endl;
+        return -1;
+    }
+    // fork 之后子进程只能调用异步信号安全的函数，参数和环境变量提前准备好
+    std::string env_channel = std::string(ENV_CHANNEL) + "=" + std::to_string(CHANNEL_FD);
+    std::vector<char *> argv;
+    for (auto &arg : args)
+    {
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(NULL);
+    std::vector<char *> envp;
+    size_t name_len = strlen(ENV_CHANNEL);
+    for (char **env = environ; *env; ++env)
+    {
+        if (strncmp(*env, ENV_CHANNEL, name_len) != 0 || (*env)[name_len] != '=')
+        {
+            envp.push_back(*env);
+        }
+    }
+    envp.push_back(const_cast<char *>(env_channel.c_str()));
+    envp.push_back(NULL);
+    const char *path = exe.c_str();
+    long max_fd = sysconf(_SC_OPEN_MAX);
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        LOG_ERROR << "upgrade fork failed, the errno is: " << errno << Log::endl;
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        // 子进程：通道放到 CHANNEL_FD 上，关闭继承来的其他 fd（客户端连接、epoll、日志文件等），
+        // 否则旧进程关闭连接时对端收不到 FIN
+        if (sv[1] == CHANNEL_FD)
+        {
+            fcntl(CHANNEL_FD, F_SETFD, 0);
+        }
+        else if (dup2(sv[1], CHANNEL_FD) == -1)
+        {
+            _exit(127);
+        }
+#ifdef SYS_close_range
+        if (syscall(SYS_close_range, CHANNEL_FD + 1, ~0U, 0) == -1)
+#endif
+        {
+            for (long fd = CHANNEL_FD + 1; fd < max_fd; ++fd)
+            {
+                close(fd);
+            }
+        }
+        execve(path, argv.data(), envp.data());
+        _exit(127);
+    }
+    close(sv[1]);
+    channel = sv[0];
+    return pid;
+}
+
+bool HotUpgrade::sendFds(int channel, const std::vector<int> &fds)
+{
+    if (fds.empty() || fds.size() > (size_t)MAX_FDS)
+    {
+        return false;
+    }
+    char payload = 'F';
+    iovec iov;
+    iov.iov_base = &payload;
+    iov.iov_len = 1;
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    ssize_t ret;
+    do
+    {
+        ret = sendmsg(channel, &msg, MSG_NOSIGNAL);
+    } while (ret == -1 && errno == EINTR);
+    return ret == 1;
+}
+
+bool HotUpgrade::recvFds(int channel, std::vector<int> &fds)
+{
+    char payload;
+    iovec iov;
+    iov.iov_base = &payload;
+    iov.iov_len = 1;
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * MAX_FDS));
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    ssize_t ret;
+    do
+    {
+        ret = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+    } while (ret == -1 && errno == EINTR);
+    if (ret != 1)
+    {
+        return false;
+    }
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        {
+            continue;
+        }
+        size_t number = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *data = (const int *)CMSG_DATA(cmsg);
+        fds.insert(fds.end(), data, data + number);
+    }
+    return !fds.empty() && !(msg.msg_flags & MSG_CTRUNC);
+}
+
+bool HotUpgrade::notifyReady(int channel)
+{
+    char ready = 'R';
+    return send(channel, &ready, 1, MSG_NOSIGNAL) == 1;
+}
+
+bool HotUpgrade::waitReady(int channel, int timeout)
+{
+    pollfd pfd;
+    pfd.fd = channel;
+    pfd.events = POLLIN;
+    int ret;
+    do
+    {
+        ret = poll(&pfd, 1, timeout);
+    } while (ret == -1 && errno == EINTR);
+    if (ret != 1)
+    {
+        return false;
+    }
+    char ready = 0;
+    return recv(channel, &ready, 1, 0) == 1 && ready == 'R';
+}
+
+int HotUpgrade::socketPort(int fd)
+{
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(fd, (sockaddr *)&addr, &len) == -1 || addr.sin_family != AF_INET)
+    {
+        return -1;
+    }
+    return ntohs(addr.sin_port);
+}
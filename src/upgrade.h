@@ -0,0 +1,32 @@
+#pragma once
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+/* 热升级（不停机替换可执行文件）：
+ * 1. 运行中的旧进程收到 SIGUSR2 后，创建一对 Unix socket，fork 并 exec 磁盘上当前的可执行文件，
+ *    通道的一端在新进程中固定为 fd 3，并通过环境变量告诉新进程；
+ * 2. 旧进程经 SCM_RIGHTS 把所有监听 socket 发给新进程，新进程直接使用这些 socket 而不是重新 bind，
+ *    监听队列中尚未 accept 的连接不会丢失；
+ * 3. 新进程启动完成后回复一个字节，旧进程随后停止 accept，排空已有连接后退出。
+ *    新进程没有回复就退出时升级失败，旧进程继续正常服务。 */
+class HotUpgrade
+{
+public:
+    static const int CHANNEL_FD = 3;         // 通道在新进程中的 fd
+    static const int READY_TIMEOUT = 30000;  // 等待新进程启动完成的最长时间（毫秒）
+
+    static int inheritedChannel(); // 新进程：返回热升级通道，不是由热升级启动时返回 -1
+    // 旧进程：启动新进程，返回其 pid，channel 为通道在旧进程中的一端；失败返回 -1
+    static pid_t spawn(const std::string &exe, const std::vector<std::string> &args, int &channel);
+    static bool sendFds(int channel, const std::vector<int> &fds);
+    static bool recvFds(int channel, std::vector<int> &fds);
+    static bool notifyReady(int channel);        // 新进程：告诉旧进程可以停止 accept 了
+    static bool waitReady(int channel, int timeout); // 旧进程：新进程启动失败、退出或超时返回 false
+    static int socketPort(int fd);               // 监听 socket 绑定的端口，不是 TCP socket 时返回 -1
+
+private:
+    static const char *ENV_CHANNEL;
+    static const int MAX_FDS = 64; // 一次 SCM_RIGHTS 消息最多传递的 fd 数
+};
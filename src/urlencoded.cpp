@@ -0,0 +1,85 @@
+#include "urlencoded.h"
+#include "scan.h"
+
+// 十六进制数字的值，不是十六进制数字返回 -1
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+void URLEncoded::parse(StringView input, Parameters &parameters)
+{
+    std::string name; // 在各个参数之间复用，短名字不分配堆内存
+    const char *p = input.begin();
+    const char *end = input.end();
+    while (p < end)
+    {
+        const char *amp = Scanner::findByte(p, end, '&');
+        if (amp == NULL)
+        {
+            amp = end;
+        }
+        if (amp != p)
+        {
+            const char *equal = Scanner::findByte(p, amp, '=');
+            const char *name_end = equal ? equal : amp;
+            name.clear();
+            decode(StringView(p, name_end - p), name);
+            std::string &value = parameters[name];
+            value.clear();
+            if (equal)
+            {
+                decode(StringView(equal + 1, amp - equal - 1), value);
+            }
+        }
+        p = amp + 1;
+    }
+}
+
+void URLEncoded::decode(StringView input, std::string &out)
+{
+    const char *p = input.begin();
+    const char *end = input.end();
+    out.reserve(out.size() + input.size);
+    while (p < end)
+    {
+        // 没有转义的部分整段追加
+        const char *run = p;
+        while (p < end && *p != '%' && *p != '+')
+        {
+            ++p;
+        }
+        out.append(run, p - run);
+        if (p == end)
+        {
+            break;
+        }
+        if (*p == '+')
+        {
+            out += ' ';
+            ++p;
+        }
+        else if (end - p >= 3 && hexValue(p[1]) >= 0 && hexValue(p[2]) >= 0)
+        {
+            out += (char)(hexValue(p[1]) << 4 | hexValue(p[2]));
+            p += 3;
+        }
+        else
+        {
+            out += '%';
+            ++p;
+        }
+    }
+}
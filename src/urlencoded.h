@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include "stringview.h"
+
+/* application/x-www-form-urlencoded 格式（查询字符串和表单请求体）的解码器。
+ * 一次遍历输入："&" 分隔各个参数，第一个 "=" 分隔名字和值；名字和值中的 "+" 解码为空格，
+ * "%XX" 解码为对应的字节，不完整的 "%" 序列原样保留。
+ * 没有 "=" 的参数值为空字符串，空的参数（如 "a=1&&b=2" 中间的部分）被忽略，重复的名字以最后一个为准。 */
+class URLEncoded
+{
+public:
+    typedef std::unordered_map<std::string, std::string> Parameters;
+
+    static void parse(StringView input, Parameters &parameters);
+    static void decode(StringView input, std::string &out); // 把 input 解码后追加到 out
+};
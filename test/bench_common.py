@@ -0,0 +1,230 @@
+import json
+import os
+import shutil
+import socket
+import ssl
+import subprocess
+import tempfile
+import threading
+import time
+
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def make_certificate(cert_path, key_path):
+    """用 openssl 生成自签名的证书和没有加密的私钥，命令和 ssl/README.md 中的相同。"""
+    subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "365",
+                    "-subj", "/CN=localhost", "-keyout", key_path, "-out", cert_path],
+                   check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+class ServerProcess:
+    """在临时工作目录中以覆盖后的 config.json 启动 server，结束时清理目录。"""
+
+    def __init__(self, binary, overrides=None, ready_wait=1.0):
+        self.workdir = tempfile.mkdtemp(prefix="myhttpserver_bench_")
+        with open(os.path.join(REPO_ROOT, "config.json")) as f:
+            config = json.load(f)
+        config.update(overrides or {})
+        self.config = config
+        with open(os.path.join(self.workdir, "config.json"), "w") as f:
+            json.dump(config, f, indent=4)
+        shutil.copytree(os.path.join(REPO_ROOT, "resources"), os.path.join(self.workdir, "resources"))
+        # 仓库中不保存私钥，每次在临时目录中生成一对
+        cert_path = os.path.join(self.workdir, config["cert path"])
+        key_path = os.path.join(self.workdir, config["private key path"])
+        for path in (cert_path, key_path):
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+        make_certificate(cert_path, key_path)
+        os.makedirs(os.path.join(self.workdir, "data"))
+        os.makedirs(os.path.join(self.workdir, "log"))
+        shutil.copy(os.path.join(REPO_ROOT, "data", "dbfile"), os.path.join(self.workdir, "data"))
+        self.proc = subprocess.Popen([os.path.abspath(binary)], cwd=self.workdir,
+                                     stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        time.sleep(ready_wait)
+
+    @property
+    def port(self):
+        return int(self.config["port"])
+
+    def pid(self):
+        return self.proc.pid
+
+    def stop(self):
+        self.proc.terminate()
+        try:
+            self.proc.wait(5)
+        except subprocess.TimeoutExpired:
+            self.proc.kill()
+        shutil.rmtree(self.workdir, ignore_errors=True)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.stop()
+
+
+_tls_contexts = {}
+
+
+def tls_context(max_version=None):
+    """按最高协议版本缓存客户端 SSLContext，会话只能在创建它的 SSLContext 上恢复。"""
+    if max_version not in _tls_contexts:
+        ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+        ctx.check_hostname = False
+        ctx.verify_mode = ssl.CERT_NONE
+        if max_version is not None:
+            ctx.maximum_version = max_version
+        _tls_contexts[max_version] = ctx
+    return _tls_contexts[max_version]
+
+
+def tls_connect(host, port, timeout=10.0, tls=True, session=None, max_version=None):
+    sock = socket.create_connection((host, port), timeout=timeout)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    if not tls:
+        return sock
+    return tls_context(max_version).wrap_socket(sock, session=session)
+
+
+def read_response(sock, buf=b""):
+    """读取一个完整的 HTTP 响应，返回 (状态码, 头部字典, 响应体, 剩余数据)。"""
+    while b"\r\n\r\n" not in buf:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("connection closed")
+        buf += data
+    head, buf = buf.split(b"\r\n\r\n", 1)
+    lines = head.decode("latin-1").split("\r\n")
+    status = int(lines[0].split(" ")[1])
+    headers = {}
+    for line in lines[1:]:
+        name, _, value = line.partition(":")
+        headers[name.strip().lower()] = value.strip()
+    if headers.get("transfer-encoding", "").lower() == "chunked":
+        body, rest = read_chunked(sock, buf)
+        return status, headers, body, rest
+    length = int(headers.get("content-length", "0"))
+    body = bytearray(buf)  # 大文件响应逐块追加，bytes 拼接会退化为平方复杂度
+    while len(body) < length:
+        data = sock.recv(65536)
+        if not data:
+            raise ConnectionError("connection closed")
+        body += data
+    return status, headers, bytes(body[:length]), bytes(body[length:])
+
+
+def read_chunked(sock, buf):
+    """读取分块编码的响应体，返回 (响应体, 剩余数据)。"""
+    buf = bytearray(buf)
+    body = bytearray()
+    pos = 0
+
+    def need(n):
+        while len(buf) - pos < n:
+            data = sock.recv(65536)
+            if not data:
+                raise ConnectionError("connection closed")
+            buf.extend(data)
+
+    while True:
+        while buf.find(b"\r\n", pos) < 0:
+            need(len(buf) - pos + 1)
+        end = buf.find(b"\r\n", pos)
+        size = int(bytes(buf[pos:end]).split(b";")[0], 16)
+        pos = end + 2
+        if size == 0:
+            need(2)  # 这里不发送尾部首部，最后一个块之后直接是空行
+            return bytes(body), bytes(buf[pos + 2:])
+        need(size + 2)
+        body += buf[pos:pos + size]
+        pos += size + 2
+
+
+class LoadResult:
+    def __init__(self):
+        self.ok = 0
+        self.failed = 0
+        self.bytes = 0
+        self.connects = 0
+        self.resumed = 0
+        self.latencies = []
+        self.statuses = {}
+
+    def merge(self, other):
+        self.ok += other.ok
+        self.failed += other.failed
+        self.bytes += other.bytes
+        self.connects += other.connects
+        self.resumed += other.resumed
+        self.latencies += other.latencies
+        for k, v in other.statuses.items():
+            self.statuses[k] = self.statuses.get(k, 0) + v
+
+    def percentile(self, p):
+        if not self.latencies:
+            return 0.0
+        lat = sorted(self.latencies)
+        return lat[min(len(lat) - 1, int(len(lat) * p / 100.0))]
+
+
+def run_load(host, port, clients, duration, request, tls=True, reconnect=False, resume=False, max_version=None,
+             depth=1):
+    """clients 个线程在 duration 秒内循环发送 request（bytes），每个响应读完后再发下一个。
+    resume 为 True 时，重新连接会带上该线程上一次连接的 TLS 会话以尝试会话恢复。
+    depth 大于 1 时一次发送 depth 个 request（HTTP/1.1 流水线），全部响应读完后再发下一批，延迟按批统计。"""
+    results = []
+    deadline = time.time() + duration
+
+    def worker():
+        res = LoadResult()
+        sock = None
+        session = None
+        rest = b""
+        while time.time() < deadline:
+            try:
+                if sock is None:
+                    sock = tls_connect(host, port, tls=tls, session=session if resume else None,
+                                       max_version=max_version)
+                    rest = b""
+                    res.connects += 1
+                    if tls and sock.session_reused:
+                        res.resumed += 1
+                start = time.time()
+                sock.sendall(request * depth)
+                for _ in range(depth):
+                    status, headers, body, rest = read_response(sock, rest)
+                    res.statuses[status] = res.statuses.get(status, 0) + 1
+                    res.ok += 1
+                    res.bytes += len(body)
+                res.latencies.append(time.time() - start)
+                if reconnect or headers.get("connection", "") == "close":
+                    if tls:
+                        session = sock.session
+                    sock.close()
+                    sock = None
+            except (OSError, ConnectionError, ValueError, IndexError):
+                res.failed += 1
+                if sock is not None:
+                    sock.close()
+                sock = None
+        if sock is not None:
+            sock.close()
+        results.append(res)
+
+    threads = [threading.Thread(target=worker) for _ in range(clients)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    total = LoadResult()
+    for r in results:
+        total.merge(r)
+    return total
+
+
+def report(name, result, duration):
+    print(F"{name:<28} {result.ok / duration:>10.1f} req/s  "
+          F"p50={result.percentile(50) * 1000:.2f}ms  p99={result.percentile(99) * 1000:.2f}ms  "
+          F"failed={result.failed}  statuses={result.statuses}")
@@ -0,0 +1,54 @@
+import argparse
+import os
+import random
+from bench_common import ServerProcess, run_load, report
+from read_buffer_bench import cpu_seconds
+
+
+def write_script(path, size):
+    """生成一个 size 字节左右的 JavaScript 文件，内容重复但不完全相同，接近真实的前端资源。"""
+    rng = random.Random(1)
+    words = ["function", "return", "const", "let", "this", "document", "element", "value", "length", "index",
+             "callback", "request", "response", "status", "render", "update", "state", "props", "event", "handler"]
+    lines = []
+    total = 0
+    while total < size:
+        line = "    %s.%s_%d = %s(%d, \"%s\");\n" % (rng.choice(words), rng.choice(words), rng.randint(0, 999),
+                                                   rng.choice(words), rng.randint(0, 99999), rng.choice(words))
+        lines.append(line)
+        total += len(line)
+    with open(path, "w") as f:
+        f.write("".join(lines))
+
+
+# 文本类的响应压缩后传输的字节数通常只有原来的 1/3 到 1/5。比较不压缩、gzip 和 brotli 时每个响应的
+# 响应体字节数和服务器每个请求消耗的 CPU 时间：静态文件的压缩版本在缓存中只生成一次，
+# CGI 生成的网页（登录失败返回的首页）每次压缩
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="response compression: bytes on the wire and cpu per request.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("-s", "--size", type=int, default=64, help="size of the generated script in KB.")
+    parser.add_argument("-c", "--clients", type=int, default=8, help="concurrent clients.")
+    parser.add_argument("-t", "--time", type=int, default=8, help="seconds per run.")
+    args = parser.parse_args()
+
+    form = "username=nobody&passwd=x&type=login"
+    targets = [("/index.html", "GET /index.html HTTP/1.1\r\n"),
+               (F"/app.js ({args.size} KB)", "GET /app.js HTTP/1.1\r\n"),
+               ("CGI login", F"POST /login.action HTTP/1.1\r\nContent-Length: {len(form)}\r\n")]
+    encodings = [("identity", ""), ("gzip", "Accept-Encoding: gzip\r\n"), ("br", "Accept-Encoding: br\r\n")]
+    overrides = {"http port": args.http_port, "admission queue wait": 0}
+    with ServerProcess(args.binary, overrides) as server:
+        write_script(os.path.join(server.workdir, "resources", "app.js"), args.size << 10)
+        for target, line in targets:
+            print(target)
+            for name, header in encodings:
+                request = (line + "Host: 127.0.0.1\r\nConnection: keep-alive\r\n" + header + "\r\n" +
+                           (form if line.startswith("POST") else "")).encode()
+                cpu = cpu_seconds(server.pid())
+                result = run_load("127.0.0.1", args.http_port, args.clients, args.time, request, tls=False)
+                cpu = cpu_seconds(server.pid()) - cpu
+                report(F"    {name}", result, args.time)
+                print(F"    {'':<28} {result.bytes / max(result.ok, 1):>10.0f} body bytes/response  "
+                      F"{cpu * 1e6 / max(result.ok, 1):.1f} us cpu/request")
@@ -0,0 +1,38 @@
+import argparse
+import socket
+from bench_common import ServerProcess, run_load, report, read_response
+
+
+def validators(port, path):
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.sendall(F"GET {path} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n".encode())
+    status, headers, body, _ = read_response(sock)
+    sock.close()
+    return headers.get("etag"), headers.get("last-modified"), len(body)
+
+
+# 浏览器再次访问页面时带上次响应的验证器重新验证。比较无条件 GET、带 If-None-Match 和
+# 带 If-Modified-Since 的 GET 的吞吐量，以及每个响应传输的字节数（304 没有响应体）
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="conditional GET vs unconditional GET.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("-c", "--clients", type=int, default=16, help="concurrent clients.")
+    parser.add_argument("-t", "--time", type=int, default=10, help="seconds per run.")
+    parser.add_argument("--paths", type=str, default="/index.html,/images/toto_portrait.jpeg",
+                        help="files to request.")
+    args = parser.parse_args()
+
+    overrides = {"http port": args.http_port, "admission queue wait": 0}
+    with ServerProcess(args.binary, overrides) as server:
+        for path in args.paths.split(","):
+            etag, last_modified, size = validators(args.http_port, path)
+            base = F"GET {path} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n"
+            cases = [("unconditional", ""),
+                     ("If-None-Match", F"If-None-Match: {etag}\r\n"),
+                     ("If-Modified-Since", F"If-Modified-Since: {last_modified}\r\n")]
+            print(F"{path}: {size} bytes, ETag {etag}")
+            for name, header in cases:
+                request = (base + header + "\r\n").encode()
+                result = run_load("127.0.0.1", args.http_port, args.clients, args.time, request, tls=False)
+                report(F"    {name}", result, args.time)
@@ -0,0 +1,69 @@
+import argparse
+import resource
+import socket
+from bench_common import ServerProcess, tls_context, read_response
+
+
+def rss_kb(pid):
+    with open(F"/proc/{pid}/status") as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+def fetch_stats(port):
+    sock = socket.create_connection(("127.0.0.1", port))
+    sock.sendall(b"GET /stats HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n")
+    body = read_response(sock)[2].decode()
+    sock.close()
+    return dict(line.split(" ", 1) for line in body.splitlines() if " " in line)
+
+
+def open_idle(port, number, tls):
+    """建立 number 个完成过一次请求的 keep-alive 连接。源地址在 127.0.0.x 之间轮换以避免耗尽临时端口。"""
+    request = b"GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n"
+    conns = []
+    for i in range(number):
+        source = F"127.0.{(i // 20000) % 256}.{i // 20000 // 256 + 1}"
+        sock = socket.create_connection(("127.0.0.1", port), source_address=(source, 0))
+        if tls:
+            sock = tls_context().wrap_socket(sock)
+        sock.sendall(request)
+        read_response(sock)
+        conns.append(sock)
+    return conns
+
+
+# 统计 N 个空闲 keep-alive 连接时每个连接占用的服务端内存（VmRSS 增量 / N），
+# 并与按最大 fd 预先分配整个连接数组的方式比较。需要足够大的 RLIMIT_NOFILE（客户端和服务端各 N 个 fd）
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="per-connection memory report.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-n", "--numbers", type=str, default="10000,100000", help="connection numbers.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("--tls", action="store_true", help="use https connections instead of plain http.")
+    args = parser.parse_args()
+
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+    for number in [int(n) for n in args.numbers.split(",")]:
+        if number * 2 + 256 > hard:
+            print(F"connections={number}: skipped, RLIMIT_NOFILE hard limit {hard} is too small.")
+            continue
+        overrides = {"http port": args.http_port, "max http connection": number + 64,
+                     "max events": number + 64, "http timeout": 3600}
+        with ServerProcess(args.binary, overrides) as server:
+            before = rss_kb(server.pid())
+            conns = open_idle(server.port if args.tls else args.http_port, number, args.tls)
+            during = rss_kb(server.pid())
+            stats = fetch_stats(args.http_port)
+            for sock in conns:
+                sock.close()
+            slot_bytes = int(stats["conn_slot_bytes"])
+            print(F"connections={number} ({'https' if args.tls else 'http'})")
+            print(F"    rss {before} KB -> {during} KB, {(during - before) * 1024 / number:.0f} bytes per connection")
+            print(F"    slots allocated {stats['conn_slots']}, {slot_bytes} bytes per slot "
+                  F"({int(stats['conn_slots']) * slot_bytes // 1024} KB)")
+            print(F"    a table preallocated for {overrides['max http connection']} fds would take "
+                  F"{overrides['max http connection'] * slot_bytes // 1024} KB up front")
@@ -0,0 +1,30 @@
+import argparse
+from bench_common import ServerProcess, run_load, report
+from conn_memory_report import fetch_stats
+
+
+def request(path):
+    return F"GET {path} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n".encode()
+
+
+# 比较不使用缓存（每个请求 stat()、open()、read()）和使用静态文件缓存时的吞吐量和延迟，
+# 使用缓存时从 /stats 读取命中次数，检查请求确实由缓存提供
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="static file throughput with and without the file cache.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("-c", "--clients", type=int, default=16, help="concurrent clients.")
+    parser.add_argument("-t", "--time", type=int, default=10, help="seconds per run.")
+    parser.add_argument("--paths", type=str, default="/index.html,/images/toto_portrait.jpeg",
+                        help="files to request.")
+    args = parser.parse_args()
+
+    for path in args.paths.split(","):
+        for cache_size in [0, 64]:
+            overrides = {"http port": args.http_port, "file cache size": cache_size, "admission queue wait": 0}
+            with ServerProcess(args.binary, overrides) as server:
+                result = run_load("127.0.0.1", args.http_port, args.clients, args.time, request(path), tls=False)
+                stats = fetch_stats(args.http_port)
+                report(F"{path} file cache {cache_size}MB", result, args.time)
+                print(F"    file_cache_hits {stats.get('file_cache_hits')}, "
+                      F"file_cache_misses {stats.get('file_cache_misses')}")
@@ -0,0 +1,45 @@
+import argparse
+import os
+from bench_common import ServerProcess, tls_connect, read_response, run_load, report
+
+
+def cpu_seconds(pid):
+    """进程累计的用户态和内核态 CPU 时间（秒）。"""
+    with open(F"/proc/{pid}/stat") as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+def fetch(port, url):
+    sock = tls_connect("127.0.0.1", port)
+    sock.sendall(F"GET {url} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n".encode())
+    body = read_response(sock)[2].decode()
+    sock.close()
+    return body
+
+
+# 对比开启和关闭内核 TLS（SSL_sendfile）时下载大文件的吞吐量以及服务端每 GB 消耗的 CPU 时间
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="ktls sendfile bench.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-t", "--benchtime", type=float, default=10.0, help="bench time of each round.")
+    parser.add_argument("-c", "--clients", type=int, default=8, help="number of clients.")
+    parser.add_argument("-s", "--size", type=int, default=64, help="file size in MB.")
+    args = parser.parse_args()
+
+    url = "/ktls_bench.bin"
+    request = F"GET {url} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n".encode()
+    for ktls in [False, True]:
+        with ServerProcess(args.binary, {"ktls": ktls}) as server:
+            with open(os.path.join(server.workdir, "resources", url[1:]), "wb") as f:
+                f.write(os.urandom(args.size * 1024 * 1024))
+            cpu_start = cpu_seconds(server.pid())
+            result = run_load("127.0.0.1", server.port, args.clients, args.benchtime, request)
+            cpu = cpu_seconds(server.pid()) - cpu_start
+            report(F"ktls={ktls}", result, args.benchtime)
+            gb = result.bytes / 1024 ** 3
+            print(F"    {gb * 1024 / args.benchtime:.1f} MB/s, server cpu {cpu / gb if gb else 0:.2f} s/GB")
+            stats = fetch(server.port, "/stats")
+            for line in stats.splitlines():
+                if line.startswith(("ktls_connections", "sendfile_bytes")):
+                    print("    " + line)
@@ -0,0 +1,128 @@
+import argparse
+import os
+import queue
+import threading
+import time
+from bench_common import ServerProcess, LoadResult, tls_connect, read_response, run_load, report
+
+REQUEST = b"GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n"
+
+
+CGROUP = "/sys/fs/cgroup/cpu/myhttpserver_bench"
+
+
+def limit_cpu(pid, percent):
+    """用 cgroup v1 的 CFS 配额把 server 限制在 percent% 个 CPU 内（需要 root）。
+    客户端和 server 在同一台机器上时，否则瓶颈往往是 Python 客户端，server 永远不会过载。"""
+    os.makedirs(CGROUP, exist_ok=True)
+    period = 10000  # 较短的周期避免配额用完后被长时间挂起
+    with open(os.path.join(CGROUP, "cpu.cfs_period_us"), "w") as f:
+        f.write(str(period))
+    with open(os.path.join(CGROUP, "cpu.cfs_quota_us"), "w") as f:
+        f.write(str(period * percent // 100))
+    for tid in os.listdir(F"/proc/{pid}/task"):
+        with open(os.path.join(CGROUP, "tasks"), "w") as f:
+            f.write(tid)
+
+
+def one_shot(port, tls, result, scheduled):
+    """新工作：每个请求使用一个新连接，延迟从计划发出的时间算起（开环，包含客户端排队时间）。"""
+    try:
+        sock = tls_connect("127.0.0.1", port, tls=tls)
+        try:
+            sock.sendall(REQUEST)
+            status, headers, body, rest = read_response(sock)
+        finally:
+            sock.close()
+        result.latencies.append(time.time() - scheduled)
+        result.statuses[status] = result.statuses.get(status, 0) + 1
+        result.ok += 1
+    except (OSError, ConnectionError, ValueError, IndexError):
+        result.failed += 1
+
+
+def open_loop(port, tls, rate, duration, workers):
+    """按固定速率 rate（请求/秒）发起新连接上的请求，不等待之前的请求完成。"""
+    tasks = queue.Queue()
+    results = [LoadResult() for _ in range(workers)]
+
+    def worker(result):
+        while True:
+            scheduled = tasks.get()
+            if scheduled is None:
+                return
+            one_shot(port, tls, result, scheduled)
+
+    threads = [threading.Thread(target=worker, args=(r,)) for r in results]
+    for t in threads:
+        t.start()
+    start = time.time()
+    total = int(rate * duration)
+    for i in range(total):
+        scheduled = start + i / rate
+        delay = scheduled - time.time()
+        if delay > 0:
+            time.sleep(delay)
+        tasks.put(scheduled)
+    for _ in threads:
+        tasks.put(None)
+    for t in threads:
+        t.join()
+    merged = LoadResult()
+    for r in results:
+        merged.merge(r)
+    return merged
+
+
+def capacity(port, tls, clients, duration):
+    """闭环测得的新连接请求吞吐量。"""
+    results = [LoadResult() for _ in range(clients)]
+    deadline = time.time() + duration
+
+    def worker(result):
+        while time.time() < deadline:
+            one_shot(port, tls, result, time.time())
+
+    threads = [threading.Thread(target=worker, args=(r,)) for r in results]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return sum(r.ok for r in results) / duration
+
+
+# 先用闭环负载测出新连接请求的处理能力，再以其 overload 倍的速率开环发起新连接请求，
+# 同时保持若干个 keep-alive 会话（已有的工作）。对比开启和关闭准入控制时两类请求的 p99 延迟
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="admission control under overload.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-t", "--benchtime", type=float, default=10.0, help="bench time of each round.")
+    parser.add_argument("-c", "--clients", type=int, default=16, help="closed loop clients for capacity.")
+    parser.add_argument("-w", "--workers", type=int, default=256, help="open loop client threads.")
+    parser.add_argument("-k", "--sessions", type=int, default=4, help="keep-alive sessions.")
+    parser.add_argument("-o", "--overload", type=float, default=2.0, help="offered load / capacity.")
+    parser.add_argument("--threads", type=int, default=1, help="server thread number.")
+    parser.add_argument("--tls", action="store_true", help="use https instead of plain http.")
+    parser.add_argument("--cpu", type=int, default=0, help="limit the server to this percent of a CPU.")
+    args = parser.parse_args()
+
+    rounds = [("admission on", {}),
+              ("admission off", {"admission queue depth": 0, "admission queue wait": 0})]
+    for name, overrides in rounds:
+        overrides.update({"http port": 10087, "thread number": args.threads, "tls handshake offload": True})
+        with ServerProcess(args.binary, overrides) as server:
+            if args.cpu:
+                limit_cpu(server.pid(), args.cpu)
+            port = server.port if args.tls else 10087
+            rate = capacity(port, args.tls, args.clients, args.benchtime / 2) * args.overload
+            sessions = {}
+            t = threading.Thread(target=lambda: sessions.update(
+                result=run_load("127.0.0.1", port, args.sessions, args.benchtime, REQUEST, tls=args.tls)))
+            t.start()
+            new = open_loop(port, args.tls, rate, args.benchtime, args.workers)
+            t.join()
+            print(F"{name}: offered {rate:.0f} new req/s ({args.overload}x capacity)")
+            report("    new connections", new, args.benchtime)
+            report("    keep-alive sessions", sessions["result"], args.benchtime)
+    if os.path.isdir(CGROUP):
+        os.rmdir(CGROUP)
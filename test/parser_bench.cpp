@@ -0,0 +1,470 @@
+// 请求解析的微基准：统计解析一个请求的堆分配次数和耗时。
+// 编译运行（在仓库根目录）：
+//     g++ -O2 -std=c++11 -Isrc test/parser_bench.cpp src/httpparser.cpp src/httptoken.cpp src/readbuffer.cpp src/scan.cpp src/urlencoded.cpp -o parser_bench && ./parser_bench
+// "copy" 是改用 HTTPParser 之前的做法：substr 出方法、URL、协议和每个首部，再放进 unordered_map；
+// "view" 是 HTTPParser，首部只记录在读缓冲区中的位置。两者都在同一个对象上反复解析，和连接上的 keep-alive 请求一样。
+// HTTPParser 依次使用 CPU 支持的每一种分隔符查找内核（scalar、sse2、avx2）各测一次，
+// 计时之前先用随机数据检查各个内核的结果和标量实现一致。
+// 解析之后对比首部查找："map" 是在 CopyParser 的 unordered_map 中按名字查找连接用到的几个首部，
+// "name" 是 HTTPParser 按名字查找（先经过完美散列得到 HEADER_ID），"slot" 直接按 HEADER_ID 读取固定槽位；
+// 方法名对比改用 HTTPToken 之前的 if/else 链（"chain"）和完美散列（"hash"）。
+// 最后对比查询字符串和登录表单的解析："regex" 是改用 URLEncoded 之前基于 std::regex 的 parseParameters，"form" 是 URLEncoded
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <algorithm>
+#include <new>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "httpparser.h"
+#include "scan.h"
+#include "urlencoded.h"
+
+static size_t g_allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++g_allocations;
+    void *p = malloc(size ? size : 1);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+// 带有长 Cookie 和 User-Agent 的请求，分隔符之间的距离较长
+static std::string largeRequest(size_t cookie_size)
+{
+    std::string request = "GET /index.html?from=search&q=http+server HTTP/1.1\r\n"
+                          "Host: www.example.com:10086\r\n"
+                          "Connection: keep-alive\r\n"
+                          "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) "
+                          "Chrome/118.0.0.0 Safari/537.36 Edg/118.0.2088.76 (compatible; ExampleToolbar 12.4.1; "
+                          "+https://www.example.com/toolbar/help/compatibility)\r\n"
+                          "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+                          "image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+                          "Accept-Encoding: gzip, deflate, br\r\n"
+                          "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8,en-GB;q=0.7,en-US;q=0.6\r\n"
+                          "Cookie: ";
+    for (size_t i = 0; request.size() < cookie_size + 600; ++i)
+    {
+        request += "_ga_" + std::to_string(i) + "=GS1.1.1697612345.12.1.1697612399.0.0.0; ";
+    }
+    request += "session=0123456789abcdef0123456789abcdef\r\n"
+               "Referer: https://www.example.com:10086/index.html\r\n"
+               "\r\n";
+    return request;
+}
+
+// 随机数据中 CR、LF、':'、' ' 出现得较多，覆盖跨越 16/32 字节边界的情况
+static void checkKernels()
+{
+    const char alphabet[] = "\r\n: ab";
+    srand(1);
+    for (int round = 0; round < 20000; ++round)
+    {
+        std::string buf(rand() % 200, 'x');
+        for (size_t i = 0; i < buf.size(); ++i)
+        {
+            buf[i] = rand() % 4 ? 'x' : alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        const char *begin = buf.data() + (buf.empty() ? 0 : rand() % buf.size());
+        const char *end = buf.data() + buf.size();
+        Scanner::setLevel(Scanner::SCALAR);
+        const char *crlf = Scanner::findCRLF(begin, end);
+        const char *colon = Scanner::findByte(begin, end, ':');
+        for (int level = Scanner::SSE2; level <= Scanner::detect(); ++level)
+        {
+            Scanner::setLevel((Scanner::Level)level);
+            if (Scanner::findCRLF(begin, end) != crlf || Scanner::findByte(begin, end, ':') != colon)
+            {
+                fprintf(stderr, "%s kernel differs from scalar\n", Scanner::levelName((Scanner::Level)level));
+                exit(1);
+            }
+        }
+    }
+    Scanner::setLevel(Scanner::detect());
+}
+
+static const char *REQUESTS[] = {
+    "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n",
+    "GET /images/toto_portrait.jpeg HTTP/1.1\r\n"
+    "Host: www.example.com:10086\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Referer: https://www.example.com:10086/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef\r\n"
+    "\r\n",
+};
+
+// 改用 HTTPParser 之前 HTTPConnection 中的解析方式
+struct CopyParser
+{
+    std::string method;
+    std::string url;
+    std::string protocol;
+    std::unordered_map<std::string, std::string> headers;
+    int content_length;
+    bool linger;
+
+    bool parse(const std::string &buf)
+    {
+        method.clear();
+        url.clear();
+        protocol.clear();
+        headers.clear();
+        content_length = 0;
+        linger = false;
+        size_t pos = 0;
+        size_t enter_pos = buf.find("\r\n", pos);
+        size_t space_pos = buf.find(' ', pos);
+        if (enter_pos == buf.npos || space_pos == buf.npos)
+        {
+            return false;
+        }
+        method = buf.substr(pos, space_pos - pos);
+        pos = space_pos + 1;
+        space_pos = buf.find(' ', pos);
+        url = buf.substr(pos, space_pos - pos);
+        pos = space_pos + 1;
+        protocol = buf.substr(pos, enter_pos - pos);
+        pos = enter_pos + 2;
+        while ((enter_pos = buf.find("\r\n", pos)) != buf.npos && enter_pos != pos)
+        {
+            size_t tmp_pos = buf.find(": ", pos);
+            std::string name = buf.substr(pos, tmp_pos - pos);
+            std::string value = buf.substr(tmp_pos + 2, enter_pos - tmp_pos - 2);
+            headers.emplace(name, value);
+            if (name == "Content-Length")
+            {
+                content_length = atoi(value.c_str());
+            }
+            if (name == "Connection" && value == "keep-alive")
+            {
+                linger = true;
+            }
+            pos = enter_pos + 2;
+        }
+        return true;
+    }
+};
+
+struct ViewParser
+{
+    ReadBuffer buf;
+    HTTPParser parser;
+
+    ViewParser() : parser(buf) {}
+
+    bool parse(const std::string &request)
+    {
+        // 相当于把 socket 中的数据读入连接的读缓冲区，容量复用
+        buf.clear();
+        buf.append(request.data(), request.size());
+        parser.reset();
+        int pos = 0;
+        return parser.parseRequestLine(pos) == LINE_OK && parser.parseHeaders(pos) == LINE_OK;
+    }
+};
+
+// 只查找分隔符：把请求切分成行并找到每行的冒号，不包含复制请求和记录首部的开销
+struct ScanOnly
+{
+    size_t found;
+
+    bool parse(const std::string &request)
+    {
+        const char *p = request.data();
+        const char *end = p + request.size();
+        const char *enter;
+        found = 0;
+        while ((enter = Scanner::findCRLF(p, end)) != NULL && enter != p)
+        {
+            found += Scanner::findByte(p, enter, ':') != NULL;
+            p = enter + 2;
+        }
+        return enter != NULL;
+    }
+};
+
+static const char *LOOKUP_NAMES[] = {"Content-Length", "Content-Type", "Connection", "Host", "Cookie", "Range"};
+static const HEADER_ID LOOKUP_IDS[] = {HEADER_CONTENT_LENGTH, HEADER_CONTENT_TYPE, HEADER_CONNECTION, HEADER_HOST,
+                                       HEADER_COOKIE, HEADER_RANGE};
+static const size_t LOOKUPS = sizeof(LOOKUP_IDS) / sizeof(LOOKUP_IDS[0]);
+
+// 首部查找的基准只在请求变化时解析一次，之后每次只做查找
+template <typename Parser>
+struct Lookup
+{
+    Parser parser;
+    const std::string *parsed;
+    size_t found;
+
+    Lookup() : parsed(NULL), found(0) {}
+
+    bool prepare(const std::string &request)
+    {
+        if (parsed != &request)
+        {
+            parsed = &request;
+            return parser.parse(request);
+        }
+        return true;
+    }
+};
+
+struct MapLookup : Lookup<CopyParser>
+{
+    bool parse(const std::string &request)
+    {
+        if (!prepare(request))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < LOOKUPS; ++i)
+        {
+            auto iter = parser.headers.find(LOOKUP_NAMES[i]);
+            found += iter != parser.headers.end() ? iter->second.size() : 0;
+        }
+        return true;
+    }
+};
+
+struct NameLookup : Lookup<ViewParser>
+{
+    bool parse(const std::string &request)
+    {
+        if (!prepare(request))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < LOOKUPS; ++i)
+        {
+            found += parser.parser.header(LOOKUP_NAMES[i]).size;
+        }
+        return true;
+    }
+};
+
+struct SlotLookup : Lookup<ViewParser>
+{
+    bool parse(const std::string &request)
+    {
+        if (!prepare(request))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < LOOKUPS; ++i)
+        {
+            found += parser.parser.header(LOOKUP_IDS[i]).size;
+        }
+        return true;
+    }
+};
+
+static const char *METHOD_TOKENS[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"};
+static const size_t METHOD_TOKEN_COUNT = sizeof(METHOD_TOKENS) / sizeof(METHOD_TOKENS[0]);
+
+// 改用 HTTPToken 之前 HTTPParser::readMethod 的做法
+static bool chainMethod(StringView token, METHOD &method)
+{
+    if (token == "GET")
+    {
+        method = GET;
+    }
+    else if (token == "POST")
+    {
+        method = POST;
+    }
+    else if (token == "HEAD")
+    {
+        method = HEAD;
+    }
+    else if (token == "PUT")
+    {
+        method = PUT;
+    }
+    else if (token == "DELETE")
+    {
+        method = DELETE;
+    }
+    else if (token == "TRACE")
+    {
+        method = TRACE;
+    }
+    else if (token == "OPTIONS")
+    {
+        method = OPTIONS;
+    }
+    else if (token == "CONNECT")
+    {
+        method = CONNECT;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// 每次识别所有方法名和一个未知的方法名，统计的是识别一轮的耗时
+template <bool (*Match)(StringView, METHOD &)>
+struct MethodLookup
+{
+    std::vector<StringView> tokens;
+    size_t found;
+
+    MethodLookup() : tokens(METHOD_TOKENS, METHOD_TOKENS + METHOD_TOKEN_COUNT), found(0) {}
+
+    bool parse(const std::string &)
+    {
+        // 告诉编译器 tokens 可能被修改，否则内联后的 if/else 链会被整个提到计时循环之外
+        asm volatile("" : : "r"(tokens.data()) : "memory");
+        METHOD method;
+        for (size_t i = 0; i < tokens.size(); ++i)
+        {
+            found += Match(tokens[i], method) ? method : 0;
+        }
+        return true;
+    }
+};
+
+static const char *FORMS[] = {
+    "username=toto&passwd=123456&type=login",
+    "q=http+server&from=search&lang=zh-CN&page=2&utm_source=%E6%90%9C%E7%B4%A2&utm_medium=cpc&empty=&flag",
+};
+
+// 改用 URLEncoded 之前 HTTPConnection::parseParameters 的做法，不做百分号解码
+struct RegexForm
+{
+    std::unordered_map<std::string, std::string> parameters;
+
+    bool parse(const std::string &str)
+    {
+        parameters.clear();
+        std::vector<std::string> name;
+        std::vector<std::string> value;
+        std::smatch result;
+        std::regex findStartParameter("(.*?)=(.*?)&");
+        std::regex_search(str, result, findStartParameter);
+        name.push_back(result.str(1));
+        std::regex findParameterName("&(.*?)=");
+        std::sregex_iterator iter(str.begin(), str.end(), findParameterName);
+        std::sregex_iterator end;
+        for (; iter != end; iter++)
+        {
+            name.push_back((*iter).str(1));
+        }
+        std::regex findParameterValue("=(.*?)&");
+        std::sregex_iterator iter1(str.begin(), str.end(), findParameterValue);
+        for (; iter1 != end; iter1++)
+        {
+            value.push_back((*iter1).str(1));
+        }
+        std::string reverse_str = str;
+        std::reverse(reverse_str.begin(), reverse_str.end());
+        std::regex findParameterLastValue("^(.*?)=");
+        regex_search(reverse_str, result, findParameterLastValue);
+        std::string lastValue = result.str(1);
+        std::reverse(lastValue.begin(), lastValue.end());
+        value.push_back(lastValue);
+        for (size_t i = 0; i < name.size() && i < value.size(); i++)
+        {
+            parameters[name[i]] = value[i];
+        }
+        return true;
+    }
+};
+
+struct Form
+{
+    URLEncoded::Parameters parameters;
+
+    bool parse(const std::string &str)
+    {
+        parameters.clear(); // 和连接的 init() 一样，每个请求清空参数表
+        URLEncoded::parse(str, parameters);
+        return !parameters.empty();
+    }
+};
+
+template <typename Parser>
+static void bench(const std::string &name, const std::string &request, int iterations)
+{
+    Parser parser;
+    parser.parse(request); // 预热，让可复用的容量分配好
+    size_t allocations = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        if (!parser.parse(request))
+        {
+            fprintf(stderr, "parse failed\n");
+            exit(1);
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    allocations = g_allocations - allocations;
+    printf("    %-12s %8.1f ns/request %8.2f allocations/request\n", name.c_str(),
+           (double)elapsed.count() / iterations, (double)allocations / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    checkKernels();
+    std::vector<std::string> requests(REQUESTS, REQUESTS + sizeof(REQUESTS) / sizeof(REQUESTS[0]));
+    requests.push_back(largeRequest(1024));
+    requests.push_back(largeRequest(4096));
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        printf("request %zu (%zu bytes)\n", i, requests[i].size());
+        bench<CopyParser>("copy", requests[i], iterations);
+        for (int level = Scanner::SCALAR; level <= Scanner::detect(); ++level)
+        {
+            Scanner::setLevel((Scanner::Level)level);
+            bench<ViewParser>(std::string("view ") + Scanner::levelName((Scanner::Level)level), requests[i], iterations);
+        }
+        for (int level = Scanner::SCALAR; level <= Scanner::detect(); ++level)
+        {
+            Scanner::setLevel((Scanner::Level)level);
+            bench<ScanOnly>(std::string("scan ") + Scanner::levelName((Scanner::Level)level), requests[i], iterations);
+        }
+        Scanner::setLevel(Scanner::detect());
+    }
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        printf("request %zu: look up %zu headers\n", i, LOOKUPS);
+        bench<MapLookup>("map", requests[i], iterations);
+        bench<NameLookup>("name", requests[i], iterations);
+        bench<SlotLookup>("slot", requests[i], iterations);
+    }
+    printf("methods: match %zu tokens\n", METHOD_TOKEN_COUNT);
+    bench<MethodLookup<chainMethod> >("chain", "", iterations);
+    bench<MethodLookup<HTTPToken::method> >("hash", "", iterations);
+    for (size_t i = 0; i < sizeof(FORMS) / sizeof(FORMS[0]); ++i)
+    {
+        std::string form(FORMS[i]);
+        printf("form %zu (%zu bytes)\n", i, form.size());
+        bench<RegexForm>("regex", form, iterations / 20);
+        bench<Form>("form", form, iterations);
+    }
+    return 0;
+}
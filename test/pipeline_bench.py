@@ -0,0 +1,21 @@
+import argparse
+from bench_common import ServerProcess, run_load, report
+
+# 每个客户端一次发送 depth 个请求（HTTP/1.1 流水线），对比不同流水线深度下的吞吐量。
+# server 依次处理读缓冲区中的所有完整请求，响应合并到一次写中发送
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="http pipelining bench.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-t", "--benchtime", type=float, default=10.0, help="bench time of each round.")
+    parser.add_argument("-c", "--clients", type=int, default=16, help="number of clients.")
+    parser.add_argument("-d", "--depths", type=str, default="1,4,16", help="pipeline depths.")
+    parser.add_argument("-u", "--url", type=str, default="/index.html", help="requested url.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    args = parser.parse_args()
+
+    request = F"GET {args.url} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n".encode()
+    with ServerProcess(args.binary, {"http port": args.http_port}) as server:
+        for name, port, tls in [("https", server.port, True), ("http", args.http_port, False)]:
+            for depth in [int(d) for d in args.depths.split(",")]:
+                result = run_load("127.0.0.1", port, args.clients, args.benchtime, request, tls=tls, depth=depth)
+                report(F"{name} depth={depth}", result, args.benchtime)
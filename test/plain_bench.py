@@ -0,0 +1,24 @@
+import argparse
+import os
+from bench_common import ServerProcess, run_load, report
+
+# 同一个 server 同时监听 HTTPS 和明文 HTTP 端口，对比两个端口上下载同一文件的吞吐量；
+# 明文端口上的静态文件通过 sendfile 发送
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="plain http vs https bench.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-t", "--benchtime", type=float, default=10.0, help="bench time of each round.")
+    parser.add_argument("-c", "--clients", type=int, default=16, help="number of clients.")
+    parser.add_argument("-s", "--size", type=int, default=1024, help="file size in KB.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    args = parser.parse_args()
+
+    url = "/plain_bench.bin"
+    request = F"GET {url} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n".encode()
+    with ServerProcess(args.binary, {"http port": args.http_port}) as server:
+        with open(os.path.join(server.workdir, "resources", url[1:]), "wb") as f:
+            f.write(os.urandom(args.size * 1024))
+        for name, port, tls in [("https", server.port, True), ("http", args.http_port, False)]:
+            result = run_load("127.0.0.1", port, args.clients, args.benchtime, request, tls=tls)
+            report(name, result, args.benchtime)
+            print(F"    {result.bytes / 1024 ** 2 / args.benchtime:.1f} MB/s")
@@ -0,0 +1,36 @@
+import argparse
+import shutil
+import subprocess
+from bench_common import ServerProcess, run_load, report
+
+# 对比 epoll 和 io_uring 两种事件后端的吞吐量；安装了 strace 时同时统计服务端的系统调用次数
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="io backend bench.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-t", "--benchtime", type=float, default=10.0, help="bench time of each round.")
+    parser.add_argument("-c", "--clients", type=int, default=64, help="number of clients.")
+    parser.add_argument("-r", "--reactors", type=int, default=0, help="reactor number.")
+    parser.add_argument("-u", "--url", type=str, default="/index.html", help="url.")
+    args = parser.parse_args()
+
+    request = F"GET {args.url} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n".encode()
+    strace = shutil.which("strace")
+    for backend in ["epoll", "io_uring"]:
+        with ServerProcess(args.binary, {"io backend": backend, "reactor number": args.reactors}) as server:
+            tracer = None
+            if strace:
+                tracer = subprocess.Popen([strace, "-f", "-c", "-p", str(server.pid())],
+                                          stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+            result = run_load("127.0.0.1", server.port, args.clients, args.benchtime, request)
+            report(F"backend={backend}", result, args.benchtime)
+            if tracer:
+                tracer.terminate()
+                summary = tracer.communicate()[1]
+                for line in summary.splitlines():
+                    if any(name in line for name in ("epoll", "io_uring", "accept", "read", "write", "total")):
+                        print("    " + line)
+                if result.ok:
+                    total = summary.strip().splitlines()[-1].split()
+                    print(F"    syscalls per request: {int(total[3]) / result.ok:.2f}")
+    if not strace:
+        print("strace not found, syscall counts are skipped.")
@@ -0,0 +1,31 @@
+import argparse
+import os
+from bench_common import ServerProcess, run_load, report
+
+
+# 续传和拖动播放进度时客户端只需要文件的一部分。比较下载一个大文件（不在文件缓存中，从 sendfile 发送）的
+# 完整 GET、只取最后 10% 的续传请求、一个 64 KB 的单范围请求和一个三段的 multipart/byteranges 请求
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="range requests vs full downloads.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("-s", "--size", type=int, default=16, help="file size in MB.")
+    parser.add_argument("-c", "--clients", type=int, default=8, help="concurrent clients.")
+    parser.add_argument("-t", "--time", type=int, default=8, help="seconds per run.")
+    args = parser.parse_args()
+
+    size = args.size << 20
+    middle = size // 2
+    cases = [("full file", ""),
+             ("resume last 10%", F"Range: bytes={size - size // 10}-\r\n"),
+             ("seek 64 KB", F"Range: bytes={middle}-{middle + 65535}\r\n"),
+             ("3 x 16 KB multipart", F"Range: bytes=0-16383,{middle}-{middle + 16383},-16384\r\n")]
+    overrides = {"http port": args.http_port, "admission queue wait": 0}
+    with ServerProcess(args.binary, overrides) as server:
+        with open(os.path.join(server.workdir, "resources", "video.bin"), "wb") as f:
+            f.write(os.urandom(size))
+        for name, header in cases:
+            request = ("GET /video.bin HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n" + header +
+                       "\r\n").encode()
+            result = run_load("127.0.0.1", args.http_port, args.clients, args.time, request, tls=False)
+            report(name, result, args.time)
@@ -0,0 +1,28 @@
+import argparse
+from bench_common import ServerProcess, run_load, report
+
+# 对比不同从 Reactor 数量下的吞吐量，0 表示单 Reactor 模式；
+# 使用 --reuseport 时改为对比不同数量的 SO_REUSEPORT 工作线程
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="reactor scaling bench.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-t", "--benchtime", type=float, default=10.0, help="bench time of each round.")
+    parser.add_argument("-c", "--clients", type=int, default=64, help="number of clients.")
+    parser.add_argument("-r", "--reactors", type=str, default="0,1,2,4,8",
+                        help="comma separated reactor numbers.")
+    parser.add_argument("-d", "--dispatch", type=str, default="round robin",
+                        help="\"round robin\" or \"least loaded\".")
+    parser.add_argument("--reuseport", action="store_true", help="bench SO_REUSEPORT workers instead.")
+    parser.add_argument("--pin", action="store_true", help="pin each SO_REUSEPORT worker to a cpu.")
+    parser.add_argument("-u", "--url", type=str, default="/index.html", help="url.")
+    args = parser.parse_args()
+
+    request = F"GET {args.url} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n".encode()
+    for n in [int(x) for x in args.reactors.split(",")]:
+        if args.reuseport:
+            name, overrides = F"reuseport workers={n}", {"reuseport workers": n, "pin worker cpu": args.pin}
+        else:
+            name, overrides = F"reactors={n}", {"reactor number": n, "reactor dispatch": args.dispatch}
+        with ServerProcess(args.binary, overrides) as server:
+            result = run_load("127.0.0.1", server.port, args.clients, args.benchtime, request)
+            report(name, result, args.benchtime)
@@ -0,0 +1,77 @@
+import argparse
+import os
+import resource
+import socket
+import time
+from bench_common import ServerProcess, tls_context, read_response
+from upload_memory_report import upload
+
+
+def rss_kb(pid):
+    with open(F"/proc/{pid}/status") as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return 0
+
+
+def cpu_seconds(pid):
+    """进程（所有线程）累计的用户态和内核态 CPU 时间。"""
+    with open(F"/proc/{pid}/stat") as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+
+def open_after_post(port, number, size):
+    """建立 number 个 https keep-alive 连接，每个连接先发送一个 size 字节的登录表单，之后保持空闲。"""
+    form = b"username=idle&passwd=pw&type=login&pad=" + b"x" * max(0, size - 39)
+    request = (b"POST /login.action HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n"
+               b"Content-Length: %d\r\n\r\n" % len(form) + form)
+    conns = []
+    for i in range(number):
+        sock = tls_context().wrap_socket(socket.create_connection(("127.0.0.1", port)))
+        sock.sendall(request)
+        read_response(sock)
+        conns.append(sock)
+    return conns
+
+
+# 对比读缓冲区改动前后的两个 server：
+# 1. 通过 https 上传大文件的耗时和 server 消耗的 CPU 时间（请求体经 SSL_read_ex 直接读入读缓冲区，开启预读）；
+# 2. 每个连接先处理一个接近读缓冲区上限的表单，然后保持空闲时，每个连接占用的内存
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="read buffer bench.")
+    parser.add_argument("-b", "--binaries", type=str, default="./server", help="comma separated server binaries.")
+    parser.add_argument("-s", "--size", type=int, default=64, help="upload size in MB.")
+    parser.add_argument("-r", "--rounds", type=int, default=3, help="uploads per binary.")
+    parser.add_argument("-n", "--idle", type=int, default=2000, help="number of idle connections.")
+    parser.add_argument("-f", "--form", type=int, default=60000, help="form size sent before idling.")
+    args = parser.parse_args()
+
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+    for binary in args.binaries.split(","):
+        # 上传大文件时事件循环的一轮可能超过准入控制的阈值，关闭按耗时拒绝，避免下一轮上传的连接被拒绝
+        overrides = {"max body size": args.size + 1, "max http connection": args.idle + 64,
+                     "http timeout": 3600, "admission queue wait": 0}
+        with ServerProcess(binary, overrides) as server:
+            elapsed = 0.0
+            cpu = cpu_seconds(server.pid())
+            for _ in range(args.rounds):
+                start = time.time()
+                status = upload(server.port, True, args.size << 20)
+                elapsed += time.time() - start
+                if status != 200:
+                    print(F"{binary}: upload failed with status {status}")
+            cpu = cpu_seconds(server.pid()) - cpu
+            total = args.size * args.rounds
+            print(F"{binary}")
+            print(F"    https upload {total} MB: {total / elapsed:.1f} MB/s, "
+                  F"server cpu {cpu * 1024 / total:.2f} s/GB")
+            before = rss_kb(server.pid())
+            conns = open_after_post(server.port, args.idle, args.form)
+            during = rss_kb(server.pid())
+            print(F"    {args.idle} idle https connections after a {args.form} byte form: "
+                  F"{(during - before) * 1024 / args.idle:.0f} bytes per connection")
+            for sock in conns:
+                sock.close()
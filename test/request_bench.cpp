@@ -0,0 +1,249 @@
+// HTTPConnection::parseRequest() 的基准：不经过 socket 和 SSL，把 test/corpus 下录制的请求直接喂给连接的解析状态机，
+// 统计每个请求的耗时、吞吐量和堆分配次数。编译运行（在仓库根目录，上传的文件部分写入 resources/images 下的临时文件）：
+//     g++ -O2 -std=c++11 -Isrc test/request_bench.cpp $(ls src/*.cpp | grep -v main.cpp) -pthread -lssl -lcrypto -lz -o request_bench && ./request_bench
+// 每个语料文件是一个或多个连续的请求（流水线），依次用不同的分段大小喂入：
+// "whole" 按 read() 一次最多读入的 64 KB 分段，其余分段大小模拟请求被 TCP 拆开、分多次到达，
+// 覆盖请求行、头部、请求体（包括分块编码和 multipart 上传）在 LINE_OPEN 之后继续解析的路径。
+// 计时之前先检查每种分段大小解析出的请求和整段喂入时完全一致。
+// 用法：./request_bench [语料目录] [每项的计时毫秒数]
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include "httpconnection.h"
+
+static size_t g_allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++g_allocations;
+    void *p = malloc(size ? size : 1);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+// 不绑定 socket 的连接：数据像 read() 那样追加到读缓冲区（multipart 请求体直接交给解析器），
+// 然后调用 parseRequest()，请求完整后像 process() 那样开始下一个请求，但不生成响应
+class RequestHarness
+{
+public:
+    RequestHarness()
+    {
+        m_conn.m_ssl = NULL;
+        m_conn.init();
+    }
+
+    ~RequestHarness()
+    {
+        m_conn.m_multipart.reset();
+        m_conn.freeBuffers();
+    }
+
+    // 喂入 size 个字节，解析出的完整请求的摘要追加到 requests 中（为 NULL 时只计数）。出错返回 -1
+    int feed(const char *data, size_t size, std::vector<std::string> *requests)
+    {
+        int count = 0;
+        while (size > 0)
+        {
+            size_t room = 0;
+            char *buf = m_conn.m_read_buf.prepare(size, room);
+            if (room == 0)
+            {
+                return -1; // 一个请求头超过了读缓冲区的最大长度
+            }
+            size_t len = std::min(size, room);
+            memcpy(buf, data, len);
+            size_t consumed = m_conn.consumeBody(buf, len);
+            if (consumed > 0)
+            {
+                memmove(buf, buf + consumed, len - consumed);
+            }
+            m_conn.m_read_buf.commit(len - consumed);
+            m_conn.m_read_size = m_conn.m_read_buf.size();
+            data += len;
+            size -= len;
+            PARSE_RESULT result;
+            while ((result = m_conn.parseRequest()) == GET_REQUEST)
+            {
+                if (requests)
+                {
+                    requests->push_back(summary());
+                }
+                ++count;
+                m_conn.m_multipart.reset(); // 删除上传的临时文件
+                m_conn.nextRequest();
+            }
+            if (result != NO_REQUEST)
+            {
+                return -1;
+            }
+            m_conn.compactReadBuffer();
+        }
+        return count;
+    }
+
+private:
+    // 解析结果中处理请求时用到的部分
+    std::string summary()
+    {
+        const HTTPParser &parser = m_conn.m_parser;
+        std::string ret = std::to_string(parser.method()) + " " + parser.url().str() + " " +
+                          std::to_string(m_conn.m_content_length) + " " + std::to_string(parser.keepAlive());
+        std::vector<std::string> params;
+        for (auto &param : m_conn.m_parameters)
+        {
+            params.push_back(param.first + "=" + param.second);
+        }
+        std::sort(params.begin(), params.end());
+        for (auto &param : params)
+        {
+            ret += " " + param;
+        }
+        MultipartParser::File *file = m_conn.m_multipart.file("portrait");
+        if (file)
+        {
+            ret += " portrait:" + std::to_string(file->size);
+        }
+        return ret;
+    }
+
+    HTTPConnection m_conn;
+};
+
+static const size_t PIECES[] = {HTTPConnection::MAX_READ_AHEAD, 1460, 64, 7, 1};
+
+static std::string pieceName(size_t piece)
+{
+    return piece == (size_t)HTTPConnection::MAX_READ_AHEAD ? "whole" : "split " + std::to_string(piece);
+}
+
+// 把语料按 piece 字节一段喂入，返回解析出的请求数
+static int feedCorpus(RequestHarness &harness, const std::string &corpus, size_t piece,
+                      std::vector<std::string> *requests)
+{
+    int count = 0;
+    for (size_t pos = 0; pos < corpus.size(); pos += piece)
+    {
+        int ret = harness.feed(corpus.data() + pos, std::min(piece, corpus.size() - pos), requests);
+        if (ret < 0)
+        {
+            return -1;
+        }
+        count += ret;
+    }
+    return count;
+}
+
+static bool check(const std::string &name, const std::string &corpus)
+{
+    std::vector<std::string> expected;
+    {
+        RequestHarness harness;
+        if (feedCorpus(harness, corpus, HTTPConnection::MAX_READ_AHEAD, &expected) <= 0)
+        {
+            fprintf(stderr, "%s: parse failed\n", name.c_str());
+            return false;
+        }
+    }
+    for (size_t piece : PIECES)
+    {
+        std::vector<std::string> requests;
+        RequestHarness harness;
+        if (feedCorpus(harness, corpus, piece, &requests) < 0 || requests != expected)
+        {
+            fprintf(stderr, "%s: %s differs from whole\n", name.c_str(), pieceName(piece).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// 同一个连接上反复喂入语料，和 keep-alive 连接上的连续请求一样
+static void bench(const std::string &corpus, size_t piece, int millis)
+{
+    RequestHarness harness;
+    int requests = feedCorpus(harness, corpus, piece, NULL); // 预热，读缓冲区和首部表达到稳定的容量
+    size_t rounds = 0;
+    size_t allocations = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::milliseconds(millis);
+    auto now = start;
+    do
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            feedCorpus(harness, corpus, piece, NULL);
+        }
+        rounds += 16;
+        now = std::chrono::steady_clock::now();
+    } while (now < end);
+    allocations = g_allocations - allocations;
+    double ns = std::chrono::duration<double, std::nano>(now - start).count();
+    double total = (double)rounds * requests;
+    printf("    %-12s %10.0f ns/request %10.1f MB/s %8.2f allocs/request\n", pieceName(piece).c_str(),
+           ns / total, corpus.size() * rounds / ns * 1e3, allocations / total);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = argc > 1 ? argv[1] : "test/corpus";
+    int millis = argc > 2 ? atoi(argv[2]) : 300;
+    std::vector<std::string> names;
+    DIR *dp = opendir(dir.c_str());
+    if (dp == NULL)
+    {
+        fprintf(stderr, "cannot open corpus directory %s\n", dir.c_str());
+        return 1;
+    }
+    while (dirent *entry = readdir(dp))
+    {
+        std::string name = entry->d_name;
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".http") == 0)
+        {
+            names.push_back(name);
+        }
+    }
+    closedir(dp);
+    std::sort(names.begin(), names.end());
+    HTTPConnection::m_max_body_size = 10 << 20;
+    bool ok = true;
+    for (auto &name : names)
+    {
+        std::string corpus;
+        FILE *fp = fopen((dir + "/" + name).c_str(), "rb");
+        char buf[4096];
+        size_t len;
+        while (fp && (len = fread(buf, 1, sizeof(buf), fp)) > 0)
+        {
+            corpus.append(buf, len);
+        }
+        if (fp)
+        {
+            fclose(fp);
+        }
+        if (!check(name, corpus))
+        {
+            ok = false;
+            continue;
+        }
+        printf("%s (%zu bytes)\n", name.c_str(), corpus.size());
+        for (size_t piece : PIECES)
+        {
+            bench(corpus, piece, millis);
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+import argparse
+import socket
+import threading
+import time
+from bench_common import ServerProcess, run_load, report
+from conn_memory_report import fetch_stats
+
+REQUEST = b"GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n"
+
+
+def slowloris(port, number, interval, stop):
+    """打开 number 个连接，每隔 interval 秒在每个连接上发送一个请求头部的字节，永远不发送结束的空行。
+    连接被 server 关闭后立即重新连接。返回重新连接的次数。"""
+    conns = []
+    reconnects = [0]
+
+    def connect():
+        sock = socket.create_connection(("127.0.0.1", port))
+        sock.sendall(b"GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nX-Slow: ")
+        return sock
+
+    for _ in range(number):
+        try:
+            conns.append(connect())
+        except OSError:
+            pass
+
+    def run():
+        while not stop.is_set():
+            for i, sock in enumerate(conns):
+                try:
+                    sock.sendall(b"a")
+                except OSError:
+                    sock.close()
+                    reconnects[0] += 1
+                    try:
+                        conns[i] = connect()
+                    except OSError:
+                        pass
+            stop.wait(interval)
+        for sock in conns:
+            sock.close()
+
+    thread = threading.Thread(target=run)
+    thread.start()
+    return thread, reconnects
+
+
+# max http connection 个连接全部被缓慢发送头部的客户端占住时，正常客户端能否得到服务。
+# 头部阶段的期限从请求的第一个字节开始计算，不随陆续到达的字节延长，
+# header timeout 较短时慢速连接会被按时关闭，腾出的连接槽位可以服务正常的请求；
+# header timeout 等于 http timeout 时相当于只有一个统一的超时时间
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="normal clients under a slowloris attack.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("-m", "--max-conn", type=int, default=200, help="max http connection.")
+    parser.add_argument("-c", "--clients", type=int, default=8, help="normal clients.")
+    parser.add_argument("-t", "--time", type=int, default=20, help="seconds of normal load.")
+    parser.add_argument("--header-timeouts", type=str, default="120,5", help="header timeouts to compare.")
+    args = parser.parse_args()
+
+    for header_timeout in [int(t) for t in args.header_timeouts.split(",")]:
+        overrides = {"http port": args.http_port, "max http connection": args.max_conn,
+                     "http timeout": 120, "header timeout": header_timeout, "admission queue wait": 0}
+        with ServerProcess(args.binary, overrides) as server:
+            stop = threading.Event()
+            thread, reconnects = slowloris(args.http_port, args.max_conn, 1.0, stop)
+            time.sleep(1)
+            result = run_load("127.0.0.1", args.http_port, args.clients, args.time, REQUEST, tls=False)
+            try:
+                stats = fetch_stats(args.http_port)
+            except (OSError, ValueError, IndexError):
+                stats = {}  # 连接槽位仍然被占满
+            stop.set()
+            thread.join()
+            report(F"header timeout {header_timeout}s", result, args.time)
+            print(F"    slowloris reconnects {reconnects[0]}, timeout_header {stats.get('timeout_header')}, "
+                  F"rejected_conns {stats.get('rejected_conns')}")
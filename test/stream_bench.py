@@ -0,0 +1,55 @@
+import argparse
+import os
+import threading
+import time
+from bench_common import ServerProcess, tls_connect, read_response
+
+
+def hwm_kb(pid):
+    """进程的峰值 RSS（VmHWM）。"""
+    with open(F"/proc/{pid}/status") as f:
+        for line in f:
+            if line.startswith("VmHWM:"):
+                return int(line.split()[1])
+    return 0
+
+
+def download(port, url, results):
+    """下载一次 url，记录 (首字节时间, 总时间, 响应体长度)。"""
+    sock = tls_connect("127.0.0.1", port)
+    start = time.time()
+    sock.sendall(F"GET {url} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n".encode())
+    first = sock.recv(65536)
+    ttfb = time.time() - start
+    status, headers, body, rest = read_response(sock, first)
+    results.append((ttfb, time.time() - start, len(body)))
+    sock.close()
+
+
+# 关闭内核 TLS 时，HTTPS 连接上的静态文件在用户态读出并加密。
+# clients 个客户端同时下载一个大文件，统计首字节时间、下载时间和 server 的峰值内存
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="large response streaming bench.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-c", "--clients", type=int, default=8, help="number of concurrent downloads.")
+    parser.add_argument("-s", "--size", type=int, default=64, help="file size in MB.")
+    args = parser.parse_args()
+
+    url = "/stream_bench.bin"
+    with ServerProcess(args.binary, {"ktls": False}) as server:
+        with open(os.path.join(server.workdir, "resources", url[1:]), "wb") as f:
+            f.write(os.urandom(args.size << 20))
+        before = hwm_kb(server.pid())
+        results = []
+        threads = [threading.Thread(target=download, args=(server.port, url, results)) for _ in range(args.clients)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        after = hwm_kb(server.pid())
+    ttfb = sorted(r[0] for r in results)
+    total = sorted(r[1] for r in results)
+    print(F"{args.clients} x {args.size} MB over https: ttfb p50={ttfb[len(ttfb) // 2] * 1000:.1f}ms "
+          F"max={ttfb[-1] * 1000:.1f}ms, download p50={total[len(total) // 2]:.2f}s, "
+          F"bodies ok={sum(r[2] == args.size << 20 for r in results)}/{len(results)}, "
+          F"peak rss {before} KB -> {after} KB (+{after - before} KB)")
@@ -0,0 +1,26 @@
+import argparse
+import ssl
+from bench_common import ServerProcess, run_load, report
+
+# 短连接场景下对比完整握手和会话恢复（会话缓存 / 会话票据）的吞吐量，每个请求都重新建立 TLS 连接
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="tls session resumption bench.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-t", "--benchtime", type=float, default=10.0, help="bench time of each round.")
+    parser.add_argument("-c", "--clients", type=int, default=32, help="number of clients.")
+    parser.add_argument("-u", "--url", type=str, default="/index.html", help="url.")
+    args = parser.parse_args()
+
+    request = F"GET {args.url} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n".encode()
+    rounds = [
+        ("no resumption", {"ssl session cache size": 0, "ssl ticket key rotation": 0}),
+        ("session cache", {"ssl ticket key rotation": 0}),
+        ("session ticket", {"ssl session cache size": 0}),
+    ]
+    for version in [ssl.TLSVersion.TLSv1_2, ssl.TLSVersion.TLSv1_3]:
+        for name, overrides in rounds:
+            with ServerProcess(args.binary, overrides) as server:
+                result = run_load("127.0.0.1", server.port, args.clients, args.benchtime, request,
+                                  reconnect=True, resume=True, max_version=version)
+                report(F"{version.name} {name}", result, args.benchtime)
+                print(F"    resumed {result.resumed}/{result.connects} connections")
@@ -0,0 +1,77 @@
+import argparse
+import os
+import signal
+import socket
+import subprocess
+import threading
+import time
+from bench_common import ServerProcess, run_load, report
+
+
+def children(pid):
+    try:
+        with open(F"/proc/{pid}/task/{pid}/children") as f:
+            return [int(p) for p in f.read().split()]
+    except OSError:
+        return []
+
+
+def wait_port(port, timeout=10.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=1.0).close()
+            return True
+        except OSError:
+            time.sleep(0.01)
+    return False
+
+
+def restart(server):
+    """普通重启：结束旧进程后在同一目录启动新进程。"""
+    server.proc.terminate()
+    server.proc.wait()
+    server.proc = subprocess.Popen(server.proc.args, cwd=server.workdir,
+                                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    wait_port(server.port)
+
+
+def hot_upgrade(server):
+    """热升级：向旧进程发送 SIGUSR2，新进程是它的子进程，旧进程排空连接后退出。"""
+    old = server.proc
+    os.kill(old.pid, signal.SIGUSR2)
+    new_pid = None
+    while new_pid is None and old.poll() is None:
+        pids = children(old.pid)
+        new_pid = pids[0] if pids else None
+        time.sleep(0.01)
+    old.wait()
+    server.upgraded_pid = new_pid
+
+
+# 在持续的 keep-alive 负载下部署一次，对比普通重启和热升级期间失败的请求数和最大延迟
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="hot upgrade vs restart bench.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-t", "--benchtime", type=float, default=6.0, help="bench time of each round.")
+    parser.add_argument("-c", "--clients", type=int, default=16, help="number of clients.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("--tls", action="store_true", help="use https connections instead of plain http.")
+    args = parser.parse_args()
+
+    request = b"GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n"
+    for name, deploy in [("restart", restart), ("hot upgrade (SIGUSR2)", hot_upgrade)]:
+        server = ServerProcess(args.binary, {"http port": args.http_port, "upgrade drain timeout": 10})
+        server.upgraded_pid = None
+        try:
+            port = server.port if args.tls else args.http_port
+            timer = threading.Timer(args.benchtime / 3, deploy, [server])
+            timer.start()
+            result = run_load("127.0.0.1", port, args.clients, args.benchtime, request, tls=args.tls)
+            timer.join()
+            report(name, result, args.benchtime)
+            print(F"    max latency {result.percentile(100) * 1000:.1f}ms, {result.connects} connects")
+        finally:
+            if server.upgraded_pid:
+                os.kill(server.upgraded_pid, signal.SIGTERM)
+            server.stop()
@@ -0,0 +1,84 @@
+import argparse
+import os
+import socket
+import time
+from bench_common import ServerProcess, tls_context, read_response
+
+BOUNDARY = b"UploadMemoryReportBoundary"
+CHUNK = 1 << 20
+
+
+def hwm_kb(pid):
+    """进程的峰值 RSS（VmHWM）。"""
+    with open(F"/proc/{pid}/status") as f:
+        for line in f:
+            if line.startswith("VmHWM:"):
+                return int(line.split()[1])
+    return 0
+
+
+def connect(port, tls):
+    sock = socket.create_connection(("127.0.0.1", port))
+    return tls_context().wrap_socket(sock) if tls else sock
+
+
+def request(sock, head, body=b""):
+    sock.sendall(head + body)
+    return read_response(sock)
+
+
+def upload(port, tls, size):
+    """注册一个新用户后上传 size 字节的头像，请求体按 1 MB 分块发送。返回状态码。"""
+    sock = connect(port, tls)
+    user = F"mem{int(time.time() * 1000000)}".encode()
+    form = b"username=" + user + b"&passwd=pw&type=register"
+    request(sock, b"POST /login.action HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n"
+                  b"Content-Length: %d\r\n\r\n" % len(form), form)
+    head = (b"--" + BOUNDARY + b"\r\nContent-Disposition: form-data; name=\"signature\"\r\n\r\nmemory report\r\n"
+            b"--" + BOUNDARY + b"\r\nContent-Disposition: form-data; name=\"portrait\"; filename=\"big.png\"\r\n"
+            b"Content-Type: image/png\r\n\r\n")
+    tail = b"\r\n--" + BOUNDARY + b"--\r\n"
+    sock.sendall(b"POST /upload.action HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n"
+                 b"Content-Type: multipart/form-data; boundary=" + BOUNDARY + b"\r\n"
+                 b"Content-Length: %d\r\n\r\n" % (len(head) + size + len(tail)) + head)
+    chunk = os.urandom(CHUNK)
+    sent = 0
+    while sent < size:
+        n = min(CHUNK, size - sent)
+        sock.sendall(chunk[:n])
+        sent += n
+    sock.sendall(tail)
+    status = read_response(sock)[0]
+    sock.close()
+    return status
+
+
+# 依次上传不同大小的头像，每次都启动新的 server 进程，比较上传前后的峰值 RSS。
+# 请求体由 multipart 解析器边接收边写入临时文件，峰值 RSS 的增量不应随上传大小增长
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="peak memory of large uploads.")
+    parser.add_argument("-b", "--binary", type=str, default="./server", help="server binary.")
+    parser.add_argument("-s", "--sizes", type=str, default="1,16,64", help="upload sizes in MB.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("--tls", action="store_true", help="upload over https instead of plain http.")
+    args = parser.parse_args()
+
+    sizes = [int(s) for s in args.sizes.split(",")]
+    for size in sizes:
+        overrides = {"http port": args.http_port, "max body size": max(sizes) + 1}
+        with ServerProcess(args.binary, overrides) as server:
+            port = server.port if args.tls else args.http_port
+            before = hwm_kb(server.pid())
+            start = time.time()
+            status = upload(port, args.tls, size << 20)
+            elapsed = time.time() - start
+            after = hwm_kb(server.pid())
+            print(F"upload {size} MB ({'https' if args.tls else 'http'}): status {status}, {elapsed:.2f}s, "
+                  F"peak rss {before} KB -> {after} KB (+{after - before} KB)")
+    # 超过 max body size 的请求在解析完头部后就被拒绝，不需要发送请求体
+    with ServerProcess(args.binary, {"http port": args.http_port, "max body size": 1}) as server:
+        sock = connect(server.port if args.tls else args.http_port, args.tls)
+        status = request(sock, b"POST /upload.action HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                               b"Content-Type: multipart/form-data; boundary=" + BOUNDARY + b"\r\n"
+                               b"Content-Length: %d\r\n\r\n" % (2 << 20))[0]
+        print(F"upload 2 MB with max body size 1 MB: status {status}")
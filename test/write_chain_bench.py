@@ -0,0 +1,77 @@
+import argparse
+import os
+import socket
+import threading
+import time
+from bench_common import ServerProcess, tls_context
+from read_buffer_bench import cpu_seconds
+
+
+def slow_download(port, tls, path, rounds, rcvbuf, piece):
+    """用很小的接收缓冲区、每次只读 piece 字节下载 rounds 次 path，server 每次只能发送出一小部分响应。
+    返回读到的字节数。"""
+    total = 0
+    request = F"GET {path} HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: keep-alive\r\n\r\n".encode()
+    sock = socket.socket()
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+    sock.connect(("127.0.0.1", port))
+    if tls:
+        sock = tls_context().wrap_socket(sock)
+    for _ in range(rounds):
+        sock.sendall(request)
+        buf = b""
+        while b"\r\n\r\n" not in buf:
+            buf += sock.recv(piece)
+        head, body = buf.split(b"\r\n\r\n", 1)
+        length = int([line.split(b":")[1] for line in head.split(b"\r\n")
+                      if line.lower().startswith(b"content-length")][0])
+        received = len(body)
+        while received < length:
+            data = sock.recv(min(piece, length - received))
+            if not data:
+                raise OSError("connection closed")
+            received += len(data)
+        total += len(head) + 4 + length
+    sock.close()
+    return total
+
+
+# 对比写缓冲区改动前后的两个 server：clients 个接收很慢的客户端下载缓存中的大文件时 server 消耗的 CPU 时间。
+# 改动之前响应体被复制进写缓冲区，每次部分发送后剩下的部分再被复制一次（O(n²)）；
+# 改动之后响应体引用缓存中的文件，部分发送只前移发送位置
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="large responses to slow clients.")
+    parser.add_argument("-b", "--binaries", type=str, default="./server", help="comma separated server binaries.")
+    parser.add_argument("-p", "--http-port", type=int, default=10087, help="plain http port.")
+    parser.add_argument("-s", "--size", type=int, default=1000, help="file size in KB, must fit in the file cache.")
+    parser.add_argument("-c", "--clients", type=int, default=8, help="concurrent slow clients.")
+    parser.add_argument("-r", "--rounds", type=int, default=10, help="downloads per client.")
+    parser.add_argument("--rcvbuf", type=int, default=4096, help="client SO_RCVBUF.")
+    parser.add_argument("--piece", type=int, default=4096, help="bytes per client recv.")
+    args = parser.parse_args()
+
+    for binary in args.binaries.split(","):
+        for tls in [False, True]:
+            overrides = {"http port": args.http_port, "admission queue wait": 0}
+            with ServerProcess(binary, overrides) as server:
+                with open(os.path.join(server.workdir, "resources", "large.bin"), "wb") as f:
+                    f.write(os.urandom(args.size << 10))
+                port = server.port if tls else args.http_port
+                slow_download(port, tls, "/large.bin", 1, args.rcvbuf, args.piece)  # 放入文件缓存
+                cpu = cpu_seconds(server.pid())
+                start = time.time()
+                totals = [0] * args.clients
+
+                def run(i):
+                    totals[i] = slow_download(port, tls, "/large.bin", args.rounds, args.rcvbuf, args.piece)
+
+                threads = [threading.Thread(target=run, args=(i,)) for i in range(args.clients)]
+                for thread in threads:
+                    thread.start()
+                for thread in threads:
+                    thread.join()
+                elapsed = time.time() - start
+                cpu = cpu_seconds(server.pid()) - cpu
+                mb = sum(totals) / float(1 << 20)
+                print(F"{binary} {'https' if tls else 'http'}: {mb:.0f} MB in {elapsed:.1f}s, "
+                      F"{mb / elapsed:.1f} MB/s, server cpu {cpu * 1024 / mb:.2f} s/GB")